@@ -4,14 +4,69 @@ var events = require('events');
 
 /*
  One function to send an animation to Tessel.
- Data gets sent on the GPIO bank's G4
+ Data gets sent on the GPIO bank's G4, or in parallel on each of up to
+ three PWM pins (G4, G5, G6) with one animation buffer per pin.
 */
 
+function pinBuffer (pins) {
+  var buf = new Buffer(pins.length);
+  for (var i = 0; i < pins.length; i++) {
+    buf[i] = typeof pins[i] == 'number' ? pins[i] : pins[i].pin;
+  }
+  return buf;
+}
+
+function sctError (status, invalid) {
+  if (status < 0) {
+    return new Error(invalid);
+  } else if (status) {
+    return new Error("SCT is already in use by "+['Inactive','PWM','Read Pulse','Neopixels','Counter'][status]);
+  }
+  return null;
+}
+
 function Neopixels() {
-  this.animate = function(numPixels, animationData, callback) {
-    var sctStatus = hw.neopixel_animation_buffer(numPixels * 3, animationData);
-    if (sctStatus) {
-      callback && callback(new Error("SCT is already in use by "+['Inactive','PWM','Read Pulse','Neopixels'][sctStatus]));
+  this._transform = {};
+
+  /*
+   Frame transforms, applied natively as frames are sent so animations can
+   be plain RGB:
+     gamma: exponent (e.g. 2.8), or a 256 entry lookup table
+     brightness: 0 to 1, for the whole strip
+     pixelBrightness: 0 to 255 per pixel, on top of brightness
+     order: the strip's byte order, e.g. 'grb' for WS2812. Without it frames
+       are sent as given.
+     fade: number of frames blended in between each pair of frames
+  */
+  this.setTransform = function(transform) {
+    this._transform = transform || {};
+  }
+
+  this._applyTransform = function(fade) {
+    var t = this._transform;
+    var gamma = t.gamma == null ? 1 : typeof t.gamma == 'number' ? t.gamma : new Buffer(t.gamma);
+    var brightness = t.brightness == null ? 255 : Math.round(Math.max(0, Math.min(1, t.brightness)) * 255);
+    var pixelBrightness = new Buffer(t.pixelBrightness || 0);
+    return hw.neopixel_transform(gamma, brightness, t.order || 'rgb', pixelBrightness, fade ? t.fade || 0 : 0);
+  }
+
+  this.animate = function(numPixels, animationData, pins, callback) {
+    if (typeof pins == 'function') {
+      callback = pins;
+      pins = null;
+    }
+    if (!Array.isArray(animationData)) {
+      animationData = [animationData];
+    }
+    pins = pins || [hw.PIN_E_G4];
+
+    var sctStatus = pins.length == animationData.length ? this._applyTransform(true) : -1;
+    if (sctStatus == 0) {
+      sctStatus = hw.neopixel_animation_buffer.apply(hw, [numPixels * 3, pinBuffer(pins)].concat(animationData));
+    }
+    var err = sctError(sctStatus, "Invalid neopixel animation: one animation per pin, on up to three PWM pins, and a valid transform");
+    if (err) {
+      callback && callback(err);
     } else {
       // When we finish sending the animation
       process.once('neopixel_animation_complete', function animationComplete() {
@@ -25,6 +80,44 @@ function Neopixels() {
       }.bind(this));
     }
   }
+
+  /*
+   Streams live frames, double buffered natively: each frame is every
+   strip's pixels in turn, and is shown from the next frame boundary. Frames
+   come from write(), from USB messages tagged 0x4E000000 | offset, or with
+   opts.port from UDP packets of a 24 bit big endian offset then the bytes.
+   opts.pins defaults to [G4].
+  */
+  this.stream = function(numPixels, opts, callback) {
+    if (typeof opts == 'function') {
+      callback = opts;
+      opts = null;
+    }
+    opts = opts || {};
+    var pins = opts.pins || [hw.PIN_E_G4];
+
+    var sctStatus = this._applyTransform(false);
+    if (sctStatus == 0) {
+      sctStatus = hw.neopixel_stream_begin(numPixels * 3, pinBuffer(pins), opts.port || 0);
+    }
+    var err = sctError(sctStatus, "Invalid neopixel stream: up to three PWM pins, a valid transform and a free UDP port");
+    callback && callback(err);
+    return !err;
+  }
+
+  // Queues part of a frame at a byte offset, or a whole frame
+  this.write = function(data, offset) {
+    return hw.neopixel_stream_write(data, offset || 0) == 0;
+  }
+
+  this.stats = function() {
+    return { shown: hw.neopixel_stream_shown(), dropped: hw.neopixel_stream_dropped() };
+  }
+
+  this.stop = function() {
+    hw.neopixel_stream_stop();
+    this.emit('end');
+  }
 }
 
 util.inherits(Neopixels, events.EventEmitter);
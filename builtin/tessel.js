@@ -14,6 +14,9 @@ var clone = require('_structured_clone');
 
 var tm = process.binding('tm');
 var hw = process.binding('hw');
+// LuaJIT builds call the scalar hw_* functions through the FFI (see
+// tools/gen_ffi.js), skipping the Lua C API stubs on hot GPIO paths.
+var hwfast = hw.ffi_enabled ? hw.ffi : hw;
 
 var tessel_version = process.versions.tessel_board;
 
@@ -115,6 +118,29 @@ process.on('interrupt', function interruptFired(interruptId, trigger, time) {
 });
 
 
+// Edges captured in the interrupt handler, delivered in batches. `edges` holds
+// [time us][trigger bit flag] little-endian uint32 pairs, oldest first, and
+// `overflow` counts edges lost because JS fell behind. Each edge is emitted
+// with the time it was captured; 'edges' gets the whole batch.
+function readUInt32 (buf, offset) {
+  return (buf[offset] | (buf[offset + 1] << 8) | (buf[offset + 2] << 16) | (buf[offset + 3] << 24)) >>> 0;
+}
+
+process.on('interrupt_edges', function interruptEdges(interruptId, edges, overflow) {
+  var pin = board.interrupts[interruptId];
+  if (!pin || !pin.interrupts.edge) {
+    return;
+  }
+
+  for (var i = 0; i + 8 <= edges.length; i += 8) {
+    var time = readUInt32(edges, i);
+    var trigger = readUInt32(edges, i + 4) == _bitFlags.rise ? 'rise' : 'fall';
+    pin.emit('change', time, trigger);
+    pin.emit(trigger, time, trigger);
+  }
+  pin.emit('edges', edges, overflow);
+});
+
 function Pin (pin) {
   this.pin = pin;
   this.interrupts = {};
@@ -344,7 +370,7 @@ Pin.prototype.pull = function(mode, next){
     throw new Error("Pin modes can only be 'pullup', 'pulldown', or 'none'");
   }
 
-  hw.digital_set_mode(this.pin, pinModes[mode]);
+  hwfast.digital_set_mode(this.pin, pinModes[mode]);
   
   if (next) {
     setImmediate(next);
@@ -354,7 +380,7 @@ Pin.prototype.pull = function(mode, next){
 }
 
 Pin.prototype.mode = function(next){
-  var mode = hw.digital_get_mode(this.pin);
+  var mode = hwfast.digital_get_mode(this.pin);
   var val;
   if (mode == pinModes.pullup) {
     val = 'pullup';
@@ -384,15 +410,15 @@ Pin.prototype.mode = function(next){
 
 Pin.prototype.rawDirection = function (isOutput) {
   if (isOutput) {
-    hw.digital_output(this.pin);
+    hwfast.digital_output(this.pin);
   } else {
-    hw.digital_input(this.pin);
+    hwfast.digital_input(this.pin);
   }
   return this;
 };
 
 Pin.prototype.rawRead = function rawRead(next) {
-  var val = hw.digital_read(this.pin);
+  var val = hwfast.digital_read(this.pin);
   if (next) {
     setImmediate(function() { next(null, val); });
   }
@@ -400,7 +426,7 @@ Pin.prototype.rawRead = function rawRead(next) {
 };
 
 Pin.prototype.rawWrite = function rawWrite(value, next) {
-  hw.digital_write(this.pin, value ? hw.HIGH : hw.LOW);
+  hwfast.digital_write(this.pin, value ? hw.HIGH : hw.LOW);
   if (next) {
     setImmediate(function() { next(null, val); });
   }
@@ -487,16 +513,20 @@ Pin.prototype.readPulse = function(type, timeout, callback) {
   }
 
   // call the read pulse function
-  var sctStatus = hw.sct_read_pulse(typeMode, timeout);
+  var sctStatus = hw.sct_read_pulse(this.pin, typeMode, timeout);
+
+  // if the pin has no SCT input
+  if (sctStatus < 0) {
+    throw new Error('Pulses can only be read on pins routed to an SCT input: GPIO bank G2 and G3, port C G2 and the config button');
 
   // if the SCT was in use by another process
-  if (sctStatus) {
-    err = new Error("SCT is already in use by "+['Inactive','PWM','Read Pulse','Neopixels'][sctStatus]);
+  } else if (sctStatus) {
+    err = new Error("SCT is already in use by "+['Inactive','PWM','Read Pulse','Neopixels','Counter'][sctStatus]);
     callback(err,0);
 
-  // if there's nothing wrong then trigger event complete
+  // if there's nothing wrong then wait for this pin's pulse
   } else {
-    process.once('read_pulse_complete', cb_read_pulse_complete);    
+    pulseCallbacks[this.pin] = cb_read_pulse_complete;
   }
 
   // calls the provided callback with an error if there was a timeout
@@ -512,6 +542,132 @@ Pin.prototype.readPulse = function(type, timeout, callback) {
 
 }
 
+// Pulse results arrive per pin, so pins measure concurrently.
+var pulseCallbacks = {};
+
+process.on('read_pulse_complete', function (pulsetime, pin) {
+  var callback = pulseCallbacks[pin];
+  delete pulseCallbacks[pin];
+  if (callback) {
+    callback(pulsetime);
+  }
+});
+
+process.on('read_pulses', function (pin, pulses, overflow, done) {
+  var callback = pulseCallbacks[pin];
+  if (done) {
+    delete pulseCallbacks[pin];
+  }
+  if (callback) {
+    callback(pulses, overflow, done);
+  }
+});
+
+// Records consecutive pulse widths with the SCT, for IR remotes, DHT-style
+// sensors and the like, on the pins readPulse works on. Widths are timed in
+// hardware and delivered in batches of `opts.count` (default 100, at most
+// 256): 'data' gets (widths in microseconds, levels with 1 for a high pulse,
+// the raw buffer of [ticks][level] uint32 pairs). Recording ends after one
+// batch unless `opts.continuous`, or once the pin stays put for
+// `opts.timeout` ms (default 1000), or on stop(); 'end' follows.
+// `callback(err, widths, levels)` gets the first batch.
+function PulseReader (pin, opts, callback) {
+  var self = this;
+  opts = opts || {};
+  this.pin = pin.pin;
+  var status = hw.sct_read_pulses(this.pin, opts.count || 100, opts.timeout || 1000, !!opts.continuous);
+  if (status < 0) {
+    throw new Error('Pulse streams need a pin routed to an SCT input and a count of at most 256');
+  } else if (status) {
+    throw new Error("SCT is already in use by "+['Inactive','PWM','Read Pulse','Neopixels','Counter'][status]);
+  }
+
+  function onPulses (pulses, overflow, done) {
+    var widths = [], levels = [];
+    for (var i = 0; i + 8 <= pulses.length; i += 8) {
+      widths.push(readUInt32(pulses, i) / hw.SCT_TICKS_PER_US);
+      levels.push(readUInt32(pulses, i + 4));
+    }
+    if (overflow) {
+      self.emit('overflow', overflow);
+    }
+    if (widths.length) {
+      self.emit('data', widths, levels, pulses);
+    }
+    if (callback) {
+      callback(widths.length ? null : new Error('SCT timed out while attempting to read pulses'), widths, levels);
+      callback = null;
+    }
+    if (done) {
+      self.emit('end');
+    }
+  }
+  pulseCallbacks[this.pin] = onPulses;
+}
+
+util.inherits(PulseReader, EventEmitter);
+
+PulseReader.prototype.stop = function () {
+  hw.sct_read_pulses_stop(this.pin);
+};
+
+Pin.prototype.readPulses = function (opts, callback) {
+  if (typeof opts == 'function') {
+    callback = opts;
+    opts = {};
+  }
+  return new PulseReader(this, opts, callback);
+};
+
+// Counts edges without a JS event per edge. Emits 'count' (count, frequency
+// in Hz, elapsed microseconds) once per `window` ms (default 1000). `edge` is
+// 'rise' (default), 'fall' or 'change'. With `hardware: true` the SCT counts
+// the edges itself, which only works on GPIO bank G3 and for one edge;
+// otherwise one of the seven pin interrupts is used.
+var counters = {};
+
+function EdgeCounter (pin, opts) {
+  opts = opts || {};
+  var edge = opts.edge || 'rise';
+  if (!(edge in _bitFlags) || _triggerTypeForMode(edge) != 'edge') {
+    throw new Error('Edge counters count rise, fall or change');
+  }
+
+  if (opts.hardware) {
+    this.id = hw.COUNTER_SCT;
+  } else {
+    this.id = hw.acquire_available_interrupt();
+    if (this.id < 0) {
+      throw new Error("All seven GPIO interrupts are currently active.");
+    }
+  }
+
+  if (hw.counter_start(this.id, pin.pin, _bitFlags[edge], opts.window || 1000) < 0) {
+    throw new Error(opts.hardware ? 'Hardware counting needs GPIO G3, a single edge and a free SCT' : 'Could not start edge counter');
+  }
+  counters[this.id] = this;
+}
+
+util.inherits(EdgeCounter, EventEmitter);
+
+EdgeCounter.prototype.stop = function () {
+  if (counters[this.id] === this) {
+    hw.counter_stop(this.id);
+    delete counters[this.id];
+  }
+};
+
+process.on('counter', function (id, count, elapsed) {
+  var counter = counters[id];
+  if (counter) {
+    counter.emit('count', count, elapsed ? count * 1e6 / elapsed : 0, elapsed);
+  }
+});
+
+Pin.prototype.countEdges = function (opts) {
+  return new EdgeCounter(this, opts);
+};
+
 Pin.prototype.pulseIn = function(type, timeout, callback) {
   console.warn('pin.pulseIn() is deprecated. Use pin.readPulse() instead.');
   this.readPulse(type, timeout, callback);
@@ -599,7 +755,7 @@ AnalogPin.prototype.readSync = function () {
 };
 
 AnalogPin.prototype.read = function (next) {
-  return hw.analog_read(this.pin) / ANALOG_RESOLUTION;
+  return hwfast.analog_read(this.pin) / ANALOG_RESOLUTION;
 };
 
 /**
@@ -609,21 +765,90 @@ AnalogPin.prototype.read = function (next) {
 function PWMPin(pin) {
   Pin.call(this, pin);
   this.isPWM = true;
+  this._pwmGroup = 0;
 }
 
 util.inherits(PWMPin, Pin);
 
+// Pulse widths in clock ticks for duty cycles of the pin's period
+PWMPin.prototype._pwmPulsewidth = function (dutyCycle) {
+  var period = pwmPeriods[this._pwmGroup];
+  if (!period) {
+    throw new Error("PWM is not configured. Call `port.pwmFrequency(freq" + (this._pwmGroup ? ", " + this._pwmGroup : "") + ")` first.");
+  }
+  if (dutyCycle > 1) dutyCycle = 1;
+  if (dutyCycle < 0) dutyCycle = 0;
+  return Math.round(dutyCycle * period);
+};
+
 PWMPin.prototype.pwmDutyCycle = function (dutyCycle) {
-  if (pwmPeriod) {
-    if (dutyCycle > 1) dutyCycle = 1;
-    if (dutyCycle < 0) dutyCycle = 0;
+  var status = hwfast.pwm_pin_pulsewidth(this.pin, this._pwmPulsewidth(dutyCycle));
+  if (status < 0) {
+    throw new Error("PWM is not suported on this pin");
+  } else if (status) {
+    throw new Error("SCT is already in use by "+['Inactive','PWM','Read Pulse','Neopixels','Counter'][status]);
+  }
+};
+
+// Moves the pin to period group 0 or 1, each with its own frequency
+PWMPin.prototype.pwmGroup = function (group) {
+  if (hwfast.pwm_pin_group(this.pin, group) < 0) {
+    throw new Error("PWM period groups are 0 and 1");
+  }
+  this._pwmGroup = group;
+};
+
+// Only one sequence plays at a time
+var pwmSequenceListener = null;
+
+function pwmSequenceForget () {
+  if (pwmSequenceListener) {
+    process.removeListener('pwm_sequence_complete', pwmSequenceListener);
+    pwmSequenceListener = null;
+  }
+}
 
-    if (hw.pwm_pin_pulsewidth(this.pin, Math.round(dutyCycle * pwmPeriod)) !== 0) {
-      throw new Error("PWM is not suported on this pin");
+// Plays an array of duty cycles, one per PWM period, fed by DMA. Calls back
+// once the last is reached, or with opts.repeat loops until
+// pwmSequenceStop() or another duty cycle is set.
+PWMPin.prototype.pwmSequence = function (dutyCycles, opts, callback) {
+  if (typeof opts == 'function') {
+    callback = opts;
+    opts = null;
+  }
+  opts = opts || {};
+
+  var buf = new Buffer(dutyCycles.length * 4);
+  for (var i = 0; i < dutyCycles.length; i++) {
+    var ticks = this._pwmPulsewidth(dutyCycles[i]);
+    for (var b = 0; b < 4; b++) {
+      buf[i * 4 + b] = (ticks >>> (b * 8)) & 0xff;
     }
-  } else {
-    throw new Error("PWM is not configured. Call `port.pwmFrequency(freq)` first.");
   }
+
+  // A sequence stopped early never completes, so drop its callback
+  pwmSequenceForget();
+  var status = hw.pwm_pin_sequence(this.pin, buf, !!opts.repeat);
+  if (status < 0) {
+    throw new Error("Could not start PWM sequence: it needs a PWM pin and at least one duty cycle");
+  } else if (status) {
+    throw new Error("SCT is already in use by "+['Inactive','PWM','Read Pulse','Neopixels','Counter'][status]);
+  }
+
+  if (!opts.repeat) {
+    pwmSequenceListener = function (error) {
+      pwmSequenceListener = null;
+      if (callback) {
+        callback(error ? new Error('PWM sequence DMA error') : null);
+      }
+    };
+    process.once('pwm_sequence_complete', pwmSequenceListener);
+  }
+};
+
+PWMPin.prototype.pwmSequenceStop = function () {
+  hw.pwm_sequence_stop();
+  pwmSequenceForget();
 };
 
 /**
@@ -1408,7 +1633,7 @@ var SPIChipSelectMode = {
  * Ports
  */
 
- var pwmPeriod = 0; // PWM period in clock ticks
+ var pwmPeriods = [0, 0]; // PWM period in clock ticks, per period group
 
 function Port (id, digital, analog, pwm, i2c, uart)
 {
@@ -1461,17 +1686,252 @@ Port.prototype.SPI = function (format, port){
 };
 
 Port.prototype.pinOutput = function (n) {
-  hw.digital_output(n);
+  hwfast.digital_output(n);
 };
 
 Port.prototype.digitalWrite = function (n, val) {
-  hw.digital_write(n, val ? hw.HIGH : hw.LOW);
+  hwfast.digital_write(n, val ? hw.HIGH : hw.LOW);
 };
 
-Port.prototype.pwmFrequency = function (frequency) {
+// Batched GPIO. `pins` is a list of Pins or pin numbers (the port's digital
+// pins if omitted) and bit i of `values` is pins[i]. Pins on the same GPIO
+// bank are written in one register store, so a parallel bus changes at once.
+// Pins must already be outputs (see pin.output()) for writes to show.
+function pinBuffer (pins) {
+  var buf = new Buffer(pins.length);
+  for (var i = 0; i < pins.length; i++) {
+    buf[i] = typeof pins[i] == 'number' ? pins[i] : pins[i].pin;
+  }
+  return buf;
+}
+
+function pinValues (values) {
+  if (typeof values == 'number') {
+    return values >>> 0;
+  }
+  var bits = 0;
+  for (var i = 0; i < values.length; i++) {
+    if (values[i]) {
+      bits |= 1 << i;
+    }
+  }
+  return bits >>> 0;
+}
+
+function writePins (pins, values) {
+  if (hw.digital_write_pins(pins, pinValues(values)) < 0) {
+    throw new Error('writePins takes at most 32 GPIO pins');
+  }
+}
+
+function readPins (pins) {
+  var bits = hw.digital_read_pins(pins);
+  if (bits < 0) {
+    throw new Error('readPins takes at most 32 GPIO pins');
+  }
+  return bits;
+}
+
+Port.prototype.writePins = function (values, pins) {
+  if (!pins) {
+    this._pinBuffer = this._pinBuffer || pinBuffer(this.digital);
+  }
+  writePins(pins ? pinBuffer(pins) : this._pinBuffer, values);
+  return this;
+};
+
+// Returns the levels of all `pins` as a bitmask, sampled together.
+Port.prototype.readPins = function (pins) {
+  if (!pins) {
+    this._pinBuffer = this._pinBuffer || pinBuffer(this.digital);
+  }
+  return readPins(pins ? pinBuffer(pins) : this._pinBuffer);
+};
+
+// Watches a set of pins for any change using one of the two GPIO group
+// interrupts, independent of the seven pin interrupts. Emits
+// 'change' (changed, levels, time) per detected change, where bit i of
+// `changed` and `levels` is pins[i] and `time` is the capture time in us,
+// and 'overflow' (count) when changes were dropped.
+var pinGroups = [];
+
+function PinGroup (pins) {
+  this.pins = pins.slice();
+  this.id = -1;
+  for (var i = 0; i < hw.GINT_COUNT; i++) {
+    if (!pinGroups[i]) {
+      this.id = i;
+      break;
+    }
+  }
+  if (this.id < 0) {
+    throw new Error('Both GPIO group interrupts are in use');
+  }
+
+  this.levels = hw.gint_watch(this.id, pinBuffer(this.pins));
+  if (this.levels < 0) {
+    throw new Error('watchPins takes 1 to 32 GPIO pins');
+  }
+  pinGroups[this.id] = this;
+}
+
+util.inherits(PinGroup, EventEmitter);
+
+PinGroup.prototype.stop = function () {
+  if (this.id >= 0) {
+    hw.gint_unwatch(this.id);
+    pinGroups[this.id] = null;
+    this.id = -1;
+  }
+};
+
+process.on('gint_change', function (id, changes, overflow) {
+  var group = pinGroups[id];
+  if (!group) {
+    return;
+  }
+  for (var i = 0; i + 12 <= changes.length; i += 12) {
+    group.levels = readUInt32(changes, i + 8);
+    group.emit('change', readUInt32(changes, i + 4), group.levels, readUInt32(changes, i));
+  }
+  if (overflow) {
+    group.emit('overflow', overflow);
+  }
+});
+
+Port.prototype.watchPins = function (pins) {
+  return new PinGroup(pins || this.digital);
+};
+
+// Motor control PWM on `pins`, each routed to whichever of the three
+// channels' A or complementary B output it carries. `opts.frequency` in Hz
+// (default 20kHz), `opts.deadtime` between A and B switching in ns (at most
+// about 5600), `opts.edge` for edge- instead of center-aligned pulses,
+// `opts.ac` to run all channels in step for a three-phase bridge, `opts.dc`
+// to commutate channel 0 across the outputs and `opts.activeLow` for
+// outputs that idle high.
+var MCPWM_CLOCK = 180000000;
+
+function MotorPWM (pins, opts) {
+  opts = opts || {};
+  this.period = Math.round(MCPWM_CLOCK / (opts.frequency || 20000));
+  var deadtime = Math.round((opts.deadtime || 0) * MCPWM_CLOCK / 1e9);
+  var flags = (opts.edge ? 0 : hw.MCPWM_CENTER)
+    | (opts.ac ? hw.MCPWM_AC : 0)
+    | (opts.dc ? hw.MCPWM_DC : 0)
+    | (opts.activeLow ? hw.MCPWM_ACTIVE_LOW : 0);
+  if (hw.mcpwm_start(pinBuffer(pins), this.period, deadtime, flags) < 0) {
+    throw new Error('Could not start motor PWM: pins must each carry a different MCPWM output, deadtime be at most 5600ns and ac and dc not both be set');
+  }
+}
+
+// Sets channel 0, 1 or 2's duty cycle, from the next period
+MotorPWM.prototype.dutyCycle = function (channel, dutyCycle) {
+  if (dutyCycle > 1) dutyCycle = 1;
+  if (dutyCycle < 0) dutyCycle = 0;
+  if (hwfast.mcpwm_pulsewidth(channel, Math.round(dutyCycle * this.period)) < 0) {
+    throw new Error('Motor PWM channels are 0, 1 and 2');
+  }
+  return this;
+};
+
+MotorPWM.prototype.dutyCycles = function (dutyCycles) {
+  for (var i = 0; i < dutyCycles.length; i++) {
+    this.dutyCycle(i, dutyCycles[i]);
+  }
+  return this;
+};
+
+// In dc mode, drives the outputs set in `pattern`: bit 0 for A0, 1 for B0,
+// 2 for A1 and so on
+MotorPWM.prototype.commutate = function (pattern) {
+  if (hw.mcpwm_commutate(pattern) < 0) {
+    throw new Error('Commutation needs motor PWM running in dc mode and a 6 bit pattern');
+  }
+  return this;
+};
+
+MotorPWM.prototype.stop = function () {
+  hw.mcpwm_stop();
+};
+
+// Quadrature encoder counted by the QEI, which only listens on PA_3, PA_2
+// and PA_1, as `opts.a`, `opts.b` and optional `opts.index`. Counts edges of
+// both phases unless `opts.mode` is '2x', or pulses on a with b as the
+// direction for 'clockDirection'. `opts.max` wraps the position (e.g. counts
+// per revolution - 1), `opts.resetOnIndex` zeroes it on each index pulse,
+// velocity is measured over `opts.velocityPeriod` us (default 10000) and
+// inputs are filtered for `opts.filter` clocks. `opts.invert` and
+// `opts.invertIndex` flip the direction and index sense.
+function encoderPin (pin) {
+  return pin == null ? -1 : typeof pin == 'number' ? pin : pin.pin;
+}
+
+function Encoder (opts) {
+  opts = opts || {};
+  this.velocityPeriod = opts.velocityPeriod || 10000;
+  this.countsPerRevolution = opts.max ? opts.max + 1 : 0;
+  var flags = (opts.mode == '2x' ? 0 : hw.QEI_4X)
+    | (opts.mode == 'clockDirection' ? hw.QEI_CLOCK_DIRECTION : 0)
+    | (opts.invert ? hw.QEI_INVERT_DIRECTION : 0)
+    | (opts.invertIndex ? hw.QEI_INVERT_INDEX : 0)
+    | (opts.resetOnIndex ? hw.QEI_INDEX_RESET : 0);
+  if (hw.qei_start(encoderPin(opts.a), encoderPin(opts.b), encoderPin(opts.index), flags,
+      opts.max || 0, this.velocityPeriod, opts.filter || 0) < 0) {
+    throw new Error('Could not start encoder: the QEI inputs are PA_3 (a), PA_2 (b) and PA_1 (index), which this board may not bring out');
+  }
+}
+
+Encoder.prototype.position = function () {
+  return hwfast.qei_position();
+};
+
+// 1 forwards, -1 backwards
+Encoder.prototype.direction = function () {
+  return hwfast.qei_direction() ? -1 : 1;
+};
+
+// Counts per second over the last velocity period
+Encoder.prototype.velocity = function () {
+  return hwfast.qei_velocity() * 1e6 / this.velocityPeriod;
+};
+
+// Needs opts.max
+Encoder.prototype.rpm = function () {
+  return this.countsPerRevolution ? this.velocity() * 60 / this.countsPerRevolution : NaN;
+};
+
+Encoder.prototype.index = function () {
+  return hwfast.qei_index();
+};
+
+Encoder.prototype.zero = function () {
+  hw.qei_zero();
+};
+
+Encoder.prototype.stop = function () {
+  hw.qei_stop();
+};
+
+// Sets the frequency of PWM period group 0, or of `group` 1, which runs on
+// the SCT counter half NeoPixels and readPulse otherwise use. Group 0 goes
+// below about 11Hz only while nothing else, group 1 included, uses the SCT.
+Port.prototype.pwmFrequency = function (frequency, group) {
   if (this.pwm.length) {
-    pwmPeriod = Math.round(1/(frequency/180000000));
-    hw.pwm_port_period(pwmPeriod);
+    group = group || 0;
+    if (group !== 0 && group !== 1) {
+      throw new Error("PWM period groups are 0 and 1");
+    }
+    var period = Math.round(1/(frequency/180000000));
+    // Group 0 runs on the whole SCT for the lowest frequencies
+    var max = group ? hw.PWM_GROUP_PERIOD_MAX : hw.PWM_PERIOD_MAX;
+    var status = period > max ? -1 : hwfast.pwm_group_period(group, period);
+    if (status < 0) {
+      throw new Error("PWM frequency too low, must be at least " + Math.ceil(18000000000 / max) / 100 + "Hz");
+    } else if (status) {
+      throw new Error("SCT is already in use by "+['Inactive','PWM','Read Pulse','Neopixels','Counter'][status]);
+    }
+    pwmPeriods[group] = period;
   } else {
     throw new Error("PWM is not supported on this port");
   }
@@ -1557,7 +2017,7 @@ function Tessel() {
     if (n < 1) {
       n = 1;
     }
-    hw.sleep_ms(n);
+    hwfast.sleep_ms(n);
   };
 
   this.deviceId = function(){
@@ -1568,6 +2028,187 @@ function Tessel() {
 	return hw.reset_board();
   }
 
+  // Tune garbage collection. `idleBudget` is the microseconds per idle slice
+  // spent collecting before sleeping (0 disables), `stepSize` the KB per
+  // incremental step, and `pause` / `stepMultiplier` the collector's pause and
+  // step multiplier percentages. Omitted options are left unchanged.
+  this.gc = function (opts) {
+    opts = opts || {};
+    hw.gc_configure(
+      opts.idleBudget == null ? -1 : opts.idleBudget,
+      opts.stepSize || 0,
+      opts.pause || 0,
+      opts.stepMultiplier || 0
+    );
+  };
+
+  // Event loop statistics. Returns one entry per event source with its
+  // dispatch count and log2 histograms (in microseconds) of the delay between
+  // trigger and dispatch and of handler run time. Pass true to reset them.
+  this.eventStats = function (reset) {
+    var stats = JSON.parse(hw.event_stats());
+    if (reset) {
+      hw.event_stats_reset();
+    }
+    return stats;
+  };
+
+  // Batched GPIO across any pins, as for port.writePins / port.readPins.
+  this.writePins = function (pins, values) {
+    writePins(pinBuffer(pins), values);
+  };
+
+  this.readPins = function (pins) {
+    return readPins(pinBuffer(pins));
+  };
+
+  this.watchPins = function (pins) {
+    return new PinGroup(pins);
+  };
+
+  // Logic analyzer. Samples `pins` (all on one GPIO bank) at `opts.rate` Hz
+  // by DMA and calls back with (err, samples, info): `samples` holds
+  // info.width bytes per sample, little-endian, with bit i for pins[i].
+  // `opts.trigger` is { mask, value } to trigger when the masked pins match
+  // `value` (bits in pin order), or { change: mask } for any change; without
+  // one, capture starts at once. `opts.pre` samples before the trigger and
+  // `opts.post` from it on are kept; info.trigger is its sample index.
+  // `opts.usb` also sends the capture to the host as an 'L' message.
+  this.logicCapture = function (pins, opts, callback) {
+    if (typeof opts == 'function') {
+      callback = opts;
+      opts = {};
+    }
+    opts = opts || {};
+    var trigger = opts.trigger || {};
+    var mode = hw.LOGIC_TRIGGER_NONE, mask = 0, value = 0;
+    if (trigger.change != null) {
+      mode = hw.LOGIC_TRIGGER_CHANGE;
+      mask = pinValues(trigger.change);
+    } else if (trigger.mask != null) {
+      mode = hw.LOGIC_TRIGGER_MATCH;
+      mask = pinValues(trigger.mask);
+      value = pinValues(trigger.value || 0);
+    }
+
+    if (hw.logic_start(pinBuffer(pins), opts.rate || 1000000, mode, mask, value,
+        opts.pre || 0, opts.post || 10000, !!opts.usb) < 0) {
+      throw new Error('Could not start capture: pins must share a GPIO bank, rate be at most 10MHz, pre + post at most 1M samples and the software UART not be enabled');
+    }
+
+    process.once('logic_complete', function (error, samples, triggerIndex, rate, width) {
+      if (callback) {
+        callback(error ? new Error('Logic capture DMA error') : null, samples, {
+          trigger: triggerIndex, rate: rate, width: width
+        });
+      }
+    });
+  };
+
+  // Ends a capture early, delivering what was captured.
+  this.logicStop = function () {
+    hw.logic_stop();
+  };
+
+  // Pattern generator. Plays `steps` on `pins` (all on one GPIO bank) at
+  // `opts.rate` steps per second by DMA, without jitter. `steps` is an array
+  // of levels (bit i for pins[i], or arrays of booleans) or a Buffer laid out
+  // like logicCapture samples, so captures can be replayed. `opts.segments`
+  // is a list of { start, length, repeat } ranges of `steps` to chain, and
+  // `opts.loop` repeats the sequence until patternStop(). `callback(err)` is
+  // called when playback ends, and can run alongside logicCapture.
+  this.pattern = function (pins, steps, opts, callback) {
+    if (typeof opts == 'function') {
+      callback = opts;
+      opts = {};
+    }
+    opts = opts || {};
+    var width = pins.length <= 8 ? 1 : pins.length <= 16 ? 2 : 4;
+    var data = steps;
+    if (!Buffer.isBuffer(steps)) {
+      data = new Buffer(steps.length * width);
+      for (var i = 0; i < steps.length; i++) {
+        var levels = pinValues(steps[i]);
+        for (var b = 0; b < width; b++) {
+          data[i * width + b] = (levels >>> (b * 8)) & 0xff;
+        }
+      }
+    }
+
+    var segments = opts.segments || [];
+    var ranges = new Buffer(segments.length * 12);
+    for (var i = 0; i < segments.length; i++) {
+      var range = [segments[i].start || 0, segments[i].length, segments[i].repeat == null ? 1 : segments[i].repeat];
+      for (var w = 0; w < 3; w++) {
+        for (var b = 0; b < 4; b++) {
+          ranges[i * 12 + w * 4 + b] = (range[w] >>> (b * 8)) & 0xff;
+        }
+      }
+    }
+
+    if (hw.pattern_start(pinBuffer(pins), opts.rate || 1000000, data, ranges, !!opts.loop) < 0) {
+      throw new Error('Could not start pattern: pins must share a GPIO bank, rate be at most 10MHz, segments lie within the pattern and the profiler not be sampling');
+    }
+
+    process.once('pattern_complete', function (error) {
+      if (callback) {
+        callback(error ? new Error('Pattern DMA error') : null);
+      }
+    });
+  };
+
+  // Stops pattern playback after the current step.
+  this.patternStop = function () {
+    hw.pattern_stop();
+  };
+
+  // Motor control PWM and quadrature encoder, as MotorPWM and Encoder above.
+  // There's one of each in hardware, so starting another replaces it.
+  this.motorPwm = function (pins, opts) {
+    return new MotorPWM(pins, opts);
+  };
+
+  this.encoder = function (opts) {
+    return new Encoder(opts);
+  };
+
+  // Raw CPU cycle counter (wraps every ~24s at 180MHz), for micro-benchmarks.
+  this.cycles = function () {
+    return hw.cycles();
+  };
+
+  // Fault context saved by the previous boot, or null if it ended cleanly.
+  this.crashReport = function (clear) {
+    var report = hw.crash_report();
+    if (clear) {
+      hw.crash_report_clear();
+    }
+    return report ? JSON.parse(report) : null;
+  };
+
+  // Event loop stall detector. If the loop does not get back to idle within
+  // `timeout` ms (at most about 5500), the stall is reported over USB along
+  // with the JS stack. 'recover' also throws in the stalled JS code and
+  // 'reset' reboots the board, leaving a crash report. Pass 0 to stop.
+  var watchdogModes = {
+    report: hw.WATCHDOG_REPORT,
+    recover: hw.WATCHDOG_RECOVER,
+    reset: hw.WATCHDOG_RESET
+  };
+  this.watchdog = function (timeout, mode) {
+    if (!timeout) {
+      hw.watchdog_stop();
+      return;
+    }
+    mode = mode || 'report';
+    if (!(mode in watchdogModes)) {
+      throw new Error('Unknown watchdog mode ' + mode);
+    }
+    if (hw.watchdog_start(timeout, watchdogModes[mode]) < 0) {
+      throw new Error('Watchdog timeout must be between 1 and 5500ms');
+    }
+  };
+
 }
 
 util.inherits(Tessel, EventEmitter);
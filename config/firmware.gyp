@@ -12,6 +12,7 @@
     'cc3k_path': '../cc3k_patch',
     'COLONY_STATE_CACHE%': '0',
     'COLONY_PRELOAD_ON_INIT%': '0',
+    'enable_luajit%': '0',
   },
 
   'target_defaults': {
@@ -235,6 +236,11 @@
         'TESSEL_FASTCONNECT=1',
         'CC3K_TIMEOUT=1'
       ],
+      'conditions': [
+        ['enable_luajit==1', {
+          'defines': [ 'HW_FFI=1' ],
+        }],
+      ],
       'sources': [
         # Startup script
         '<(firmware_path)/sys/startup_lpc1800.s',
@@ -258,14 +264,25 @@
         '<(firmware_path)/hw/hw_readpulse.c',
         '<(firmware_path)/hw/hw_i2c.c',
         '<(firmware_path)/hw/hw_interrupt.c',
+        '<(firmware_path)/hw/hw_gint.c',
+        '<(firmware_path)/hw/hw_counter.c',
+        '<(firmware_path)/hw/hw_logic.c',
+        '<(firmware_path)/hw/hw_pattern.c',
         '<(firmware_path)/hw/hw_net.c',
         '<(firmware_path)/hw/hw_pwm.c',
+        '<(firmware_path)/hw/hw_mcpwm.c',
+        '<(firmware_path)/hw/hw_qei.c',
+        '<(firmware_path)/hw/hw_sct.c',
+        '<(firmware_path)/hw/hw_timer.c',
         '<(firmware_path)/hw/hw_wait.c',
         '<(firmware_path)/hw/hw_spi.c',
         '<(firmware_path)/hw/hw_spi_async.c',
         '<(firmware_path)/hw/hw_uart.c',
         '<(firmware_path)/hw/hw_swuart.c',
         '<(firmware_path)/hw/hw_gpdma.c',
+        '<(firmware_path)/hw/hw_event.c',
+        '<(firmware_path)/hw/hw_periodic.c',
+        '<(firmware_path)/hw/hw_watchdog.c',
         '<(firmware_path)/hw/l_hw.c',
 
         '<(firmware_path)/sys/sbrk.c',
@@ -274,6 +291,11 @@
         '<(firmware_path)/sys/startup.c',
         '<(firmware_path)/sys/system_lpc18xx.c',
         '<(firmware_path)/sys/bootloader.c',
+        '<(firmware_path)/sys/event_stats.c',
+        '<(firmware_path)/sys/profiler.c',
+        '<(firmware_path)/sys/trace.c',
+        '<(firmware_path)/sys/crash.c',
+        '<(firmware_path)/sys/json.c',
 
         '<(firmware_path)/test/test.c',
         '<(firmware_path)/test/test_nmea.c',
@@ -292,6 +314,8 @@
         '<(firmware_path)/main.c',
         '<(firmware_path)/syscalls.c',
         '<(firmware_path)/tessel.c',
+        '<(firmware_path)/tessel_gc.c',
+        '<(firmware_path)/tessel_profile.c',
         '<(firmware_path)/tessel_wifi.c',
 
         '<(firmware_path)/usb/usb.c',
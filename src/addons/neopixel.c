@@ -1,37 +1,200 @@
 #include "neopixel.h" 
+#include "event_stats.h"
+#include <string.h>
 
 #define SYSTEM_CORE_CLOCK                   180000000
 #define DATA_SPEED                          800000  
 #define BITS_PER_INTERRUPT                  24
 #define PRESCALER                           SYSTEM_CORE_CLOCK / (25 * DATA_SPEED)
 
-#define PERIOD_EVENT_NUM                    15
-#define T1H_EVENT_NUM                       14
-#define T0H_EVENT_NUM                       13
-#define CHAN_A_OUTPUT_BUFFER_EVENT_NUM      12
-#define CHAN_A_AUX_BUFFER_EVENT_NUM         11
-#define COMPLETE_FRAME_EVENT                6
+neopixel_animation_status_t channel_animations[MAX_SCT_CHANNELS];
 
-neopixel_animation_status_t channel_a_animation;
-
-const neopixel_sct_status_t sct_animation_channels[MAX_SCT_CHANNELS] = {
-  {
-    .pin = E_G4,
-    .animationStatus = &channel_a_animation,
-    .sctOutputBuffer = CHAN_A_OUTPUT_BUFFER_EVENT_NUM,
-    .sctAuxBuffer = CHAN_A_AUX_BUFFER_EVENT_NUM,
-    .sctOutputChannel = 8,
-    .sctAuxChannel = 1,
-  }
+// Strips are assigned their pins and outputs in neopixel_sct_claim. They
+// share the timing events and the AUX signal; each has its own output and
+// its own pair of buffer events.
+neopixel_sct_status_t sct_animation_channels[MAX_SCT_CHANNELS] = {
+  { .animationStatus = &channel_animations[0], .sctAuxChannel = NEOPIXEL_AUX_OUTPUT },
+  { .animationStatus = &channel_animations[1], .sctAuxChannel = NEOPIXEL_AUX_OUTPUT },
+  { .animationStatus = &channel_animations[2], .sctAuxChannel = NEOPIXEL_AUX_OUTPUT },
 };
+static uint32_t activeChannels;
+
+/*
+Pixels are expanded into the 24 bit state masks of the buffer events and
+written there by GPDMA, so a frame streams with no interrupts. Each side's
+buffers are refilled while the other side's shift out: a refill event
+fires on the first bit periods of the other side's pixel, one per word of
+a pixel slot, and raises an SCT DMA request for a single transfer each.
+Request 0 refills the output buffers and request 1 the AUX ones. Each
+frame's words are stored as [even pixels][odd pixels] so each channel
+reads its own half in order. The channel that would load the pixel after
+the last one writes HALT_H instead, halting the counter at the end of the
+frame, and interrupts so the next frame can be started.
+
+With several strips, each side's buffer events are one consecutive block,
+and a pixel slot is the STATE/CTRL word pairs covering the block. All
+strips shift out together, so the frame rate doesn't drop with more strips.
+
+Frames are expanded into one of two pixel buffers from the event loop while
+the other streams, each buffer with its linked lists built once. At the end
+of a frame the interrupt only flips buffers and restarts DMA, or, if the
+next frame isn't expanded yet, leaves the strips idle until it is.
+*/
+
+#define NEOPIXEL_DMA_CHUNK 4095 // largest GPDMA transfer size
+
+static uint32_t *pixelWords[2];
+static uint32_t pixelsPerFrame;
+static uint32_t slotWords;
+static uint32_t frameIndex;
+static uint32_t frameCount;
+static hw_GPDMA_Linked_List_Type *outputLLI[2];
+static hw_GPDMA_Linked_List_Type *auxLLI[2];
+static uint32_t outputItems;
+static uint32_t auxItems;
+static uint16_t haltWord;
+static volatile bool frameRunning;
+static volatile int frontBuffer;      // the buffer streaming
+static volatile bool nextReady;       // the other holds the next frame
+static volatile bool frameWaiting;    // idle until it does
+
+// Frame transforms, applied as each frame is expanded. Without them the
+// frames are sent as given, already in the strip's byte order.
+static bool frameTransform;
+static uint8_t frameLUT[256];         // brightness, then gamma
+static uint8_t colorOrder[3];         // logical channel sent as each byte
+static uint8_t *pixelBrightness;      // optional per pixel scale
+static uint32_t pixelBrightnessCount;
+static uint32_t fadeSteps;            // frames blended between two frames
+
+// Streaming, USB, UDP or JS fill the stream frame, every strip's frame in
+// turn. A complete frame is expanded into the back pixel buffer and shown
+// from the next frame boundary; one replaced before it was shown is
+// dropped.
+#define NEOPIXEL_STREAM_POLL_MS 5
+#define NEOPIXEL_UDP_PACKET 1472  // largest unfragmented UDP payload
+
+static bool streaming;
+static uint8_t *streamFrame;
+static const uint8_t *streamFrames[MAX_SCT_CHANNELS];
+static uint32_t streamLength;
+static uint32_t streamFramesShown;
+static uint32_t streamFramesDropped;
+static tm_socket_t streamSocket = -1;
+static hw_periodic_t streamPoll;
+static uint8_t *streamPacket;
 
-
-void beginAnimationAtCurrentFrame();
-void continueAnimation();
-bool updateChannelAnimation(neopixel_sct_status_t channel);
 void animation_complete();
+static void sct_neopixel_irq_handler (uint32_t flags);
+static void expandNext (tm_event *event);
 
 tm_event animation_complete_event = TM_EVENT_INIT(animation_complete); 
+static tm_event expand_event = TM_EVENT_INIT(expandNext);
+
+// Whether an animation or stream holds the event queue open
+static bool animationHeld;
+
+// The driver runs on the SCT's H counter, with events, match registers and
+// outputs reserved from the SCT allocator so PWM keeps the L counter
+static hw_sct_owner_t neopixel_sct = { .user = SCT_NEOPIXEL, .irq = sct_neopixel_irq_handler };
+
+static int PERIOD_EVENT_NUM;
+static int T1H_EVENT_NUM;
+static int T0H_EVENT_NUM;
+static int COMPLETE_TO_AUX_EVENT;
+static int COMPLETE_TO_OUTPUT_EVENT;
+static int REFILL_OUTPUT_EVENT;
+static int REFILL_AUX_EVENT;
+static int OUTPUT_BUFFER_EVENTS;
+static int AUX_BUFFER_EVENTS;
+static int PERIOD_MATCH;
+static int T0H_MATCH;
+static int T1H_MATCH;
+
+#define COMPLETE_EVENTS ((1u << COMPLETE_TO_AUX_EVENT) | (1u << COMPLETE_TO_OUTPUT_EVENT))
+
+// Reserves the H counter and everything needed to drive a strip on each of
+// `pins`. Returns 0, -1 if a pin can't be driven, or the SCT's user if
+// something is taken.
+int neopixel_sct_claim (const uint8_t *pins, size_t count)
+{
+  if (count == 0 || count > MAX_SCT_CHANNELS) {
+    return -1;
+  }
+  for (size_t i = 0; i < count; i++) {
+    if (g_APinDescription[pins[i]].alternate != PWM_MODE) {
+      return -1; // Not routed to an SCT output
+    }
+    for (size_t j = 0; j < i; j++) {
+      if (pins[j] == pins[i]) {
+        return -1;
+      }
+    }
+  }
+
+  int status = hw_sct_claim_counter(&neopixel_sct, HW_SCT_H);
+  if (!status) {
+    status = hw_sct_claim_output(&neopixel_sct, NEOPIXEL_AUX_OUTPUT);
+  }
+  for (size_t i = 0; i < count && !status; i++) {
+    sct_animation_channels[i].pin = pins[i];
+    sct_animation_channels[i].sctOutputChannel = g_APinDescription[pins[i]].pwm_channel;
+    status = hw_sct_claim_output(&neopixel_sct, sct_animation_channels[i].sctOutputChannel);
+  }
+  if (status) {
+    hw_sct_release(&neopixel_sct);
+    return status;
+  }
+
+  // A pixel slot is one STATE, or a STATE/CTRL pair per strip
+  slotWords = count == 1 ? 1 : 2 * count;
+  OUTPUT_BUFFER_EVENTS = hw_sct_alloc_events(&neopixel_sct, count);
+  AUX_BUFFER_EVENTS = hw_sct_alloc_events(&neopixel_sct, count);
+  for (size_t i = 0; i < count; i++) {
+    sct_animation_channels[i].sctOutputBuffer = OUTPUT_BUFFER_EVENTS + i;
+    sct_animation_channels[i].sctAuxBuffer = AUX_BUFFER_EVENTS + i;
+  }
+
+  PERIOD_EVENT_NUM = hw_sct_alloc_event(&neopixel_sct);
+  T1H_EVENT_NUM = hw_sct_alloc_event(&neopixel_sct);
+  T0H_EVENT_NUM = hw_sct_alloc_event(&neopixel_sct);
+  COMPLETE_TO_AUX_EVENT = hw_sct_alloc_event(&neopixel_sct);
+  COMPLETE_TO_OUTPUT_EVENT = hw_sct_alloc_event(&neopixel_sct);
+  REFILL_OUTPUT_EVENT = hw_sct_alloc_event(&neopixel_sct);
+  REFILL_AUX_EVENT = hw_sct_alloc_event(&neopixel_sct);
+  PERIOD_MATCH = hw_sct_alloc_reg(&neopixel_sct, HW_SCT_H, 0);
+  T0H_MATCH = hw_sct_alloc_reg(&neopixel_sct, HW_SCT_H, 0);
+  T1H_MATCH = hw_sct_alloc_reg(&neopixel_sct, HW_SCT_H, 0);
+
+  // Both DMA requests, 0 refilling the output buffers and 1 the AUX ones
+  int outputDMA = hw_sct_alloc_dma(&neopixel_sct);
+  int auxDMA = hw_sct_alloc_dma(&neopixel_sct);
+
+  if (outputDMA != 0 || auxDMA != 1 || OUTPUT_BUFFER_EVENTS < 0 || AUX_BUFFER_EVENTS < 0
+    || PERIOD_EVENT_NUM < 0 || T1H_EVENT_NUM < 0 || T0H_EVENT_NUM < 0
+    || COMPLETE_TO_AUX_EVENT < 0 || COMPLETE_TO_OUTPUT_EVENT < 0
+    || REFILL_OUTPUT_EVENT < 0 || REFILL_AUX_EVENT < 0
+    || PERIOD_MATCH < 0 || T0H_MATCH < 0 || T1H_MATCH < 0) {
+    status = hw_sct_busy(&neopixel_sct);
+    hw_sct_release(&neopixel_sct);
+    return status;
+  }
+  activeChannels = count;
+  return 0;
+}
+
+// The CTRL word of the buffer events that load while AUX is at `auxLevel`
+static uint32_t bufferEventCtrl (int auxLevel)
+{
+  return 0
+    | (T0H_MATCH << SCT_EVx_CTRL_MATCHSEL_Pos)  /* T0H match */
+    | (1 << SCT_EVx_CTRL_HEVENT_Pos)    /* Belongs to H counter */
+    | (1 << SCT_EVx_CTRL_OUTSEL_Pos)    /* Use OUTPUT for I/O condition */
+    | (NEOPIXEL_AUX_OUTPUT << SCT_EVx_CTRL_IOSEL_Pos)    /* Use AUX signal */
+    | ((auxLevel ? 3 : 0) << SCT_EVx_CTRL_IOCOND_Pos)    /* AUX = auxLevel */
+    | (3 << SCT_EVx_CTRL_COMBMODE_Pos)  /* MATCH AND I/O */
+    ;
+}
 
 void LEDDRIVER_open (void)
 {
@@ -52,257 +215,495 @@ void LEDDRIVER_open (void)
   LPC_SCT->STATE_H = BITS_PER_INTERRUPT;
 
   /* Counter LIMIT */
-  LPC_SCT->LIMIT_H = (1u << PERIOD_EVENT_NUM);          /* Event 15 */
+  LPC_SCT->LIMIT_H = (1u << PERIOD_EVENT_NUM);
 
   /* Configure the match registers */
   clocksPerBit = SYSTEM_CORE_CLOCK / (PRESCALER * DATA_SPEED);
-  LPC_SCT->MATCHREL_H[0] = clocksPerBit - 1;              /* Bit period */
-  LPC_SCT->MATCHREL_H[1] = 8 - 1;          /* T0H */
-  LPC_SCT->MATCHREL_H[2] = 16 - 1;  /* T1H */
+  LPC_SCT->MATCHREL_H[PERIOD_MATCH] = clocksPerBit - 1;              /* Bit period */
+  LPC_SCT->MATCHREL_H[T0H_MATCH] = 8 - 1;          /* T0H */
+  LPC_SCT->MATCHREL_H[T1H_MATCH] = 16 - 1;  /* T1H */
 
   /* Configure events */
   LPC_SCT->EVENT[PERIOD_EVENT_NUM].CTRL = 0
-      | (0 << SCT_EVx_CTRL_MATCHSEL_Pos)  /* MATCH0_H */
+      | (PERIOD_MATCH << SCT_EVx_CTRL_MATCHSEL_Pos)  /* Bit period match */
       | (1 << SCT_EVx_CTRL_HEVENT_Pos)    /* Belongs to H counter */
       | (1 << SCT_EVx_CTRL_COMBMODE_Pos)  /* MATCH only */
       | (0 << SCT_EVx_CTRL_STATELD_Pos)   /* Add value to STATE */
       | (31 << SCT_EVx_CTRL_STATEV_Pos)   /* Add 31 (i.e subtract 1) */
       ;
   LPC_SCT->EVENT[T1H_EVENT_NUM].CTRL = 0
-      | (2 << SCT_EVx_CTRL_MATCHSEL_Pos)  /* MATCH2_H */
+      | (T1H_MATCH << SCT_EVx_CTRL_MATCHSEL_Pos)  /* T1H match */
       | (1 << SCT_EVx_CTRL_HEVENT_Pos)    /* Belongs to H counter */
       | (1 << SCT_EVx_CTRL_COMBMODE_Pos)  /* MATCH only */
       ;
   LPC_SCT->EVENT[T0H_EVENT_NUM].CTRL = 0
-      | (1 << SCT_EVx_CTRL_MATCHSEL_Pos)  /* MATCH1_H */
+      | (T0H_MATCH << SCT_EVx_CTRL_MATCHSEL_Pos)  /* T0H match */
       | (1 << SCT_EVx_CTRL_HEVENT_Pos)    /* Belongs to H counter */
       | (1 << SCT_EVx_CTRL_COMBMODE_Pos)  /* MATCH only */
       ;
 
-  LPC_SCT->RES = 0;
-
-  for (int i = 0; i < MAX_SCT_CHANNELS; i++) {
-    if (sct_animation_channels[i].animationStatus->animation.frames != NULL) {
+  for (uint32_t i = 0; i < activeChannels; i++) {
+    LPC_SCT->EVENT[OUTPUT_BUFFER_EVENTS + i].CTRL = bufferEventCtrl(0);
+    LPC_SCT->EVENT[AUX_BUFFER_EVENTS + i].CTRL = bufferEventCtrl(1);
+    LPC_SCT->EVENT[OUTPUT_BUFFER_EVENTS + i].STATE = 0;
+    LPC_SCT->EVENT[AUX_BUFFER_EVENTS + i].STATE = 0;
+  }
 
-      LPC_SCT->OUTPUT &= ~(0 
-        | (1u << sct_animation_channels[i].sctOutputChannel)
-      );
-      LPC_SCT->OUTPUT |= (1u << sct_animation_channels[i].sctAuxChannel);
-      
-      LPC_SCT->EVENT[sct_animation_channels[i].sctOutputBuffer].CTRL = 0
-        | (1 << SCT_EVx_CTRL_MATCHSEL_Pos)  /* MATCH1_H */
-        | (1 << SCT_EVx_CTRL_HEVENT_Pos)    /* Belongs to H counter */
-        | (1 << SCT_EVx_CTRL_OUTSEL_Pos)    /* Use OUTPUT for I/O condition */
-        | (sct_animation_channels[i].sctAuxChannel << SCT_EVx_CTRL_IOSEL_Pos)    /* Use AUX signal */
-        | (0 << SCT_EVx_CTRL_IOCOND_Pos)    /* AUX = 0 */
-        | (3 << SCT_EVx_CTRL_COMBMODE_Pos)  /* MATCH AND I/O */
+  LPC_SCT->OUT[NEOPIXEL_AUX_OUTPUT].SET = 0
+      | (1u << COMPLETE_TO_AUX_EVENT)                /* Output buffer done, switch to AUX */
+      ;
+  LPC_SCT->OUT[NEOPIXEL_AUX_OUTPUT].CLR = 0
+      | (1u << COMPLETE_TO_OUTPUT_EVENT)             /* AUX buffer done, switch back */
+      ;
+  LPC_SCT->RES &= ~(3 << 2 * NEOPIXEL_AUX_OUTPUT);
+  LPC_SCT->RES |= (3 << 2 * NEOPIXEL_AUX_OUTPUT);
+
+  for (uint32_t i = 0; i < activeChannels; i++) {
+    LPC_SCT->OUT[sct_animation_channels[i].sctOutputChannel].SET = 0
+        | (1u << PERIOD_EVENT_NUM)                        /* Bit period sets the DATA signal */
+        | (1u << sct_animation_channels[i].sctOutputBuffer)   /* A 1 bit keeps the DATA signal set */
+        | (1u << sct_animation_channels[i].sctAuxBuffer)      /* A 1 bit keeps the DATA signal set */
         ;
-      LPC_SCT->EVENT[sct_animation_channels[i].sctAuxBuffer].CTRL = 0
-        | (1 << SCT_EVx_CTRL_MATCHSEL_Pos)  /* MATCH1_H */
-        | (1 << SCT_EVx_CTRL_HEVENT_Pos)    /* Belongs to H counter */
-        | (1 << SCT_EVx_CTRL_OUTSEL_Pos)    /* Use OUTPUT for I/O condition */
-        | (sct_animation_channels[i].sctAuxChannel << SCT_EVx_CTRL_IOSEL_Pos)    /* Use AUX signal */
-        | (3 << SCT_EVx_CTRL_IOCOND_Pos)    /* AUX = 1 */
-        | (3 << SCT_EVx_CTRL_COMBMODE_Pos)  /* MATCH AND I/O */
+    LPC_SCT->OUT[sct_animation_channels[i].sctOutputChannel].CLR = 0
+        | (1u << T1H_EVENT_NUM)                        /* T1H clears the DATA signal */
+        | (1u << T0H_EVENT_NUM)                        /* T0H clears the DATA signal */
+        | COMPLETE_EVENTS                              /* Complete Events clear the DATA signal */
         ;
 
-      LPC_SCT->EVENT[sct_animation_channels[i].sctOutputBuffer].STATE = 0;
-      LPC_SCT->EVENT[sct_animation_channels[i].sctAuxBuffer].STATE = 0; 
-
-      LPC_SCT->OUT[sct_animation_channels[i].sctAuxChannel].SET = 0
-          | (1u << COMPLETE_FRAME_EVENT)                        /* Complete Event toggles the AUX signal */
-          ;
-      LPC_SCT->OUT[sct_animation_channels[i].sctAuxChannel].CLR = 0
-          | (1u << COMPLETE_FRAME_EVENT)                        /* Complete Event toggles the AUX signal */
-          ;
-      LPC_SCT->OUT[sct_animation_channels[i].sctOutputChannel].SET = 0
-          | (1u << PERIOD_EVENT_NUM)                        /* Event 15 sets the DATA signal */
-          | (1u << sct_animation_channels[i].sctOutputBuffer)                        /* Event 12 sets the DATA signal */
-          | (1u << sct_animation_channels[i].sctAuxBuffer)                        /* Event 11 sets the DATA signal */
-          ;
-      LPC_SCT->OUT[sct_animation_channels[i].sctOutputChannel].CLR = 0
-          | (1u << T1H_EVENT_NUM)                        /* Event 14 clears the DATA signal */
-          | (1u << T0H_EVENT_NUM)                        /* Event 13 clears the DATA signal */
-          | (1u << COMPLETE_FRAME_EVENT)                        /* Complete Event clears the DATA signal */
-          ;
-
-      LPC_SCT->RES |= 0
-            | (0 << 2 * sct_animation_channels[i].sctOutputChannel)            /* DATA signal doesn't change */
-            | (3 << 2 * sct_animation_channels[i].sctAuxChannel) 
-            ;
-    }
+    /* DATA signal doesn't change on conflicts */
+    LPC_SCT->RES &= ~(3 << 2 * sct_animation_channels[i].sctOutputChannel);
   }
 
-  LPC_SCT->EVENT[COMPLETE_FRAME_EVENT].CTRL = 0
-      | (2 << SCT_EVx_CTRL_MATCHSEL_Pos)  /* MATCH2_H */
+  LPC_SCT->EVENT[COMPLETE_TO_AUX_EVENT].CTRL = 0
+      | (T1H_MATCH << SCT_EVx_CTRL_MATCHSEL_Pos)  /* T1H match */
       | (1 << SCT_EVx_CTRL_HEVENT_Pos)    /* Belongs to H counter */
-      | (1 << SCT_EVx_CTRL_COMBMODE_Pos)  /* MATCH only */
+      | (1 << SCT_EVx_CTRL_OUTSEL_Pos)    /* Use OUTPUT for I/O condition */
+      | (NEOPIXEL_AUX_OUTPUT << SCT_EVx_CTRL_IOSEL_Pos)    /* Use AUX signal */
+      | (0 << SCT_EVx_CTRL_IOCOND_Pos)    /* AUX = 0 */
+      | (3 << SCT_EVx_CTRL_COMBMODE_Pos)  /* MATCH AND I/O */
+      | (1 << SCT_EVx_CTRL_STATELD_Pos)   /* Set STATE to a value */
+      | (BITS_PER_INTERRUPT << SCT_EVx_CTRL_STATEV_Pos)   /* Set to 24 */
+      ;
+  LPC_SCT->EVENT[COMPLETE_TO_OUTPUT_EVENT].CTRL = 0
+      | (T1H_MATCH << SCT_EVx_CTRL_MATCHSEL_Pos)  /* T1H match */
+      | (1 << SCT_EVx_CTRL_HEVENT_Pos)    /* Belongs to H counter */
+      | (1 << SCT_EVx_CTRL_OUTSEL_Pos)    /* Use OUTPUT for I/O condition */
+      | (NEOPIXEL_AUX_OUTPUT << SCT_EVx_CTRL_IOSEL_Pos)    /* Use AUX signal */
+      | (3 << SCT_EVx_CTRL_IOCOND_Pos)    /* AUX = 1 */
+      | (3 << SCT_EVx_CTRL_COMBMODE_Pos)  /* MATCH AND I/O */
       | (1 << SCT_EVx_CTRL_STATELD_Pos)   /* Set STATE to a value */
-      | (BITS_PER_INTERRUPT << SCT_EVx_CTRL_STATEV_Pos)   /* Set to 8 */
+      | (BITS_PER_INTERRUPT << SCT_EVx_CTRL_STATEV_Pos)   /* Set to 24 */
       ;
   LPC_SCT->EVENT[PERIOD_EVENT_NUM].STATE = 0xFFFFFFFF;
   LPC_SCT->EVENT[T1H_EVENT_NUM].STATE = 0x00FFFFFE;  /* All data bit states except state 0 */
   LPC_SCT->EVENT[T0H_EVENT_NUM].STATE = 0x00FFFFFF;  /* All data bit states */
-  LPC_SCT->EVENT[COMPLETE_FRAME_EVENT].STATE = 0x00000001; /* Only in state 0 */
+  LPC_SCT->EVENT[COMPLETE_TO_AUX_EVENT].STATE = 0x00000001; /* Only in state 0 */
+  LPC_SCT->EVENT[COMPLETE_TO_OUTPUT_EVENT].STATE = 0x00000001; /* Only in state 0 */
 
-      /* Default is to halt the block transfer after the next frame */
-  LPC_SCT->HALT_H = (1u << COMPLETE_FRAME_EVENT);           /* Complete Event halts the transfer */
+  /* Refill each side's buffers as the other side's pixel starts */
+  LPC_SCT->EVENT[REFILL_OUTPUT_EVENT].CTRL = 0
+      | (PERIOD_MATCH << SCT_EVx_CTRL_MATCHSEL_Pos)  /* Bit period match */
+      | (1 << SCT_EVx_CTRL_HEVENT_Pos)    /* Belongs to H counter */
+      | (1 << SCT_EVx_CTRL_OUTSEL_Pos)    /* Use OUTPUT for I/O condition */
+      | (NEOPIXEL_AUX_OUTPUT << SCT_EVx_CTRL_IOSEL_Pos)    /* Use AUX signal */
+      | (3 << SCT_EVx_CTRL_IOCOND_Pos)    /* AUX = 1 */
+      | (3 << SCT_EVx_CTRL_COMBMODE_Pos)  /* MATCH AND I/O */
+      ;
+  LPC_SCT->EVENT[REFILL_AUX_EVENT].CTRL = 0
+      | (PERIOD_MATCH << SCT_EVx_CTRL_MATCHSEL_Pos)  /* Bit period match */
+      | (1 << SCT_EVx_CTRL_HEVENT_Pos)    /* Belongs to H counter */
+      | (1 << SCT_EVx_CTRL_OUTSEL_Pos)    /* Use OUTPUT for I/O condition */
+      | (NEOPIXEL_AUX_OUTPUT << SCT_EVx_CTRL_IOSEL_Pos)    /* Use AUX signal */
+      | (0 << SCT_EVx_CTRL_IOCOND_Pos)    /* AUX = 0 */
+      | (3 << SCT_EVx_CTRL_COMBMODE_Pos)  /* MATCH AND I/O */
+      ;
+  /* One bit period, from state 24 down, per word of a pixel slot */
+  LPC_SCT->EVENT[REFILL_OUTPUT_EVENT].STATE = ((1u << slotWords) - 1) << (BITS_PER_INTERRUPT + 1 - slotWords);
+  LPC_SCT->EVENT[REFILL_AUX_EVENT].STATE = ((1u << slotWords) - 1) << (BITS_PER_INTERRUPT + 1 - slotWords);
+
+  /* Each refill event requests a single transfer */
+  LPC_SCT->DMAREQ0 = (1u << REFILL_OUTPUT_EVENT);
+  LPC_SCT->DMAREQ1 = (1u << REFILL_AUX_EVENT);
 
-  // Clear pending interrupts on period completion
-  LPC_SCT->EVFLAG = (1u << COMPLETE_FRAME_EVENT);
-  /* Configure interrupt events */
-  LPC_SCT->EVEN |= (1u << COMPLETE_FRAME_EVENT);            /* Complete Event */
+  // Completion only interrupts at the end of a frame
+  LPC_SCT->EVFLAG = COMPLETE_EVENTS;
 }
 
+/* Start a block transmission */
+void LEDDRIVER_start (void)
+{
+  /* Set reset time */
+  LPC_SCT->COUNT_H = - LPC_SCT->MATCHREL_H[PERIOD_MATCH] * 50;     /* TODO: Modify this to guarantee 50 µs min in both modes! */
 
+  /* Start state */
+  LPC_SCT->STATE_H = BITS_PER_INTERRUPT;
 
-/* Simple function to write to a transmit buffer. */
-void LEDDRIVER_writeNextRGBValue (neopixel_sct_status_t sct_channel)
+  /* Start timer H */
+  LPC_SCT->CTRL_H &= ~SCT_CTRL_H_HALT_H_Msk;
+}
+
+// Links `slots` pixel slots to a block of buffer events, then optionally
+// the halt word, and returns the number of items used
+static uint32_t linkBufferWords (hw_GPDMA_Linked_List_Type *lli, const uint32_t *words, uint32_t slots, int bufferEvent, bool halt)
 {
-  
-  // Make sure this channel actually has animations
-  if (sct_channel.animationStatus->animation.frames != NULL) {
-    // Get the current rgb value
-    uint32_t rgb = (sct_channel.animationStatus->animation.frames[sct_channel.animationStatus->framesSent][sct_channel.animationStatus->bytesPending] << 16
-                 | sct_channel.animationStatus->animation.frames[sct_channel.animationStatus->framesSent][sct_channel.animationStatus->bytesPending + 1] << 8
-                 | sct_channel.animationStatus->animation.frames[sct_channel.animationStatus->framesSent][sct_channel.animationStatus->bytesPending + 2]);
-    // Set the rgb value to the appropriate state
-    if (LPC_SCT->OUTPUT & (1u << sct_channel.sctAuxChannel)) {
-      LPC_SCT->EVENT[sct_channel.sctOutputBuffer].STATE = (rgb & 0xFFFFFF);
-    }
-    else {
-      LPC_SCT->EVENT[sct_channel.sctAuxBuffer].STATE = (rgb & 0xFFFFFF);
-    }
+  uint32_t items = 0;
+  while (slots > 0) {
+    // One strip streams into one register; several need an item per pixel
+    uint32_t size = slotWords > 1 ? 1 : slots < NEOPIXEL_DMA_CHUNK ? slots : NEOPIXEL_DMA_CHUNK;
+    lli[items].Source = (uint32_t) words;
+    lli[items].Destination = (uint32_t) &LPC_SCT->EVENT[bufferEvent].STATE;
+    lli[items].NextLLI = (uint32_t) &lli[items + 1];
+    lli[items].Control = GPDMA_DMACCxControl_TransferSize(size * slotWords)
+      | GPDMA_DMACCxControl_SBSize(GPDMA_BSIZE_1)
+      | GPDMA_DMACCxControl_DBSize(GPDMA_BSIZE_1)
+      | GPDMA_DMACCxControl_SWidth(GPDMA_WIDTH_WORD)
+      | GPDMA_DMACCxControl_DWidth(GPDMA_WIDTH_WORD)
+      | GPDMA_DMACCxControl_SI
+      | (slotWords > 1 ? GPDMA_DMACCxControl_DI : 0);
+    words += size * slotWords;
+    slots -= size;
+    items++;
+  }
+  if (halt) {
+    // Halt after the frame, and interrupt so the next one can start
+    lli[items].Source = (uint32_t) &haltWord;
+    lli[items].Destination = (uint32_t) &LPC_SCT->HALT_H;
+    lli[items].NextLLI = 0;
+    lli[items].Control = GPDMA_DMACCxControl_TransferSize(1)
+      | GPDMA_DMACCxControl_SBSize(GPDMA_BSIZE_1)
+      | GPDMA_DMACCxControl_DBSize(GPDMA_BSIZE_1)
+      | GPDMA_DMACCxControl_SWidth(GPDMA_WIDTH_HALFWORD)
+      | GPDMA_DMACCxControl_DWidth(GPDMA_WIDTH_HALFWORD)
+      | GPDMA_DMACCxControl_I;
+    items++;
+  } else if (items > 0) {
+    lli[items - 1].NextLLI = 0;
   }
+  return items;
+}
 
-  sct_channel.animationStatus->bytesPending += 3;
+static void beginBufferDMA (uint32_t channel, hw_GPDMA_Conn_Type request, hw_GPDMA_Linked_List_Type *lli)
+{
+  hw_GPDMA_Chan_Config config = {
+    .SrcConn = 0,
+    .DestConn = request,
+    .TransferType = m2p,
+  };
+  hw_gpdma_transfer_config(channel, &config);
+  hw_gpdma_transfer_begin(channel, lli);
 }
 
-/* Activate or deactivate HALT after next frame. */
-void LEDDRIVER_haltAfterFrame (int on)
+// Sets the transforms for the next animation: `gamma` as an exponent, or
+// a 256 entry `gammaTable`, a global `brightness` scaled further by the
+// optional `pixelScale` per pixel, the strip's byte `order` of 'r', 'g' and
+// 'b', and `fade` frames blended in between each pair of frames. Returns
+// 0, -1 if something is invalid, or SCT_NEOPIXEL while animating.
+int neopixel_set_transform (float gamma, const uint8_t *gammaTable, uint8_t brightness, const char *order,
+  const uint8_t *pixelScale, size_t pixelCount, uint32_t fade)
 {
-  if (on) {
-    LPC_SCT->HALT_H = (1u << COMPLETE_FRAME_EVENT);
+  if (activeChannels) {
+    return SCT_NEOPIXEL;
   }
-  else {
-    LPC_SCT->HALT_H = 0;
+  if (!order || strlen(order) != 3 || gamma <= 0) {
+    return -1;
+  }
+  static const char channels[] = "rgb";
+  for (int c = 0; c < 3; c++) {
+    const char *channel = strchr(channels, order[c]);
+    if (!channel || strchr(order + c + 1, order[c])) {
+      return -1;
+    }
+    colorOrder[c] = channel - channels;
   }
-}
 
-/* Start a block transmission */
-void LEDDRIVER_start (void)
-{
-  /* TODO: Check whether timer is really in HALT mode */
+  free(pixelBrightness);
+  pixelBrightness = NULL;
+  pixelBrightnessCount = 0;
+  if (pixelCount) {
+    pixelBrightness = malloc(pixelCount);
+    if (!pixelBrightness) {
+      return -1;
+    }
+    memcpy(pixelBrightness, pixelScale, pixelCount);
+    pixelBrightnessCount = pixelCount;
+  }
 
-  /* Set reset time */
-  LPC_SCT->COUNT_H = - LPC_SCT->MATCHREL_H[0] * 50;     /* TODO: Modify this to guarantee 50 µs min in both modes! */
+  for (uint32_t v = 0; v < 256; v++) {
+    uint32_t scaled = (v * (brightness + 1)) >> 8;
+    frameLUT[v] = gammaTable ? gammaTable[scaled] : (uint8_t) (powf(scaled / 255.0f, gamma) * 255 + 0.5f);
+  }
+  fadeSteps = fade;
 
-  /* Start state */
-  LPC_SCT->STATE_H = BITS_PER_INTERRUPT;
+  // Skip the work entirely if nothing would change
+  frameTransform = gammaTable || gamma != 1 || brightness != 255 || pixelBrightness || fade
+    || colorOrder[0] != 0 || colorOrder[1] != 1 || colorOrder[2] != 2;
+  return 0;
+}
 
-  /* Start timer H */
-  LPC_SCT->CTRL_H &= ~SCT_CTRL_H_HALT_H_Msk;
+// Blends, scales, gamma corrects and reorders pixel `p`. `weight` (0-255)
+// is how far from `from` towards `to` it is.
+static uint32_t transformPixel (const uint8_t *from, const uint8_t *to, uint32_t weight, uint32_t p)
+{
+  uint32_t scale = p < pixelBrightnessCount ? pixelBrightness[p] + 1 : 256;
+  uint8_t out[3];
+  for (int c = 0; c < 3; c++) {
+    uint32_t v = (from[3 * p + c] * (256 - weight) + to[3 * p + c] * weight) >> 8;
+    out[c] = frameLUT[(v * scale) >> 8];
+  }
+  return out[colorOrder[0]] << 16 | out[colorOrder[1]] << 8 | out[colorOrder[2]];
 }
 
-void sct_neopixel_irq_handler (void)
+// Expands frame `index` of every strip into buffer state masks in `words`,
+// a pixel slot each, [even][odd]. A strip out of frames repeats its last.
+static void expandFrame (uint32_t *words, uint32_t index)
 {
-  /* Acknowledge interrupt */
-  if (LPC_SCT->EVFLAG & (1u << COMPLETE_FRAME_EVENT)) {
-    // Unset IRQ flag
-    LPC_SCT->EVFLAG = (1u << COMPLETE_FRAME_EVENT);
-
-    // Bool to track if all animations are complete
-    bool complete = true;
-    // Iterate through SCT channels
-    for (int i = 0; i < MAX_SCT_CHANNELS; i++) {
-
-      // Attempt to update their channel
-      if (updateChannelAnimation((sct_animation_channels[i]))) {
-        // If we did, then we aren't complete with sending data
-        complete = false;
+  uint32_t n = pixelsPerFrame;
+  uint32_t *even = words;
+  uint32_t *odd = even + (n + 1) / 2 * slotWords;
+  uint32_t ctrl[2] = { bufferEventCtrl(0), bufferEventCtrl(1) };
+
+  // Fading, each source frame is followed by blends towards the next
+  uint32_t source = index / (fadeSteps + 1);
+  uint32_t weight = (index % (fadeSteps + 1)) * 256 / (fadeSteps + 1);
+
+  for (uint32_t i = 0; i < activeChannels; i++) {
+    const neopixel_animation_t *animation = &sct_animation_channels[i].animationStatus->animation;
+    uint32_t last = animation->numFrames - 1;
+    const uint8_t *from = animation->frames[source < last ? source : last];
+    const uint8_t *to = animation->frames[source + 1 < last ? source + 1 : last];
+
+    for (uint32_t p = 0; p < n; p++) {
+      uint32_t *slot = p % 2 ? &odd[p / 2 * slotWords] : &even[p / 2 * slotWords];
+      if (frameTransform) {
+        slot[2 * i] = transformPixel(from, to, weight, p);
+      } else {
+        slot[2 * i] = from[3 * p] << 16 | from[3 * p + 1] << 8 | from[3 * p + 2];
+      }
+      if (slotWords > 1) {
+        slot[2 * i + 1] = ctrl[p % 2];
       }
-    }
-
-    // If we finished sending data
-    if (complete) {
-      // Trigger the callback
-      tm_event_trigger(&animation_complete_event);
     }
   }
 }
 
-// Updates the SCT with the next byte of an animation
-// Returns the number of bytes updated (0 or 1)
-bool updateChannelAnimation(neopixel_sct_status_t channel) {
+// Loads the first pixel of the front buffer and streams the rest
+static void startFrame (void)
+{
+  uint32_t n = pixelsPerFrame;
+  const uint32_t *even = pixelWords[frontBuffer];
+
+  // The output buffers go first, with AUX low, while DMA loads the AUX
+  // buffers with pixel 1
+  LPC_SCT->OUTPUT &= ~(1u << NEOPIXEL_AUX_OUTPUT);
+  for (uint32_t i = 0; i < activeChannels; i++) {
+    uint32_t word = slotWords == 1 ? 0 : 2 * i;
+    LPC_SCT->OUTPUT &= ~(1u << sct_animation_channels[i].sctOutputChannel);
+    LPC_SCT->EVENT[sct_animation_channels[i].sctOutputBuffer].STATE = even[word];
+    LPC_SCT->EVENT[sct_animation_channels[i].sctAuxBuffer].STATE = 0;
+  }
 
-  bool byteSent = false;
+  // Drop requests left over from the last frame
+  LPC_SCT->DMAREQ0 = 0;
+  LPC_SCT->DMAREQ1 = 0;
+  if (outputItems) {
+    beginBufferDMA(HW_NEOPIXEL_OUTPUT_DMA_CHANNEL, SCT0_CONN, outputLLI[frontBuffer]);
+  }
+  if (auxItems) {
+    beginBufferDMA(HW_NEOPIXEL_AUX_DMA_CHANNEL, SCT1_CONN, auxLLI[frontBuffer]);
+  }
+  LPC_SCT->DMAREQ0 = (1u << REFILL_OUTPUT_EVENT);
+  LPC_SCT->DMAREQ1 = (1u << REFILL_AUX_EVENT);
+
+  LPC_SCT->EVEN &= ~COMPLETE_EVENTS;
+  LPC_SCT->EVFLAG = COMPLETE_EVENTS;
+  frameRunning = true;
+  if (n == 1) {
+    // A single pixel halts on its own complete event
+    LPC_SCT->HALT_H = COMPLETE_EVENTS;
+    LPC_SCT->EVEN |= COMPLETE_EVENTS;
+  } else {
+    LPC_SCT->HALT_H = 0;
+  }
 
-  // If this channel doesn't have an animation, then we can return
-  if (channel.animationStatus->animation.frames == NULL) return byteSent;
+  LEDDRIVER_start();
+}
 
-  channel.animationStatus->bytesSent+=3;
+// Streams the back buffer, which holds the next frame, and has the one
+// after expanded. Call with IRQs off or from an IRQ.
+static void nextFrame (void)
+{
+  frontBuffer = !frontBuffer;
+  nextReady = false;
+  frameWaiting = false;
+  startFrame();
+  tm_event_trigger(&expand_event);
+}
 
-  // If we have not yet sent all of our frames
-  if (channel.animationStatus->framesSent < channel.animationStatus->animation.numFrames) {
+// Shows the next frame if it's expanded, or idles until it is
+static void showNext (void)
+{
+  if (nextReady) {
+    nextFrame();
+  } else {
+    frameWaiting = true;
+  }
+}
+
+// The counter has halted after the last pixel of a frame: start the next
+// or finish. Call with IRQs off or from an IRQ.
+static void frameComplete (void)
+{
+  LPC_SCT->EVEN &= ~COMPLETE_EVENTS;
+  LPC_SCT->EVFLAG = COMPLETE_EVENTS;
+  if (!frameRunning) {
+    return;
+  }
+  frameRunning = false;
 
-    // If we have not yet sent all of our bytes in the current frame
-    if (channel.animationStatus->bytesSent <= channel.animationStatus->animation.frameLength) {
+  if (streaming && frameIndex < frameCount) {
+    // Show the next frame if there is one, or idle until it arrives
+    streamFramesShown++;
+    showNext();
+    return;
+  }
 
-      // Send the next byte
-      LEDDRIVER_writeNextRGBValue(channel); 
+  for (uint32_t i = 0; i < activeChannels; i++) {
+    neopixel_animation_status_t *status = sct_animation_channels[i].animationStatus;
+    if (status->framesSent < status->animation.numFrames) {
+      status->framesSent++;
+    }
+  }
+  if (++frameIndex < frameCount) {
+    showNext();
+  } else {
+    event_stats_trigger(EVENT_SOURCE_NEOPIXEL);
+    tm_event_trigger(&animation_complete_event);
+  }
+}
 
-      byteSent = true;
+static void sct_neopixel_irq_handler (uint32_t flags)
+{
+  if (flags & COMPLETE_EVENTS) {
+    frameComplete();
+  }
+}
 
-      uint32_t bytesRemaining = channel.animationStatus->animation.frameLength - channel.animationStatus->bytesSent;
+// Expands the frame after the one streaming into the back buffer, or the
+// one the strips are waiting on, which it then starts
+static void expandNext (tm_event *event)
+{
+  (void) event;
+  __disable_irq();
+  uint32_t index = frameWaiting ? frameIndex : frameIndex + 1;
+  bool wanted = activeChannels && !streaming && !nextReady && index < frameCount;
+  __enable_irq();
+  if (!wanted) {
+    return;
+  }
 
-      // If we only have one byte left (but it's double buffered, so the 2nd last byte is current being sent)
-      if (bytesRemaining == 3) {
+  expandFrame(pixelWords[!frontBuffer], index);
 
-        // We're going to halt
-        LEDDRIVER_haltAfterFrame(1);
+  __disable_irq();
+  nextReady = true;
+  if (frameWaiting) {
+    nextFrame();
+  }
+  __enable_irq();
+}
 
-      }
+// Called from DMA_IRQHandler. The halt word went out with the second to
+// last pixel; wait for the counter to halt on the last one.
+void neopixel_dma_irq (void)
+{
+  bool error = GPDMA_IntGetStatus(GPDMA_STAT_INTERR, HW_NEOPIXEL_OUTPUT_DMA_CHANNEL)
+    || GPDMA_IntGetStatus(GPDMA_STAT_INTERR, HW_NEOPIXEL_AUX_DMA_CHANNEL);
+  bool done = GPDMA_IntGetStatus(GPDMA_STAT_INTTC, HW_NEOPIXEL_OUTPUT_DMA_CHANNEL)
+    || GPDMA_IntGetStatus(GPDMA_STAT_INTTC, HW_NEOPIXEL_AUX_DMA_CHANNEL);
+  if (!error && !done) {
+    return;
+  }
+  GPDMA_ClearIntPending(GPDMA_STATCLR_INTERR, HW_NEOPIXEL_OUTPUT_DMA_CHANNEL);
+  GPDMA_ClearIntPending(GPDMA_STATCLR_INTERR, HW_NEOPIXEL_AUX_DMA_CHANNEL);
+  GPDMA_ClearIntPending(GPDMA_STATCLR_INTTC, HW_NEOPIXEL_OUTPUT_DMA_CHANNEL);
+  GPDMA_ClearIntPending(GPDMA_STATCLR_INTTC, HW_NEOPIXEL_AUX_DMA_CHANNEL);
+  if (!frameRunning) {
+    return;
+  }
 
-      // If we have sent all of the bytes in this frame (bytesSent is pre-)
-      else if (bytesRemaining == 0) {
-
-        // Move onto the next
-        channel.animationStatus->framesSent++;
-        channel.animationStatus->bytesSent = 0;
-        channel.animationStatus->bytesPending = 0;
-        // If we have now sent all of them
-        if (channel.animationStatus->framesSent == channel.animationStatus->animation.numFrames) {
-          // Trigger the end
-          byteSent = false;
-        }
-
-        // If not all frames have been sent
-        else {
-          // Continue with the next frame
-          continueAnimation();
-
-          byteSent = true;
-        }
-      }
+  __disable_irq();
+  if (error) {
+    // Give up on the animation
+    LPC_SCT->CTRL_H |= SCT_CTRL_H_HALT_H_Msk;
+    frameIndex = frameCount;
+    frameComplete();
+  } else {
+    LPC_SCT->EVFLAG = COMPLETE_EVENTS;
+    LPC_SCT->EVEN |= COMPLETE_EVENTS;
+    // It may have halted already
+    if (LPC_SCT->CTRL_H & SCT_CTRL_H_HALT_H_Msk) {
+      frameComplete();
     }
   }
+  __enable_irq();
+}
 
-  return byteSent;
+// Closes the stream's socket and frees its frames
+static void streamEnd (void)
+{
+  if (!streaming) {
+    return;
+  }
+  hw_periodic_cancel(&streamPoll);
+  if (streamSocket >= 0) {
+    tm_udp_close(streamSocket);
+  }
+  streamSocket = -1;
+  free(streamFrame);
+  free(streamPacket);
+  streamFrame = streamPacket = NULL;
+  streaming = false;
+  for (int i = 0; i < MAX_SCT_CHANNELS; i++) {
+    sct_animation_channels[i].animationStatus->animation.frames = NULL;
+    sct_animation_channels[i].animationStatus->animation.numFrames = 0;
+  }
 }
 
 void neopixel_reset_animation() {
 
-  // set the SCT state back to inactive
-  hw_sct_status = SCT_INACTIVE;
-
-  // Disable the SCT IRQ
-  NVIC_DisableIRQ(SCT_IRQn);
+  // Stop streaming
+  frameRunning = false;
+  hw_gpdma_cancel_transfer(HW_NEOPIXEL_OUTPUT_DMA_CHANNEL);
+  hw_gpdma_cancel_transfer(HW_NEOPIXEL_AUX_DMA_CHANNEL);
 
-  // We should make sure the SCT is halted
-  LEDDRIVER_haltAfterFrame(true);
+  // Halt the H counter and hand back only what we reserved
+  hw_sct_release(&neopixel_sct);
 
-  // really clear the SCT: ( 1 << 5 ) is an LPC18xx.h include workaround
-  LPC_RGU->RESET_CTRL1 = ( 1 << 5 );
+  for (int b = 0; b < 2; b++) {
+    free(pixelWords[b]);
+    free(outputLLI[b]);
+    free(auxLLI[b]);
+    pixelWords[b] = NULL;
+    outputLLI[b] = auxLLI[b] = NULL;
+  }
+  nextReady = false;
+  frameWaiting = false;
+  activeChannels = 0;
+
+  // Transforms are set again for each animation
+  frameTransform = false;
+  free(pixelBrightness);
+  pixelBrightness = NULL;
+  pixelBrightnessCount = 0;
+  fadeSteps = 0;
+
+  // Stop streaming; its frames aren't Lua buffers
+  streamEnd();
+
+  // Unreference the event, if an animation got far enough to hold it
+  if (animationHeld) {
+    tm_event_unref(&animation_complete_event);
+    animationHeld = false;
+  }
 
   // Make sure the Lua state exists
   lua_State* L = tm_lua_state;
@@ -325,8 +726,6 @@ void neopixel_reset_animation() {
     }
 
   }
-  // Unreference the event
-  tm_event_unref(&animation_complete_event);
 }
 
 void animation_complete() {
@@ -334,33 +733,46 @@ void animation_complete() {
   neopixel_reset_animation();
   lua_State* L = tm_lua_state;
   if (!L) return;
+  event_stats_begin(EVENT_SOURCE_NEOPIXEL);
   // Push the _colony_emit helper function onto the stack
   lua_getglobal(L, "_colony_emit");
   // The process message identifier
   lua_pushstring(L, "neopixel_animation_complete");
   // Call _colony_emit to run the JS callback
   tm_checked_call(L, 1);
+  event_stats_end();
 }
 
-void continueAnimation() {
-
-  // Todo: Make this extensible for more channels
-  LEDDRIVER_writeNextRGBValue(sct_animation_channels[0]);
-
-  // Don't halt
-  LPC_SCT->HALT_H = 0;
-
-  // Set the flag to get an interrupt when byte transfer is complete
-  LPC_SCT->EVEN |= (1u << COMPLETE_FRAME_EVENT);
-
-   /* Set reset time */
-  LPC_SCT->COUNT_H = - LPC_SCT->MATCHREL_H[0] * 50;     /* TODO: Modify this to guarantee 50 µs min in both modes! */
-
-  // Set the state to the default
-  LPC_SCT->STATE_H = BITS_PER_INTERRUPT;
+// Sizes both pixel buffers, and links each to its buffer events, with
+// linked lists for the longer half of a frame
+static int allocateFrame (uint32_t frameLength)
+{
+  uint32_t n = frameLength / 3;
+  if (n == 0) {
+    return -1;
+  }
+  uint32_t half = (n + 1) / 2;
+  uint32_t items = (slotWords == 1 ? (half + NEOPIXEL_DMA_CHUNK - 1) / NEOPIXEL_DMA_CHUNK : half) + 1;
+
+  for (int b = 0; b < 2; b++) {
+    pixelWords[b] = malloc(n * slotWords * sizeof(uint32_t));
+    outputLLI[b] = malloc(items * sizeof(hw_GPDMA_Linked_List_Type));
+    auxLLI[b] = malloc(items * sizeof(hw_GPDMA_Linked_List_Type));
+    if (!pixelWords[b] || !outputLLI[b] || !auxLLI[b]) {
+      return -1;
+    }
 
-  /* Start timer H */
-  LPC_SCT->CTRL_H &= ~SCT_CTRL_H_HALT_H_Msk;
+    // The channel due to load pixel n halts instead
+    const uint32_t *even = pixelWords[b];
+    const uint32_t *odd = even + half * slotWords;
+    outputItems = linkBufferWords(outputLLI[b], even + slotWords, half - 1, OUTPUT_BUFFER_EVENTS, n > 1 && n % 2 == 0);
+    auxItems = linkBufferWords(auxLLI[b], odd, n / 2, AUX_BUFFER_EVENTS, n > 1 && n % 2 == 1);
+  }
+  pixelsPerFrame = n;
+  frontBuffer = 0;
+  nextReady = false;
+  frameWaiting = false;
+  return 0;
 }
 
 void beginAnimation() {
@@ -368,27 +780,13 @@ void beginAnimation() {
   // Initialize the LEDDriver
   LEDDRIVER_open();
 
-  // Fill the double buffer with the first two bytes
-  for (int i = 0; i < MAX_SCT_CHANNELS; i++) {
-    // Reset struct status vars
-    sct_animation_channels[i].animationStatus->bytesPending = 0;
-    sct_animation_channels[i].animationStatus->bytesSent = 0;
-    // Write the first bytes to the output
-    LEDDRIVER_writeNextRGBValue((sct_animation_channels[i]));
-    // Toggle the AUX Output so the next write will go to Aux
-    LPC_SCT->OUTPUT &= ~(1u << sct_animation_channels[i].sctAuxChannel);
-    // Write the next bytes to Aux
-    LEDDRIVER_writeNextRGBValue((sct_animation_channels[i]));
-  }
+  frameIndex = 0;
+  haltWord = COMPLETE_EVENTS;
 
-  // Allow SCT IRQs (which update the relevant data byte)
-  NVIC_EnableIRQ(SCT_IRQn);
-
-  // Do not halt after the first frame
-  LEDDRIVER_haltAfterFrame(0);
-
-  // Start the operation
-  LEDDRIVER_start();
+  // Start the operation, expanding the next frame while it streams
+  expandFrame(pixelWords[frontBuffer], 0);
+  startFrame();
+  tm_event_trigger(&expand_event);
 }
 
 void setPinSCTFunc(uint8_t pin) {
@@ -399,30 +797,156 @@ void setPinSCTFunc(uint8_t pin) {
     g_APinDescription[pin].alternate_func);
 }
 
+// Copies `length` bytes at `offset` into the stream frame. The write that
+// completes it expands the frame into the back buffer, replacing one not
+// yet shown, and starts the strips if they're idle.
+int neopixel_stream_write (uint32_t offset, const uint8_t *data, size_t length)
+{
+  if (!streaming || offset + length > streamLength) {
+    return -1;
+  }
+
+  memcpy(&streamFrame[offset], data, length);
+  if (offset + length < streamLength) {
+    return 0;
+  }
+
+  __disable_irq();
+  if (nextReady) {
+    // Never shown
+    nextReady = false;
+    streamFramesDropped++;
+  }
+  __enable_irq();
+
+  expandFrame(pixelWords[!frontBuffer], 0);
+
+  __disable_irq();
+  nextReady = true;
+  if (frameWaiting) {
+    nextFrame();
+  }
+  __enable_irq();
+  return 0;
+}
+
+// Each packet is a 24 bit big endian offset into the frame, then its bytes
+static void stream_udp_receive (tm_event *event)
+{
+  (void) event;
+  while (streaming && streamSocket >= 0 && tm_udp_readable(streamSocket) > 0) {
+    size_t length = NEOPIXEL_UDP_PACKET;
+    uint32_t addr = 0;
+    uint16_t port = 0;
+    if (tm_udp_receive(streamSocket, streamPacket, &length, &addr, &port) != 0 || length < 3) {
+      break;
+    }
+    uint32_t offset = streamPacket[0] << 16 | streamPacket[1] << 8 | streamPacket[2];
+    neopixel_stream_write(offset, &streamPacket[3], length - 3);
+  }
+}
+
+tm_event stream_udp_event = TM_EVENT_INIT(stream_udp_receive);
+
+// The socket is read from the event loop, polled from SysTick
+static void stream_udp_tick (hw_periodic_t *periodic)
+{
+  (void) periodic;
+  tm_event_trigger(&stream_udp_event);
+}
+
+// Starts streaming `frameLength` byte frames to the strips claimed by
+// neopixel_sct_claim, fed by neopixel_stream_write, by USB messages and, if
+// `udpPort` isn't 0, by packets to that port
+int neopixel_stream_begin (uint32_t frameLength, uint16_t udpPort)
+{
+  if (activeChannels == 0 || fadeSteps || allocateFrame(frameLength) < 0) {
+    return -1;
+  }
+
+  streamLength = frameLength * activeChannels;
+  streamFrame = calloc(streamLength, 1);
+  if (!streamFrame) {
+    return -1;
+  }
+  streamFramesShown = streamFramesDropped = 0;
+
+  for (uint32_t i = 0; i < activeChannels; i++) {
+    neopixel_animation_t *animation = &sct_animation_channels[i].animationStatus->animation;
+    streamFrames[i] = &streamFrame[i * frameLength];
+    animation->frames = &streamFrames[i];
+    animation->frameLength = frameLength;
+    animation->numFrames = 1;
+    setPinSCTFunc(sct_animation_channels[i].pin);
+  }
+  frameIndex = 0;
+  frameCount = 1;
+  haltWord = COMPLETE_EVENTS;
+  streaming = true;
+
+  if (udpPort) {
+    streamPacket = malloc(NEOPIXEL_UDP_PACKET);
+    streamSocket = streamPacket ? tm_udp_open() : -1;
+    if (streamSocket < 0 || tm_udp_listen(streamSocket, udpPort) != 0) {
+      streamEnd();
+      return -1;
+    }
+    hw_periodic_start(&streamPoll, NEOPIXEL_STREAM_POLL_MS, stream_udp_tick);
+  }
+
+  // Strips start on the first complete frame
+  LEDDRIVER_open();
+  frameWaiting = true;
+
+  // Hold the event queue open until the stream is stopped
+  tm_event_ref(&animation_complete_event);
+  animationHeld = true;
+  return 0;
+}
+
+// Frames shown and dropped since the stream began
+uint32_t neopixel_stream_shown (void)
+{
+  return streamFramesShown;
+}
+
+uint32_t neopixel_stream_dropped (void)
+{
+  return streamFramesDropped;
+}
+
+// Starts the strips claimed by neopixel_sct_claim, one animation each, in
+// the claimed order. They must share a frame length.
 int8_t writeAnimationBuffers(neopixel_animation_status_t **channel_animations) {
 
-  // really clear the SCT: ( 1 << 5 ) is an LPC18xx.h include workaround
-  LPC_RGU->RESET_CTRL1 = ( 1 << 5 );
+  frameCount = 0;
 
-  // Bool indicating whether any channels have animations ready
-  bool animationsReady = false;
+  // Hand every channel's frames over first, so a reset frees them all
+  for (uint32_t i = 0; i < activeChannels; i++) {
+    *sct_animation_channels[i].animationStatus = *channel_animations[i];
+  }
 
-  // For each SCT channel
-  for (int i = 0; i < MAX_SCT_CHANNELS; i++) {
+  // For each claimed SCT channel
+  for (uint32_t i = 0; i < activeChannels; i++) {
 
-    // If this channel has animation frames
-    if (channel_animations[i]->animation.frames != NULL) {
-      // Assign the data buffers to the memory struct
-      *sct_animation_channels[i].animationStatus = *channel_animations[i];
+    // Every strip needs frames of the same length
+    if (channel_animations[i]->animation.frames == NULL
+      || channel_animations[i]->animation.frameLength != channel_animations[0]->animation.frameLength) {
+      return -1;
+    }
 
-      // Set up the pin as SCT
-      setPinSCTFunc(sct_animation_channels[i].pin);
+    // Set up the pin as SCT
+    setPinSCTFunc(sct_animation_channels[i].pin);
 
-      animationsReady = true;
+    if (channel_animations[i]->animation.numFrames > frameCount) {
+      frameCount = channel_animations[i]->animation.numFrames;
     }
   }
 
-  if (!animationsReady) {
+  // Fades add frames in between each pair
+  frameCount = frameCount ? (frameCount - 1) * (fadeSteps + 1) + 1 : 0;
+
+  if (activeChannels == 0 || allocateFrame(channel_animations[0]->animation.frameLength) < 0) {
     return -1;
   }
 
@@ -431,6 +955,7 @@ int8_t writeAnimationBuffers(neopixel_animation_status_t **channel_animations) {
 
   // Hold the event queue open until we're done with this event
   tm_event_ref(&animation_complete_event);
+  animationHeld = true;
 
   return 0;
 }
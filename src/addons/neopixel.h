@@ -24,8 +24,6 @@ current completion status
 */
 typedef struct {
   neopixel_animation_t animation; 
-  uint32_t bytesSent;
-  uint32_t bytesPending;
   uint32_t framesSent;
 } neopixel_animation_status_t;
 
@@ -46,20 +44,22 @@ int8_t writeAnimationBuffers (neopixel_animation_status_t **channel_animations);
 
 void neopixel_reset_animation ();
 
-void LEDDRIVER_open (void);
+int neopixel_stream_begin (uint32_t frameLength, uint16_t udpPort);
+uint32_t neopixel_stream_shown (void);
+uint32_t neopixel_stream_dropped (void);
 
-/* Simple function to write to a transmit buffer.
- * NOTE: Application must keep track of how many data words have been sent!
- */
-void LEDDRIVER_writeNextRGBValue (neopixel_sct_status_t sct_channel);
+int neopixel_set_transform (float gamma, const uint8_t *gammaTable, uint8_t brightness, const char *order,
+  const uint8_t *pixelScale, size_t pixelCount, uint32_t fade);
 
-/* Activate or deactivate HALT after next frame. */
-void LEDDRIVER_haltAfterFrame (int on);
+void LEDDRIVER_open (void);
 
 /* Start a block transmission */
 void LEDDRIVER_start (void);
 
-#define MAX_SCT_CHANNELS 1
+#define MAX_SCT_CHANNELS 3
+
+// SCT output driving the AUX signal all channels share
+#define NEOPIXEL_AUX_OUTPUT 1
 
 /** Macro to define register bits and mask in CMSIS style */
 #define LPCLIB_DefineRegBit(name,pos,width)    \
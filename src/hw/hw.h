@@ -35,6 +35,43 @@ typedef enum {
 
 void hw_usb_init(void);
 
+// Priority events
+// Native driver continuations (DMA chaining, USB and CC3000 traffic) that
+// must not wait behind Lua callbacks. They are drained from
+// hw_wait_for_event, before the runtime dispatches its next event, and must
+// not call into Lua; trigger a tm_event for the Lua-facing half instead.
+
+typedef struct hw_priority_event {
+	struct hw_priority_event* next;
+	volatile uint8_t pending;
+	void (*callback)(struct hw_priority_event* event);
+} hw_priority_event;
+
+#define HW_PRIORITY_EVENT_INIT(cb) { .next = NULL, .pending = 0, .callback = (cb) }
+
+void hw_priority_event_trigger (hw_priority_event* event);
+int hw_priority_events_pending (void);
+void hw_priority_events_process (void);
+
+// Periodic callbacks
+// Run from the SysTick interrupt on a timing wheel with HW_PERIODIC_TICK_MS
+// resolution. Keep callbacks short and trigger an event for longer work.
+// Entries must stay allocated until cancelled.
+
+#define HW_PERIODIC_TICK_MS 1
+
+typedef struct hw_periodic {
+	struct hw_periodic* next;
+	struct hw_periodic** pprev;
+	uint32_t period;
+	uint32_t rounds;
+	uint32_t count;
+	void (*callback)(struct hw_periodic* periodic);
+} hw_periodic_t;
+
+void hw_periodic_start (hw_periodic_t* periodic, uint32_t period_ms, void (*callback)(hw_periodic_t* periodic));
+void hw_periodic_cancel (hw_periodic_t* periodic);
+
 // Net
 
 #include "utility/socket.h"
@@ -263,6 +300,25 @@ uint32_t hw_uart_receive(uint32_t UARTPort, uint8_t *rxbuf, size_t buflen);
 uint32_t hw_uart_send(uint32_t UARTPort, const uint8_t *txbuf, size_t buflen);
 
 
+// timers
+// TIMER1 is shared by the software UART and the logic analyzer, TIMER2 by
+// the pattern generator and the PC sampler; see hw_timer.c.
+
+#define HW_TIMER_COUNT 4
+
+typedef enum {
+  HW_TIMER_FREE,
+  HW_TIMER_SWUART,
+  HW_TIMER_LOGIC,
+  HW_TIMER_PATTERN,
+  HW_TIMER_PROFILER
+} hw_timer_user_t;
+
+int hw_timer_claim (int timer, hw_timer_user_t user);
+void hw_timer_release (int timer, hw_timer_user_t user);
+hw_timer_user_t hw_timer_user (int timer);
+
+
 // software uart
 
 #include "lpc18xx_uart.h"
@@ -304,6 +360,23 @@ int hw_send_usb_msg_formatted(unsigned tag, const char* format, ...);
 #define TM_COMMAND(command, str, ...) hw_send_usb_msg_formatted(command, str, ##__VA_ARGS__)
 
 
+// watchdog
+// Event loop stall detector; see hw_watchdog.c. Timeouts are limited to
+// about 5.5s by the WWDT counter width.
+
+typedef enum {
+	HW_WATCHDOG_OFF = 0,
+	HW_WATCHDOG_REPORT,
+	HW_WATCHDOG_RECOVER,
+	HW_WATCHDOG_RESET
+} hw_watchdog_mode_t;
+
+int hw_watchdog_start (uint32_t timeout_ms, hw_watchdog_mode_t mode);
+void hw_watchdog_stop (void);
+void hw_watchdog_feed (void);
+void hw_watchdog_idle (int idle);
+
+
 // wait
 
 void hw_wait_ms (int ms);
@@ -343,6 +416,61 @@ int hw_interrupt_unwatch(int interrupt_index, int bitMask);
 int hw_interrupt_acquire (void);
 int hw_interrupt_assignment_query (int pin);
 
+// pin groups
+
+#define HW_GINT_COUNT 2
+
+int hw_gint_watch (int index, const uint8_t* pins, size_t count, uint32_t* levels);
+int hw_gint_unwatch (int index);
+void hw_gint_reset (void);
+
+// edge counters
+
+#define HW_COUNTER_SCT NUM_INTERRUPTS
+#define HW_COUNTER_COUNT (NUM_INTERRUPTS + 1)
+
+int hw_interrupt_count_start (int pin, int bitMask, int interrupt_index);
+uint32_t hw_interrupt_count_read (int interrupt_index);
+
+int hw_counter_start (int index, int pin, int bitMask, uint32_t window_ms);
+int hw_counter_stop (int index);
+void hw_counter_reset (void);
+
+// logic analyzer
+// GPDMA channels 0 and 1 belong to async SPI.
+
+#define HW_LOGIC_DMA_CHANNEL 2
+#define HW_LOGIC_PINS_MAX 32
+#define HW_LOGIC_RATE_MAX 10000000
+#define HW_LOGIC_DEPTH_MAX (1024 * 1024)
+
+typedef enum {
+	HW_LOGIC_TRIGGER_NONE = 0,
+	HW_LOGIC_TRIGGER_MATCH = 1,
+	HW_LOGIC_TRIGGER_CHANGE = 2
+} hw_logic_trigger_t;
+
+int hw_logic_start (const uint8_t* pins, size_t count, uint32_t rate,
+	hw_logic_trigger_t trigger, uint32_t trigger_mask, uint32_t trigger_value,
+	uint32_t pre, uint32_t post, int usb);
+void hw_logic_stop (void);
+void hw_logic_reset (void);
+void hw_logic_dma_irq (void);
+
+// pattern generator
+
+#define HW_PATTERN_SET_DMA_CHANNEL 3
+#define HW_PATTERN_CLR_DMA_CHANNEL 4
+#define HW_PATTERN_PINS_MAX 32
+#define HW_PATTERN_RATE_MAX 10000000
+#define HW_PATTERN_LLI_MAX 4096
+
+int hw_pattern_start (const uint8_t* pins, size_t count, uint32_t rate,
+	const uint8_t* data, size_t data_len, const uint8_t* segments, size_t segments_len, int loop);
+void hw_pattern_stop (void);
+void hw_pattern_reset (void);
+void hw_pattern_dma_irq (void);
+
 
 // highspeed signal
 
@@ -352,8 +480,54 @@ void hw_highspeedsignal_update (uint8_t *buf, size_t buf_len);
 
 // pwm
 
+// the period in SCT clocks: group 1 runs on a 16 bit counter half prescaled
+// up to 256, group 0 on the whole SCT when its period needs it
+#define HW_PWM_GROUP_PERIOD_MAX (0x10000 * 256)
+#define HW_PWM_PERIOD_MAX 0xFFFFFFFF
+// GPDMA channel playing pulse width sequences
+#define HW_PWM_SEQUENCE_DMA_CHANNEL 7
+
 int hw_pwm_port_period (uint32_t period);
+int hw_pwm_group_period (int group, uint32_t period);
+int hw_pwm_pin_group (int pin, int group);
 int hw_pwm_pin_pulsewidth (int pin, uint32_t pulsewidth);
+int hw_pwm_pin_sequence (int pin, const uint32_t* pulsewidths, size_t count, int repeat);
+void hw_pwm_sequence_stop (void);
+void hw_pwm_dma_irq (void);
+void hw_pwm_reset (void);
+
+// motor control pwm
+
+#define HW_MCPWM_CHANNELS 3
+
+// hw_mcpwm_start flags
+#define HW_MCPWM_CENTER (1 << 0) // center-aligned pulses
+#define HW_MCPWM_AC (1 << 1) // all channels on channel 0's timer, for three-phase AC
+#define HW_MCPWM_DC (1 << 2) // channel 0 commutated across the outputs, for BLDC
+#define HW_MCPWM_ACTIVE_LOW (1 << 3) // outputs idle high
+
+int hw_mcpwm_start (const uint8_t* pins, size_t count, uint32_t period, uint32_t deadtime, int flags);
+int hw_mcpwm_pulsewidth (int channel, uint32_t pulsewidth);
+int hw_mcpwm_commutate (uint32_t pattern);
+void hw_mcpwm_stop (void);
+void hw_mcpwm_reset (void);
+
+// quadrature encoder
+
+// hw_qei_start flags
+#define HW_QEI_4X (1 << 0) // count phase B edges as well as phase A
+#define HW_QEI_CLOCK_DIRECTION (1 << 1) // phase A clocks, phase B is the direction
+#define HW_QEI_INVERT_DIRECTION (1 << 2)
+#define HW_QEI_INVERT_INDEX (1 << 3)
+#define HW_QEI_INDEX_RESET (1 << 4) // zero the position on every index pulse
+
+int hw_qei_start (int pha, int phb, int idx, int flags, uint32_t max_position, uint32_t velocity_us, uint32_t filter);
+uint32_t hw_qei_position (void);
+int hw_qei_direction (void);
+uint32_t hw_qei_velocity (void);
+uint32_t hw_qei_index (void);
+void hw_qei_zero (void);
+void hw_qei_stop (void);
 
 // gpio
 
@@ -365,12 +539,26 @@ uint8_t hw_digital_read (size_t ulPin);
 uint8_t hw_digital_get_mode (uint8_t ulPin);
 int hw_digital_set_mode (uint8_t ulPin, uint8_t mode);
 
+#define HW_DIGITAL_PINS_MAX 32
+
+int hw_digital_write_pins (const uint8_t* pins, size_t count, uint32_t values);
+int hw_digital_read_pins (const uint8_t* pins, size_t count, uint32_t* values);
+
 uint32_t hw_analog_read (uint32_t ulPin);
 int hw_analog_write (uint32_t ulPin, float ulValue);
 
 // neopixel
+// GPDMA channels fed by the SCT's two DMA requests
+
+#define HW_NEOPIXEL_OUTPUT_DMA_CHANNEL 5
+#define HW_NEOPIXEL_AUX_DMA_CHANNEL 6
 
-void sct_neopixel_irq_handler (void);
+// USB messages tagged (HW_NEOPIXEL_USB_TAG << 24 | offset) feed the stream
+#define HW_NEOPIXEL_USB_TAG 0x4E
+
+int neopixel_sct_claim (const uint8_t* pins, size_t count);
+int neopixel_stream_write (uint32_t offset, const uint8_t* data, size_t length);
+void neopixel_dma_irq (void);
 
 // sct
 
@@ -382,7 +570,8 @@ typedef enum {
   SCT_INACTIVE,
   SCT_PWM,
   SCT_READPULSE,
-  SCT_NEOPIXEL
+  SCT_NEOPIXEL,
+  SCT_COUNTER
 } hw_sct_status_t;
 
 typedef enum {
@@ -390,11 +579,54 @@ typedef enum {
   SCT_PULSE_HIGH
 } hw_sct_pulse_type_t;
 
-extern hw_sct_status_t hw_sct_status;
-
-uint8_t sct_read_pulse (hw_sct_pulse_type_t type, uint32_t timeout);
-void sct_readpulse_irq_handler (void);
+// The SCT is shared out by resource: each driver's owner reserves a
+// counter half (or the whole SCT, unified), events, match/capture registers,
+// outputs and DMA requests. `irq` gets the owner's pending event flags.
+
+#define HW_SCT_L 0
+#define HW_SCT_H 1
+#define HW_SCT_EVENTS 16
+#define HW_SCT_OUTPUTS 16
+#define HW_SCT_REGS 16
+#define HW_SCT_DMAREQS 2
+
+typedef struct hw_sct_owner {
+  hw_sct_status_t user;
+  void (*irq) (uint32_t flags);
+  uint32_t events;
+} hw_sct_owner_t;
+
+int hw_sct_claim_counter (hw_sct_owner_t* owner, int half);
+int hw_sct_claim_unified (hw_sct_owner_t* owner);
+int hw_sct_claim_output (hw_sct_owner_t* owner, int output);
+int hw_sct_alloc_event (hw_sct_owner_t* owner);
+int hw_sct_alloc_events (hw_sct_owner_t* owner, int count);
+int hw_sct_alloc_reg (hw_sct_owner_t* owner, int half, int capture);
+int hw_sct_alloc_dma (hw_sct_owner_t* owner);
+void hw_sct_dma_events (int dma, uint32_t events);
+void hw_sct_free_event (hw_sct_owner_t* owner, int event);
+void hw_sct_free_reg (hw_sct_owner_t* owner, int half, int reg);
+void hw_sct_free_dma (hw_sct_owner_t* owner, int dma);
+int hw_sct_busy (hw_sct_owner_t* owner);
+void hw_sct_release_counter (hw_sct_owner_t* owner, int half);
+void hw_sct_release (hw_sct_owner_t* owner);
+
+void hw_sct_counter (int half, uint32_t prescale, int run);
+void hw_sct_match (int half, int reg, uint16_t value);
+void hw_sct_match_unified (int reg, uint32_t value);
+void hw_sct_capture_events (int half, int reg, uint32_t events);
+uint16_t hw_sct_capture (int half, int reg);
+
+// SCT inputs routed to pins, each measuring pulses independently on a
+// 16 bit counter half prescaled to 10MHz
+#define SCT_PULSE_CHANNELS 4
+#define SCT_PULSE_PRESCALE 18
+#define SCT_PULSE_TICKS_PER_US ( (SYSTEM_CORE_CLOCK) / (SCT_PULSE_PRESCALE) / 1000000 )
+
+int sct_read_pulse (uint8_t pin, hw_sct_pulse_type_t type, uint32_t timeout);
 void sct_read_pulse_reset (void);
+int sct_read_pulses (uint8_t pin, uint32_t batch, uint32_t timeout, int continuous);
+void sct_read_pulses_stop (uint8_t pin);
 
 
 #ifdef __cplusplus
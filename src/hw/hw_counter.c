@@ -0,0 +1,191 @@
+// Copyright 2014 Technical Machine, Inc. See the COPYRIGHT
+// file at the top-level directory of this distribution.
+//
+// Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+// http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+// <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+// option. This file may not be copied, modified, or distributed
+// except according to those terms.
+
+// Edge counters with a gate window. Counters 0 to NUM_INTERRUPTS - 1 count
+// in the matching pin interrupt slot, where the ISR only increments a
+// counter. HW_COUNTER_SCT clocks the SCT counter from CTIN_5 (GPIO bank G3)
+// so counting takes no CPU at all. Either way a periodic callback samples
+// the count once per window and JS gets one event with the count and the
+// exact time it covers.
+
+#include <stdlib.h>
+#include <stddef.h>
+
+#include "LPC18xx.h"
+#include "variant.h"
+#include "tm.h"
+#include "colony.h"
+#include "hw.h"
+#include "event_stats.h"
+
+// SCT input clock mode, clocked by the input and edge selected by CKSEL
+#define SCT_CONFIG_UNIFY (1 << 0)
+#define SCT_CONFIG_CLKMODE_INPUT (2 << 1)
+#define SCT_CONFIG_CKSEL(input, falling) ((((input) << 1) | (falling)) << 3)
+#define SCT_CTRL_HALT_L (1 << 2)
+#define SCT_CTRL_CLRCTR_L (1 << 3)
+
+#define SCT_COUNTER_INPUT 5
+#define SCT_COUNTER_PIN E_G3
+
+typedef struct {
+	tm_event event;
+	hw_periodic_t periodic;
+	uint8_t active;
+	uint32_t last_count;
+	uint32_t last_time;
+	// Accumulated since the last dispatch, in case JS falls behind
+	volatile uint32_t count;
+	volatile uint32_t elapsed;
+} hw_counter_t;
+
+static void counter_callback (tm_event* event);
+
+static hw_counter_t counters[HW_COUNTER_COUNT] = {
+	[0 ... HW_COUNTER_COUNT - 1] = { .event = TM_EVENT_INIT(counter_callback) },
+};
+
+static uint32_t counter_read (unsigned index)
+{
+	return index == HW_COUNTER_SCT ? LPC_SCT->COUNT_U : hw_interrupt_count_read(index);
+}
+
+// Closes a gate window from the SysTick interrupt.
+static void counter_window (hw_periodic_t* periodic)
+{
+	hw_counter_t* counter = (hw_counter_t*) ((uint8_t*) periodic - offsetof(hw_counter_t, periodic));
+	unsigned index = counter - counters;
+
+	uint32_t time = tm_uptime_micro();
+	uint32_t count = counter_read(index);
+	counter->count += count - counter->last_count;
+	counter->elapsed += time - counter->last_time;
+	counter->last_count = count;
+	counter->last_time = time;
+
+	tm_event_trigger(&counter->event);
+}
+
+// Emits "counter" with the counter index, the edges counted and the
+// microseconds they were counted over.
+static void counter_callback (tm_event* event)
+{
+	hw_counter_t* counter = (hw_counter_t*) event;
+
+	lua_State* L = tm_lua_state;
+	if (!L) return;
+
+	__disable_irq();
+	uint32_t count = counter->count;
+	uint32_t elapsed = counter->elapsed;
+	counter->count = 0;
+	counter->elapsed = 0;
+	__enable_irq();
+
+	event_stats_begin(EVENT_SOURCE_INTERRUPT);
+	lua_getglobal(L, "_colony_emit");
+	lua_pushstring(L, "counter");
+	lua_pushnumber(L, counter - counters);
+	lua_pushnumber(L, count);
+	lua_pushnumber(L, elapsed);
+	tm_checked_call(L, 4);
+	event_stats_end();
+}
+
+static hw_sct_owner_t counter_sct = { .user = SCT_COUNTER };
+
+static int counter_sct_start (int bitMask)
+{
+	if (bitMask != TM_INTERRUPT_MASK_BIT_RISING && bitMask != TM_INTERRUPT_MASK_BIT_FALLING) {
+		// The SCT counts one edge of its clock input
+		return -1;
+	}
+	// input clocking applies to the whole SCT
+	if (hw_sct_claim_unified(&counter_sct)) {
+		return -1;
+	}
+
+	scu_pinmux(g_APinDescription[SCT_COUNTER_PIN].port,
+		g_APinDescription[SCT_COUNTER_PIN].pin,
+		PUP_DISABLE | PDN_DISABLE | FILTER_ENABLE | INBUF_ENABLE,
+		g_APinDescription[SCT_COUNTER_PIN].alternate_func);
+
+	LPC_SCT->CTRL_U = SCT_CTRL_HALT_L | SCT_CTRL_CLRCTR_L;
+	LPC_SCT->CONFIG = SCT_CONFIG_UNIFY | SCT_CONFIG_CLKMODE_INPUT
+		| SCT_CONFIG_CKSEL(SCT_COUNTER_INPUT, bitMask == TM_INTERRUPT_MASK_BIT_FALLING);
+	LPC_SCT->CTRL_U = 0;
+	return 0;
+}
+
+static void counter_sct_stop (void)
+{
+	LPC_SCT->CTRL_U = SCT_CTRL_HALT_L;
+	hw_sct_release(&counter_sct);
+	hw_digital_startup(SCT_COUNTER_PIN);
+}
+
+// Starts counting edges (TM_INTERRUPT_MASK_BIT_* in `bitMask`) on `pin`,
+// reported every `window_ms`. Counter `index` is a free pin interrupt slot
+// or HW_COUNTER_SCT, which only works on the CTIN_5 pin and counts a single
+// edge.
+int hw_counter_start (int index, int pin, int bitMask, uint32_t window_ms)
+{
+	if (index < 0 || index >= HW_COUNTER_COUNT || window_ms == 0) {
+		return -1;
+	}
+	hw_counter_t* counter = &counters[index];
+	if (counter->active) {
+		return -1;
+	}
+
+	if (index == HW_COUNTER_SCT) {
+		if (pin != SCT_COUNTER_PIN || counter_sct_start(bitMask) < 0) {
+			return -1;
+		}
+	} else if (hw_interrupt_count_start(pin, bitMask, index) < 0) {
+		return -1;
+	}
+
+	counter->count = counter->elapsed = 0;
+	counter->last_count = counter_read(index);
+	counter->last_time = tm_uptime_micro();
+	counter->active = 1;
+	tm_event_ref(&counter->event);
+	hw_periodic_start(&counter->periodic, window_ms, counter_window);
+	return 0;
+}
+
+int hw_counter_stop (int index)
+{
+	if (index < 0 || index >= HW_COUNTER_COUNT) {
+		return -1;
+	}
+	hw_counter_t* counter = &counters[index];
+	if (!counter->active) {
+		return 0;
+	}
+
+	hw_periodic_cancel(&counter->periodic);
+	if (index == HW_COUNTER_SCT) {
+		counter_sct_stop();
+	} else {
+		hw_interrupt_unwatch(index, TM_INTERRUPT_MASK_BIT_RISING | TM_INTERRUPT_MASK_BIT_FALLING);
+	}
+	counter->active = 0;
+	tm_event_unref(&counter->event);
+	return 0;
+}
+
+void hw_counter_reset (void)
+{
+	int i;
+	for (i = 0; i < HW_COUNTER_COUNT; i++) {
+		hw_counter_stop(i);
+	}
+}
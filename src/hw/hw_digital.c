@@ -104,6 +104,90 @@ uint8_t hw_digital_read ( size_t ulPin )
 	return (res & (1<<g_APinDescription[ulPin].bitNum)) != 0 ? 1 : 0;
 }
 
+#define GPIO_PORTS 8
+
+// Sorts a pin list into per-port bit masks. Returns a bitmask of the ports
+// used, or -1 if any pin is not a GPIO.
+static int hw_digital_port_masks (const uint8_t* pins, size_t count, uint32_t values,
+	uint32_t mask[GPIO_PORTS], uint32_t set[GPIO_PORTS])
+{
+	if (count > HW_DIGITAL_PINS_MAX) {
+		return -1;
+	}
+
+	int ports = 0;
+	size_t i;
+	for (i = 0; i < count; i++) {
+		if (!hw_valid_pin(pins[i]) || g_APinDescription[pins[i]].portNum >= GPIO_PORTS) {
+			return -1;
+		}
+		uint8_t port = g_APinDescription[pins[i]].portNum;
+		uint32_t bit = 1u << g_APinDescription[pins[i]].bitNum;
+		mask[port] |= bit;
+		if (values & (1u << i)) {
+			set[port] |= bit;
+		}
+		ports |= 1 << port;
+	}
+	return ports;
+}
+
+// Drives pins[i] to bit i of `values`. Each GPIO port is updated with a
+// single MPIN store, so pins sharing a port change together.
+int hw_digital_write_pins (const uint8_t* pins, size_t count, uint32_t values)
+{
+	uint32_t mask[GPIO_PORTS] = {0}, set[GPIO_PORTS] = {0};
+	int ports = hw_digital_port_masks(pins, count, values, mask, set);
+	if (ports < 0) {
+		return -1;
+	}
+
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	unsigned port;
+	for (port = 0; port < GPIO_PORTS; port++) {
+		if (ports & (1 << port)) {
+			// MPIN only writes bits that are clear in MASK.
+			LPC_GPIO_PORT->MASK[port] = ~mask[port];
+			LPC_GPIO_PORT->MPIN[port] = set[port];
+			LPC_GPIO_PORT->MASK[port] = 0;
+		}
+	}
+	__set_PRIMASK(primask);
+	return 0;
+}
+
+// Reads pins[i] into bit i of `values`, sampling each port once.
+int hw_digital_read_pins (const uint8_t* pins, size_t count, uint32_t* values)
+{
+	uint32_t mask[GPIO_PORTS] = {0}, set[GPIO_PORTS] = {0};
+	int ports = hw_digital_port_masks(pins, count, 0, mask, set);
+	if (ports < 0) {
+		return -1;
+	}
+
+	uint32_t levels[GPIO_PORTS] = {0};
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	unsigned port;
+	for (port = 0; port < GPIO_PORTS; port++) {
+		if (ports & (1 << port)) {
+			levels[port] = LPC_GPIO_PORT->PIN[port];
+		}
+	}
+	__set_PRIMASK(primask);
+
+	*values = 0;
+	size_t i;
+	for (i = 0; i < count; i++) {
+		const PinDescription* desc = &g_APinDescription[pins[i]];
+		if (levels[desc->portNum] & (1u << desc->bitNum)) {
+			*values |= 1u << i;
+		}
+	}
+	return 0;
+}
+
 void hw_interrupt_enable(int index, int ulPin, int mode)
 {
 	assert(index >= 0 && index < 8);
@@ -0,0 +1,59 @@
+// Copyright 2014 Technical Machine, Inc. See the COPYRIGHT
+// file at the top-level directory of this distribution.
+//
+// Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+// http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+// <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+// option. This file may not be copied, modified, or distributed
+// except according to those terms.
+
+#include "hw.h"
+#include "LPC18xx.h"
+
+static hw_priority_event* priority_head = NULL;
+static hw_priority_event* priority_tail = NULL;
+
+// Safe to call from interrupt context, and idempotent until the event runs.
+void hw_priority_event_trigger (hw_priority_event* event)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	if (!event->pending) {
+		event->pending = 1;
+		event->next = NULL;
+		if (priority_tail) {
+			priority_tail->next = event;
+		} else {
+			priority_head = event;
+		}
+		priority_tail = event;
+	}
+	__set_PRIMASK(primask);
+}
+
+int hw_priority_events_pending (void)
+{
+	return priority_head != NULL;
+}
+
+void hw_priority_events_process (void)
+{
+	while (1) {
+		__disable_irq();
+		hw_priority_event* event = priority_head;
+		if (event) {
+			priority_head = event->next;
+			if (!priority_head) {
+				priority_tail = NULL;
+			}
+			// Clear before running so the callback may re-trigger it.
+			event->pending = 0;
+		}
+		__enable_irq();
+
+		if (!event) {
+			break;
+		}
+		event->callback(event);
+	}
+}
@@ -0,0 +1,34 @@
+// Generated by tools/gen_ffi.js from hw.h. Do not edit.
+
+#pragma once
+
+#include "hw.h"
+
+typedef struct {
+	const char* name;
+	const char* signature;
+	int argc;
+	void* fn;
+} hw_ffi_entry_t;
+
+static const hw_ffi_entry_t hw_ffi_entries[] = {
+	{ "sleep_us", "void (*)(int)", 1, (void*) hw_wait_us },
+	{ "sleep_ms", "void (*)(int)", 1, (void*) hw_wait_ms },
+	{ "digital_output", "void (*)(uint8_t)", 1, (void*) hw_digital_output },
+	{ "digital_input", "void (*)(uint8_t)", 1, (void*) hw_digital_input },
+	{ "digital_write", "void (*)(size_t, uint8_t)", 2, (void*) hw_digital_write },
+	{ "digital_read", "uint8_t (*)(size_t)", 1, (void*) hw_digital_read },
+	{ "digital_get_mode", "uint8_t (*)(uint8_t)", 1, (void*) hw_digital_get_mode },
+	{ "digital_set_mode", "int (*)(uint8_t, uint8_t)", 2, (void*) hw_digital_set_mode },
+	{ "analog_read", "uint32_t (*)(uint32_t)", 1, (void*) hw_analog_read },
+	{ "pwm_port_period", "int (*)(uint32_t)", 1, (void*) hw_pwm_port_period },
+	{ "pwm_pin_pulsewidth", "int (*)(int, uint32_t)", 2, (void*) hw_pwm_pin_pulsewidth },
+	{ "pwm_group_period", "int (*)(int, uint32_t)", 2, (void*) hw_pwm_group_period },
+	{ "pwm_pin_group", "int (*)(int, int)", 2, (void*) hw_pwm_pin_group },
+	{ "mcpwm_pulsewidth", "int (*)(int, uint32_t)", 2, (void*) hw_mcpwm_pulsewidth },
+	{ "qei_position", "uint32_t (*)(void)", 0, (void*) hw_qei_position },
+	{ "qei_direction", "int (*)(void)", 0, (void*) hw_qei_direction },
+	{ "qei_velocity", "uint32_t (*)(void)", 0, (void*) hw_qei_velocity },
+	{ "qei_index", "uint32_t (*)(void)", 0, (void*) hw_qei_index },
+	{ NULL, NULL, 0, NULL }
+};
@@ -0,0 +1,239 @@
+// Copyright 2014 Technical Machine, Inc. See the COPYRIGHT
+// file at the top-level directory of this distribution.
+//
+// Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+// http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+// <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+// option. This file may not be copied, modified, or distributed
+// except according to those terms.
+
+// Pin change detection on the two GPIO group interrupt blocks. Each group
+// watches up to 32 pins with one IRQ: the group is set to OR its pins in
+// level mode, with each pin's polarity set to the opposite of its current
+// level, so it fires as soon as any pin changes. The ISR snapshots the
+// pins, queues the diff and re-arms the polarities from the new levels.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "LPC18xx.h"
+#include "variant.h"
+#include "tm.h"
+#include "colony.h"
+#include "hw.h"
+#include "event_stats.h"
+
+#define GINT_CTRL_INT (1 << 0)
+#define GINT_CTRL_COMB_OR (0 << 1)
+#define GINT_CTRL_TRIG_LEVEL (1 << 2)
+
+#define GINT_PORTS 8
+#define GINT_RING_SIZE 32
+#define GINT_RING_MASK (GINT_RING_SIZE - 1)
+
+typedef struct {
+	uint32_t time;
+	uint32_t changed;
+	uint32_t levels;
+} hw_gint_change_t;
+
+typedef struct {
+	tm_event event;
+	LPC_GPIO_GROUP_INTn_Type* regs;
+	IRQn_Type irq;
+	uint8_t active;
+	uint8_t count;
+	uint8_t port[HW_DIGITAL_PINS_MAX];
+	uint32_t bit[HW_DIGITAL_PINS_MAX];
+	uint32_t levels;
+	hw_gint_change_t ring[GINT_RING_SIZE];
+	volatile uint32_t head;
+	volatile uint32_t tail;
+	volatile uint32_t overflow;
+} hw_gint_t;
+
+static void gint_callback (tm_event* event);
+
+static hw_gint_t gints[HW_GINT_COUNT] = {
+	{ .event = TM_EVENT_INIT(gint_callback), .regs = LPC_GPIO_GROUP_INT0, .irq = GINT0_IRQn },
+	{ .event = TM_EVENT_INIT(gint_callback), .regs = LPC_GPIO_GROUP_INT1, .irq = GINT1_IRQn },
+};
+
+// Reads the watched pins into bit i = pins[i], sampling each port once.
+static uint32_t gint_levels (hw_gint_t* gint)
+{
+	uint32_t ports[GINT_PORTS];
+	unsigned i;
+	for (i = 0; i < GINT_PORTS; i++) {
+		ports[i] = gint->regs->PORT_ENA[i] ? LPC_GPIO_PORT->PIN[i] : 0;
+	}
+
+	uint32_t levels = 0;
+	for (i = 0; i < gint->count; i++) {
+		if (ports[gint->port[i]] & gint->bit[i]) {
+			levels |= 1u << i;
+		}
+	}
+	return levels;
+}
+
+// Sets each pin to trigger on the level it is not at.
+static void gint_arm (hw_gint_t* gint, uint32_t levels)
+{
+	uint32_t pol[GINT_PORTS] = {0};
+	unsigned i;
+	for (i = 0; i < gint->count; i++) {
+		if (!(levels & (1u << i))) {
+			pol[gint->port[i]] |= gint->bit[i];
+		}
+	}
+	for (i = 0; i < GINT_PORTS; i++) {
+		gint->regs->PORT_POL[i] = pol[i];
+	}
+}
+
+static void gint_irq (hw_gint_t* gint)
+{
+	uint32_t time = tm_uptime_micro();
+	uint32_t levels = gint_levels(gint);
+	gint_arm(gint, levels);
+	gint->regs->CTRL |= GINT_CTRL_INT;
+
+	uint32_t changed = levels ^ gint->levels;
+	gint->levels = levels;
+	if (!changed) {
+		return;
+	}
+
+	uint32_t head = gint->head;
+	if (head - gint->tail >= GINT_RING_SIZE) {
+		gint->overflow++;
+	} else {
+		hw_gint_change_t* change = &gint->ring[head & GINT_RING_MASK];
+		change->time = time;
+		change->changed = changed;
+		change->levels = levels;
+		gint->head = head + 1;
+	}
+
+	event_stats_trigger(EVENT_SOURCE_INTERRUPT);
+	tm_event_trigger(&gint->event);
+}
+
+void __attribute__ ((interrupt)) GINT0_IRQHandler (void)
+{
+	gint_irq(&gints[0]);
+}
+
+void __attribute__ ((interrupt)) GINT1_IRQHandler (void)
+{
+	gint_irq(&gints[1]);
+}
+
+// Emits "gint_change" with the group, a buffer of [time us][changed][levels]
+// little-endian uint32 triples oldest first (bit i = pins[i]), and the
+// number of changes dropped while the ring was full.
+static void gint_callback (tm_event* event)
+{
+	hw_gint_t* gint = (hw_gint_t*) event;
+
+	lua_State* L = tm_lua_state;
+	if (!L) return;
+
+	event_stats_begin(EVENT_SOURCE_INTERRUPT);
+
+	__disable_irq();
+	uint32_t tail = gint->tail;
+	uint32_t count = gint->head - tail;
+	uint32_t overflow = gint->overflow;
+	gint->overflow = 0;
+	__enable_irq();
+
+	lua_getglobal(L, "_colony_emit");
+	lua_pushstring(L, "gint_change");
+	lua_pushnumber(L, gint - gints);
+	hw_gint_change_t* changes = (hw_gint_change_t*) colony_createbuffer(L, count * sizeof(hw_gint_change_t));
+	uint32_t i;
+	for (i = 0; i < count; i++) {
+		changes[i] = gint->ring[(tail + i) & GINT_RING_MASK];
+	}
+	gint->tail = tail + count;
+	lua_pushnumber(L, overflow);
+	tm_checked_call(L, 4);
+
+	event_stats_end();
+}
+
+// Watches `pins` on group `index` for any change and stores their current
+// levels (bit i = pins[i]) in `levels`. Returns -1 if the group is busy or
+// a pin is not a GPIO.
+int hw_gint_watch (int index, const uint8_t* pins, size_t count, uint32_t* levels)
+{
+	if (index < 0 || index >= HW_GINT_COUNT || count == 0 || count > HW_DIGITAL_PINS_MAX) {
+		return -1;
+	}
+	hw_gint_t* gint = &gints[index];
+	if (gint->active) {
+		return -1;
+	}
+
+	uint32_t ena[GINT_PORTS] = {0};
+	size_t i;
+	for (i = 0; i < count; i++) {
+		if (!hw_valid_pin(pins[i]) || g_APinDescription[pins[i]].portNum >= GINT_PORTS) {
+			return -1;
+		}
+		hw_digital_input(pins[i]);
+		gint->port[i] = g_APinDescription[pins[i]].portNum;
+		gint->bit[i] = 1u << g_APinDescription[pins[i]].bitNum;
+		ena[gint->port[i]] |= gint->bit[i];
+	}
+	gint->count = count;
+
+	NVIC_DisableIRQ(gint->irq);
+	for (i = 0; i < GINT_PORTS; i++) {
+		gint->regs->PORT_ENA[i] = ena[i];
+	}
+	gint->levels = gint_levels(gint);
+	gint_arm(gint, gint->levels);
+	gint->regs->CTRL = GINT_CTRL_INT | GINT_CTRL_COMB_OR | GINT_CTRL_TRIG_LEVEL;
+
+	gint->head = gint->tail = gint->overflow = 0;
+	gint->active = 1;
+	tm_event_ref(&gint->event);
+	NVIC_ClearPendingIRQ(gint->irq);
+	NVIC_EnableIRQ(gint->irq);
+
+	*levels = gint->levels;
+	return 0;
+}
+
+int hw_gint_unwatch (int index)
+{
+	if (index < 0 || index >= HW_GINT_COUNT) {
+		return -1;
+	}
+	hw_gint_t* gint = &gints[index];
+	if (!gint->active) {
+		return 0;
+	}
+
+	NVIC_DisableIRQ(gint->irq);
+	unsigned i;
+	for (i = 0; i < GINT_PORTS; i++) {
+		gint->regs->PORT_ENA[i] = 0;
+	}
+	gint->regs->CTRL = GINT_CTRL_INT;
+	gint->active = 0;
+	tm_event_unref(&gint->event);
+	return 0;
+}
+
+// Frees both groups when a script ends.
+void hw_gint_reset (void)
+{
+	int i;
+	for (i = 0; i < HW_GINT_COUNT; i++) {
+		hw_gint_unwatch(i);
+	}
+}
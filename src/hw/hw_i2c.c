@@ -11,6 +11,7 @@
 #include <stdint.h>
 
 #include "hw.h"
+#include "trace.h"
 #include "lpc18xx_i2c.h"
 #include "lpc18xx_cgu.h"
 #include "lpc18xx_gpio.h"
@@ -91,7 +92,9 @@ int hw_i2c_master_transfer (uint32_t port, uint32_t addr, const uint8_t *txbuf,
 	transferMCfg.tx_count = 0;
 	transferMCfg.rx_count = 0;
 	transferMCfg.retransmissions_count = 0;
+	TRACE_BEGIN(TRACE_I2C);
 	int status = I2C_MasterTransferData((LPC_I2Cn_Type*) port, &transferMCfg, I2C_TRANSFER_POLLING);
+	TRACE_END(TRACE_I2C);
   return status == SUCCESS ? 0 : 1;
 }
 
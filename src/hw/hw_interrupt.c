@@ -14,6 +14,7 @@
 #include "colony.h"
 #include "hw.h"
 #include "tessel.h"
+#include "event_stats.h"
 #include "assert.h"
 #include "lpc18xx_gpio.h"
 
@@ -23,12 +24,28 @@
 
 #define NO_ASSIGNMENT -1
 
+// Edges captured by the ISR, waiting to be delivered to JS.
+#define EDGE_RING_SIZE 64
+#define EDGE_RING_MASK (EDGE_RING_SIZE - 1)
+
+typedef struct {
+	uint32_t time;
+	uint32_t state;
+} GPIO_Edge;
+
 typedef struct {
 	tm_event event;
 	int pin;
 	int mode;
 	int state;
 	void (*callback)();
+	GPIO_Edge edges[EDGE_RING_SIZE];
+	volatile uint32_t edge_head;
+	volatile uint32_t edge_tail;
+	volatile uint32_t edge_overflow;
+	// Counting mode: the ISR only counts edges
+	uint8_t counting;
+	volatile uint32_t counted;
 } GPIO_Interrupt;
 
 static void interrupt_callback(tm_event* event);
@@ -123,6 +140,7 @@ int hw_interrupt_unwatch(int interrupt_index, int bitMask) {
 			interrupts[interrupt_index].pin = NO_ASSIGNMENT;
 			interrupts[interrupt_index].mode = NO_ASSIGNMENT;
 			interrupts[interrupt_index].callback = NULL;
+			interrupts[interrupt_index].counting = 0;
 
 			tm_event_unref(&interrupts[interrupt_index].event);
 		}
@@ -143,6 +161,13 @@ int hw_interrupt_watch (int pin, int bitMask, int interrupt_index, void (*callba
 	// If the interrupt ID was valid
 	if (interrupt_index >= 0 && interrupt_index < NUM_INTERRUPTS) {
 
+		// Start with an empty edge ring
+		__disable_irq();
+		interrupts[interrupt_index].edge_head = 0;
+		interrupts[interrupt_index].edge_tail = 0;
+		interrupts[interrupt_index].edge_overflow = 0;
+		__enable_irq();
+
 		// Assign the pin to the interrupt
 		interrupts[interrupt_index].pin = pin;
 		interrupts[interrupt_index].callback = callback;
@@ -175,6 +200,32 @@ int hw_interrupt_watch (int pin, int bitMask, int interrupt_index, void (*callba
 }
 
 
+// Delivers every edge captured since the last dispatch as one
+// "interrupt_edges" event: the interrupt index, a buffer of
+// [time us][state] little-endian uint32 pairs oldest first, and the number
+// of edges dropped because the ring was full.
+static void interrupt_emit_edges(lua_State* L, GPIO_Interrupt* interrupt, int interrupt_index)
+{
+	__disable_irq();
+	uint32_t tail = interrupt->edge_tail;
+	uint32_t count = interrupt->edge_head - tail;
+	uint32_t overflow = interrupt->edge_overflow;
+	interrupt->edge_overflow = 0;
+	__enable_irq();
+
+	lua_getglobal(L, "_colony_emit");
+	lua_pushstring(L, "interrupt_edges");
+	lua_pushnumber(L, interrupt_index);
+	GPIO_Edge* edges = (GPIO_Edge*) colony_createbuffer(L, count * sizeof(GPIO_Edge));
+	for (uint32_t i = 0; i < count; i++) {
+		edges[i] = interrupt->edges[(tail + i) & EDGE_RING_MASK];
+	}
+	// Only the ISR moves head, so the entries copied above are stable.
+	interrupt->edge_tail = tail + count;
+	lua_pushnumber(L, overflow);
+	tm_checked_call(L, 4);
+}
+
 void interrupt_callback(tm_event* event)
 {
 	GPIO_Interrupt* interrupt = (GPIO_Interrupt*) event;
@@ -183,46 +234,113 @@ void interrupt_callback(tm_event* event)
 	lua_State* L = tm_lua_state;
 	if (!L) return;
 
+	event_stats_begin(EVENT_SOURCE_INTERRUPT);
+	if (interrupt->edge_head != interrupt->edge_tail || interrupt->edge_overflow) {
+		interrupt_emit_edges(L, interrupt, interrupt_index);
+		event_stats_end();
+		return;
+	}
+
 	lua_getglobal(L, "_colony_emit");
 	lua_pushstring(L, "interrupt");
 	lua_pushnumber(L, interrupt_index);
 	lua_pushnumber(L, interrupt->state);
 	lua_pushnumber(L, tm_uptime_micro());
 	tm_checked_call(L, 4);
+	event_stats_end();
+}
+
+
+
+// Watches `pin` in counting mode: edges selected by `bitMask` (rising and/or
+// falling) only increment a counter, read with hw_interrupt_count_read.
+int hw_interrupt_count_start (int pin, int bitMask, int interrupt_index)
+{
+	if (interrupt_index < 0 || interrupt_index >= NUM_INTERRUPTS
+		|| !bitMask || (bitMask & ~(TM_INTERRUPT_MASK_BIT_RISING | TM_INTERRUPT_MASK_BIT_FALLING))) {
+		return NO_ASSIGNMENT;
+	}
+	interrupts[interrupt_index].counting = 1;
+	interrupts[interrupt_index].counted = 0;
+	if (hw_interrupt_watch(pin, bitMask, interrupt_index, NULL) < 0) {
+		interrupts[interrupt_index].counting = 0;
+		return NO_ASSIGNMENT;
+	}
+	return 1;
 }
 
+// Free-running count of edges seen in counting mode.
+uint32_t hw_interrupt_count_read (int interrupt_index)
+{
+	return interrupts[interrupt_index].counted;
+}
 
+static void push_edge(GPIO_Interrupt* interrupt, uint32_t time, uint32_t state)
+{
+	interrupt->state = state;
+
+	uint32_t head = interrupt->edge_head;
+	if (head - interrupt->edge_tail >= EDGE_RING_SIZE) {
+		interrupt->edge_overflow++;
+		return;
+	}
+	interrupt->edges[head & EDGE_RING_MASK].time = time;
+	interrupt->edges[head & EDGE_RING_MASK].state = state;
+	interrupt->edge_head = head + 1;
+}
 
 void place_awaiting_interrupt(int interrupt_id)
 {
 	GPIO_Interrupt* interrupt = &interrupts[interrupt_id];
 
+	if (interrupt->counting) {
+		// Both edges can latch between interrupts when the pin toggles
+		// faster than we get here, so count each watched one.
+		int rose = (interrupt->mode & TM_INTERRUPT_MASK_BIT_RISING) &&
+			(LPC_GPIO_PIN_INT->RISE & (1 << interrupt_id));
+		int fell = (interrupt->mode & TM_INTERRUPT_MASK_BIT_FALLING) &&
+			(LPC_GPIO_PIN_INT->FALL & (1 << interrupt_id));
+		// Clears both edge flags
+		LPC_GPIO_PIN_INT->IST = (1 << interrupt_id);
+		interrupt->counted += rose + fell;
+		return;
+	}
+
 	// If it's an edge triggered interrupt
 	if (interrupt-> mode & (TM_INTERRUPT_MASK_BIT_RISING | TM_INTERRUPT_MASK_BIT_FALLING)) {
+		// Timestamp the edge here rather than at dispatch
+		uint32_t time = tm_uptime_micro();
 
-		// It's a rising edge and we were waiting for a rising edge
-		// Note that this register will change even if you didn't
-		// activate the register
-		if ((interrupt->mode & TM_INTERRUPT_MASK_BIT_RISING) &&
-		 	(LPC_GPIO_PIN_INT->RISE & (1 << interrupt_id))) {
-			// Clear the pending interrupt
+		// Note that these registers change even for edges that aren't
+		// enabled
+		int rose = (interrupt->mode & TM_INTERRUPT_MASK_BIT_RISING) &&
+			(LPC_GPIO_PIN_INT->RISE & (1 << interrupt_id));
+		int fell = (interrupt->mode & TM_INTERRUPT_MASK_BIT_FALLING) &&
+			(LPC_GPIO_PIN_INT->FALL & (1 << interrupt_id));
+
+		if (!rose && !fell) {
+			// Something went wrong
+			return;
+		}
+		if (rose) {
 			GPIO_ClearInt(TM_INTERRUPT_MODE_RISING, interrupt_id);
-			// Set the state to high
-			interrupt->state = TM_INTERRUPT_MASK_BIT_RISING;
 		}
-		// It's a falling edge and we were waiting for a rising edge
-		// Note that this register will change even if you didn't
-		// activate the register
-		else if((interrupt->mode & TM_INTERRUPT_MASK_BIT_FALLING) &&
-		 	(LPC_GPIO_PIN_INT->FALL & (1 << interrupt_id))) {
-			// Clear the pending interrupt
+		if (fell) {
 			GPIO_ClearInt(TM_INTERRUPT_MODE_FALLING, interrupt_id);
-			// Set the state to low
-			interrupt->state = TM_INTERRUPT_MASK_BIT_FALLING;
 		}
-		else {
-			// Something went wrong
-			return;
+
+		if (rose && fell) {
+			// Both latched before we got here; the pin's level now tells
+			// which came last.
+			if (hw_digital_read(interrupt->pin)) {
+				push_edge(interrupt, time, TM_INTERRUPT_MASK_BIT_FALLING);
+				push_edge(interrupt, time, TM_INTERRUPT_MASK_BIT_RISING);
+			} else {
+				push_edge(interrupt, time, TM_INTERRUPT_MASK_BIT_RISING);
+				push_edge(interrupt, time, TM_INTERRUPT_MASK_BIT_FALLING);
+			}
+		} else {
+			push_edge(interrupt, time, rose ? TM_INTERRUPT_MASK_BIT_RISING : TM_INTERRUPT_MASK_BIT_FALLING);
 		}
 	}
 	// It's a level trigger
@@ -255,6 +373,7 @@ void place_awaiting_interrupt(int interrupt_id)
 		(*interrupt->callback)();
 	}
 	else {
+		event_stats_trigger(EVENT_SOURCE_INTERRUPT);
 		tm_event_trigger(&interrupt->event);
 	}
 }
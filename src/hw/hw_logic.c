@@ -0,0 +1,347 @@
+// Copyright 2014 Technical Machine, Inc. See the COPYRIGHT
+// file at the top-level directory of this distribution.
+//
+// Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+// http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+// <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+// option. This file may not be copied, modified, or distributed
+// except according to those terms.
+
+// Logic analyzer. TIMER1 match 0 paces a GPDMA channel that copies one GPIO
+// port's PIN register into a circular buffer (on the heap, so in SDRAM),
+// with no CPU involvement per sample. The buffer is a ring of linked list
+// items; each one raises a terminal count interrupt, where the completed
+// chunk is scanned for the trigger condition until it is found, and the
+// capture stops once enough samples follow it.
+//
+// The timer's match DMA request is cleared when the GPDMA services it, so
+// the channel is set up as a peripheral-to-memory transfer on the MAT1.0
+// request line with the GPIO register as its source address. TIMER1 is
+// claimed from the software UART for the length of a capture.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "LPC18xx.h"
+#include "lpc18xx_cgu.h"
+#include "lpc18xx_gpdma.h"
+#include "variant.h"
+#include "tm.h"
+#include "colony.h"
+#include "hw.h"
+
+#define LOGIC_TIMER LPC_TIMER1
+#define LOGIC_TIMER_INDEX 1
+#define LOGIC_CHUNK 2048
+#define LOGIC_PORTS 8
+
+typedef enum {
+	LOGIC_IDLE,
+	LOGIC_RUNNING,
+	LOGIC_DONE,
+	LOGIC_ERROR
+} logic_state_t;
+
+static struct {
+	volatile logic_state_t state;
+	uint32_t* ring;
+	hw_GPDMA_Linked_List_Type* lli;
+	uint32_t chunks;
+	uint32_t rate;
+	uint8_t port;
+	uint8_t usb;
+
+	// Pins, for packing samples on export
+	uint8_t count;
+	uint32_t bit[HW_LOGIC_PINS_MAX];
+
+	hw_logic_trigger_t trigger;
+	uint32_t trigger_mask;
+	uint32_t trigger_value;
+	uint32_t previous;
+
+	uint32_t pre;
+	uint32_t post;
+	volatile uint32_t done_chunks;
+	volatile int32_t trigger_index;
+} logic;
+
+static void logic_complete (tm_event* event);
+static tm_event logic_event = TM_EVENT_INIT(logic_complete);
+
+static void logic_halt (void)
+{
+	LOGIC_TIMER->TCR = 0;
+	hw_gpdma_cancel_transfer(HW_LOGIC_DMA_CHANNEL);
+	hw_timer_release(LOGIC_TIMER_INDEX, HW_TIMER_LOGIC);
+}
+
+// Returns the index within `samples` where the trigger condition holds, or -1.
+static int32_t logic_scan (const uint32_t* samples, uint32_t count)
+{
+	uint32_t i;
+	if (logic.trigger == HW_LOGIC_TRIGGER_MATCH) {
+		for (i = 0; i < count; i++) {
+			if ((samples[i] & logic.trigger_mask) == logic.trigger_value) {
+				return i;
+			}
+		}
+	} else if (logic.trigger == HW_LOGIC_TRIGGER_CHANGE) {
+		uint32_t previous = logic.previous;
+		for (i = 0; i < count; i++) {
+			if ((samples[i] ^ previous) & logic.trigger_mask) {
+				return i;
+			}
+			previous = samples[i];
+		}
+		logic.previous = previous;
+	}
+	return -1;
+}
+
+// Called from DMA_IRQHandler.
+void hw_logic_dma_irq (void)
+{
+	if (!GPDMA_IntGetStatus(GPDMA_STAT_INT, HW_LOGIC_DMA_CHANNEL)) {
+		return;
+	}
+
+	if (GPDMA_IntGetStatus(GPDMA_STAT_INTERR, HW_LOGIC_DMA_CHANNEL)) {
+		GPDMA_ClearIntPending(GPDMA_STATCLR_INTERR, HW_LOGIC_DMA_CHANNEL);
+		logic_halt();
+		logic.state = LOGIC_ERROR;
+		tm_event_trigger(&logic_event);
+		return;
+	}
+
+	if (!GPDMA_IntGetStatus(GPDMA_STAT_INTTC, HW_LOGIC_DMA_CHANNEL)) {
+		return;
+	}
+	GPDMA_ClearIntPending(GPDMA_STATCLR_INTTC, HW_LOGIC_DMA_CHANNEL);
+	if (logic.state != LOGIC_RUNNING) {
+		return;
+	}
+
+	uint32_t chunk = logic.done_chunks;
+	if (logic.trigger_index < 0) {
+		int32_t found = logic_scan(&logic.ring[(chunk % logic.chunks) * LOGIC_CHUNK], LOGIC_CHUNK);
+		if (found >= 0) {
+			logic.trigger_index = chunk * LOGIC_CHUNK + found;
+		}
+	}
+	logic.done_chunks = ++chunk;
+
+	if (logic.trigger_index >= 0 && chunk * LOGIC_CHUNK >= logic.trigger_index + logic.post) {
+		logic_halt();
+		logic.state = LOGIC_DONE;
+		tm_event_trigger(&logic_event);
+	}
+}
+
+// Starts capturing `pins`, which must share a GPIO port, at `rate` Hz.
+// Keeps `pre` samples before the trigger and `post` from it on.
+int hw_logic_start (const uint8_t* pins, size_t count, uint32_t rate,
+	hw_logic_trigger_t trigger, uint32_t trigger_mask, uint32_t trigger_value,
+	uint32_t pre, uint32_t post, int usb)
+{
+	if (logic.state == LOGIC_RUNNING) {
+		return -1;
+	}
+	if (count == 0 || count > HW_LOGIC_PINS_MAX || rate == 0 || rate > HW_LOGIC_RATE_MAX
+		|| post == 0 || pre + post > HW_LOGIC_DEPTH_MAX) {
+		return -1;
+	}
+
+	size_t i;
+	for (i = 0; i < count; i++) {
+		if (!hw_valid_pin(pins[i]) || g_APinDescription[pins[i]].portNum >= LOGIC_PORTS
+			|| g_APinDescription[pins[i]].portNum != g_APinDescription[pins[0]].portNum) {
+			return -1;
+		}
+	}
+
+	hw_logic_reset();
+	if (hw_timer_claim(LOGIC_TIMER_INDEX, HW_TIMER_LOGIC)) {
+		return -1;
+	}
+
+	// Trigger masks and values come in pin order; move them to port bits.
+	logic.port = g_APinDescription[pins[0]].portNum;
+	logic.count = count;
+	logic.trigger_mask = logic.trigger_value = 0;
+	for (i = 0; i < count; i++) {
+		hw_digital_input(pins[i]);
+		logic.bit[i] = 1u << g_APinDescription[pins[i]].bitNum;
+		if (trigger_mask & (1u << i)) {
+			logic.trigger_mask |= logic.bit[i];
+		}
+		if (trigger_value & (1u << i)) {
+			logic.trigger_value |= logic.bit[i];
+		}
+	}
+	logic.trigger = trigger_mask ? trigger : HW_LOGIC_TRIGGER_NONE;
+	logic.pre = logic.trigger == HW_LOGIC_TRIGGER_NONE ? 0 : pre;
+	logic.post = post;
+	logic.usb = usb;
+
+	// Room for the window, the chunk the capture overshoots by, and two
+	// chunks the DMA may be writing into by the time it is halted.
+	logic.chunks = (logic.pre + post + LOGIC_CHUNK - 1) / LOGIC_CHUNK + 3;
+	logic.ring = malloc(logic.chunks * LOGIC_CHUNK * sizeof(uint32_t));
+	logic.lli = malloc(logic.chunks * sizeof(hw_GPDMA_Linked_List_Type));
+	if (!logic.ring || !logic.lli) {
+		hw_logic_reset();
+		return -1;
+	}
+
+	uint32_t control = GPDMA_DMACCxControl_TransferSize(LOGIC_CHUNK)
+		| GPDMA_DMACCxControl_SBSize(GPDMA_BSIZE_1)
+		| GPDMA_DMACCxControl_DBSize(GPDMA_BSIZE_1)
+		| GPDMA_DMACCxControl_SWidth(GPDMA_WIDTH_WORD)
+		| GPDMA_DMACCxControl_DWidth(GPDMA_WIDTH_WORD)
+		| GPDMA_DMACCxControl_DI
+		| GPDMA_DMACCxControl_I;
+	for (i = 0; i < logic.chunks; i++) {
+		logic.lli[i].Source = (uint32_t) &LPC_GPIO_PORT->PIN[logic.port];
+		logic.lli[i].Destination = (uint32_t) &logic.ring[i * LOGIC_CHUNK];
+		logic.lli[i].NextLLI = (uint32_t) &logic.lli[(i + 1) % logic.chunks];
+		logic.lli[i].Control = control;
+	}
+
+	logic.rate = rate;
+	logic.done_chunks = 0;
+	logic.previous = LPC_GPIO_PORT->PIN[logic.port];
+	logic.trigger_index = logic.trigger == HW_LOGIC_TRIGGER_NONE ? 0 : -1;
+
+	hw_GPDMA_Chan_Config config = {
+		.SrcConn = MAT1_0_CONN,
+		.DestConn = 0,
+		.TransferType = p2m,
+	};
+	if (hw_gpdma_transfer_config(HW_LOGIC_DMA_CHANNEL, &config) != SUCCESS) {
+		hw_logic_reset();
+		return -1;
+	}
+
+	CGU_ConfigPWR(CGU_PERIPHERAL_TIMER1, ENABLE);
+	LOGIC_TIMER->TCR = (1<<1); // stop and reset counter
+	LOGIC_TIMER->PR = 0;
+	LOGIC_TIMER->MR[0] = CGU_GetPCLKFrequency(CGU_PERIPHERAL_TIMER1) / rate - 1;
+	LOGIC_TIMER->MCR = (1<<1); // reset on MR0
+	LOGIC_TIMER->IR = 0xFFFFFFFF; // drop any stale DMA request
+
+	logic.state = LOGIC_RUNNING;
+	tm_event_ref(&logic_event);
+	hw_gpdma_transfer_begin(HW_LOGIC_DMA_CHANNEL, &logic.lli[0]);
+	LOGIC_TIMER->TCR = (1<<0); // release reset and start
+	return 0;
+}
+
+// Stops a capture early; whatever has been captured is delivered as usual.
+void hw_logic_stop (void)
+{
+	if (logic.state != LOGIC_RUNNING) {
+		return;
+	}
+	__disable_irq();
+	logic_halt();
+	logic.state = LOGIC_DONE;
+	__enable_irq();
+	tm_event_trigger(&logic_event);
+}
+
+void hw_logic_reset (void)
+{
+	if (logic.state != LOGIC_IDLE) {
+		logic_halt();
+		tm_event_unref(&logic_event);
+	}
+	logic.state = LOGIC_IDLE;
+	hw_timer_release(LOGIC_TIMER_INDEX, HW_TIMER_LOGIC);
+	free(logic.ring);
+	free(logic.lli);
+	logic.ring = NULL;
+	logic.lli = NULL;
+}
+
+// Packs samples [start, end) into `out`, `width` bytes each with bit i of
+// each sample being pins[i].
+static void logic_pack (uint8_t* out, uint32_t start, uint32_t end, unsigned width)
+{
+	uint32_t depth = logic.chunks * LOGIC_CHUNK;
+	uint32_t s;
+	for (s = start; s < end; s++) {
+		uint32_t raw = logic.ring[s % depth];
+		uint32_t packed = 0;
+		unsigned i;
+		for (i = 0; i < logic.count; i++) {
+			if (raw & logic.bit[i]) {
+				packed |= 1u << i;
+			}
+		}
+		memcpy(out, &packed, width);
+		out += width;
+	}
+}
+
+// Emits "logic_complete" with an error flag, the samples as a buffer, the
+// trigger's offset in it (-1 if it never fired), the sample rate and the
+// bytes per sample. With the USB option the same is sent to the host as
+// an 'L' message: [rate][count][trigger offset][width] then the samples.
+static void logic_complete (tm_event* event)
+{
+	(void) event;
+	if (logic.state == LOGIC_RUNNING || logic.state == LOGIC_IDLE) {
+		return;
+	}
+
+	uint32_t end = logic.done_chunks * LOGIC_CHUNK;
+	uint32_t depth = logic.chunks * LOGIC_CHUNK;
+	// The two chunks after `end` may have overwritten the oldest samples.
+	uint32_t oldest = end + 2 * LOGIC_CHUNK > depth ? end + 2 * LOGIC_CHUNK - depth : 0;
+	int32_t trigger = logic.trigger_index;
+	uint32_t start;
+	if (trigger >= 0) {
+		start = (uint32_t) trigger > logic.pre ? trigger - logic.pre : 0;
+		if ((uint32_t) trigger + logic.post < end) {
+			end = trigger + logic.post;
+		}
+	} else {
+		start = end > logic.pre + logic.post ? end - logic.pre - logic.post : 0;
+	}
+	if (start < oldest) {
+		start = oldest;
+	}
+	int32_t trigger_offset = trigger >= 0 && (uint32_t) trigger >= start ? (int32_t) (trigger - start) : -1;
+	uint32_t count = end > start ? end - start : 0;
+	unsigned width = logic.count <= 8 ? 1 : logic.count <= 16 ? 2 : 4;
+	int error = logic.state == LOGIC_ERROR;
+
+	if (logic.usb) {
+		size_t size = 4 * sizeof(uint32_t) + count * width;
+		uint8_t* msg = malloc(size);
+		if (msg) {
+			uint32_t header[4] = { logic.rate, count, (uint32_t) trigger_offset, width };
+			memcpy(msg, header, sizeof(header));
+			logic_pack(msg + sizeof(header), start, end, width);
+			hw_send_usb_msg('L', msg, size);
+			free(msg);
+		}
+	}
+
+	lua_State* L = tm_lua_state;
+	if (L) {
+		lua_getglobal(L, "_colony_emit");
+		lua_pushstring(L, "logic_complete");
+		lua_pushboolean(L, error);
+		uint8_t* out = colony_createbuffer(L, count * width);
+		logic_pack(out, start, end, width);
+		lua_pushnumber(L, trigger_offset);
+		lua_pushnumber(L, logic.rate);
+		lua_pushnumber(L, width);
+		tm_checked_call(L, 6);
+	}
+
+	// The capture was copied out; give the memory back.
+	hw_logic_reset();
+}
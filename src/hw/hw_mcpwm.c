@@ -0,0 +1,211 @@
+// Copyright 2014 Technical Machine, Inc. See the COPYRIGHT
+// file at the top-level directory of this distribution.
+//
+// Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+// http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+// <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+// option. This file may not be copied, modified, or distributed
+// except according to those terms.
+
+// Motor control PWM. Three channels each drive an A output and, with a dead
+// time between them, its complementary B output, for the high and low side
+// of a half bridge. Center-aligned channels count up then down so pulses sit
+// in the middle of the period. In AC mode all three channels run off channel
+// 0's timer, switching a three-phase bridge in step; in DC mode channel 0
+// alone drives whichever outputs the commutation pattern selects, for
+// brushless DC motors. The MCPWM runs off the 180MHz core clock.
+
+#include "hw.h"
+#include "variant.h"
+#include "LPC18xx.h"
+#include "lpc18xx_mcpwm.h"
+
+#define MCPWM_DEADTIME_MAX 0x3FF
+
+// pads carrying an MCPWM output; `output` is channel * 2, plus 1 for MCOB
+static const struct {
+  uint8_t port;
+  uint8_t pin;
+  uint8_t func;
+  uint8_t output;
+} mcpwm_pads[] = {
+  { 0x4, 0, FUNC1, 0 }, // MCOA0
+  { 0x9, 3, FUNC1, 0 }, // MCOA0
+  { 0x5, 4, FUNC1, 1 }, // MCOB0
+  { 0x9, 4, FUNC1, 1 }, // MCOB0
+  { 0x5, 5, FUNC1, 2 }, // MCOA1
+  { 0x9, 5, FUNC1, 2 }, // MCOA1
+  { 0x5, 6, FUNC1, 3 }, // MCOB1
+  { 0x9, 6, FUNC1, 3 }, // MCOB1
+  { 0x5, 7, FUNC1, 4 }, // MCOA2
+  { 0x9, 1, FUNC1, 4 }, // MCOA2
+  { 0x5, 0, FUNC1, 5 }, // MCOB2
+  { 0x9, 2, FUNC1, 5 }, // MCOB2
+};
+
+#define MCPWM_PADS (sizeof(mcpwm_pads) / sizeof(mcpwm_pads[0]))
+
+static struct {
+  int running;
+  int flags;
+  uint32_t period;
+  uint32_t pulsewidths[HW_MCPWM_CHANNELS];
+  // board pin routed to each output, or -1
+  int pins[HW_MCPWM_CHANNELS * 2];
+} mcpwm = {
+  .pins = { [0 ... HW_MCPWM_CHANNELS * 2 - 1] = -1 },
+};
+
+
+// Returns the pad index for `pin`, or -1 if it carries no MCPWM output
+static int mcpwm_pad (uint8_t pin)
+{
+  if (!hw_valid_pin(pin)) {
+    return -1;
+  }
+  size_t i;
+  for (i = 0; i < MCPWM_PADS; i++) {
+    if (g_APinDescription[pin].port == mcpwm_pads[i].port
+      && g_APinDescription[pin].pin == mcpwm_pads[i].pin) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+
+// Limit and match values for a pulse width: the output goes active once
+// the timer passes the match, so the match sits a pulse width before the
+// end of the period (or, counting up and down, half of one each way).
+static void mcpwm_channel_values (uint32_t pulsewidth, uint32_t* limit, uint32_t* match)
+{
+  if (pulsewidth > mcpwm.period) {
+    pulsewidth = mcpwm.period;
+  }
+  if (mcpwm.flags & HW_MCPWM_CENTER) {
+    *limit = mcpwm.period / 2;
+    *match = (mcpwm.period - pulsewidth) / 2;
+  } else {
+    *limit = mcpwm.period - 1;
+    *match = mcpwm.period - pulsewidth;
+  }
+}
+
+
+// Routes `count` pins to their outputs and starts all three channels with
+// a `period` and `deadtime` (at most 1023) in core clocks and HW_MCPWM_*
+// `flags`. Pulse widths set beforehand carry over. Returns -1 for a pin
+// without an MCPWM output, two pins on one output or bad timing.
+int hw_mcpwm_start (const uint8_t* pins, size_t count, uint32_t period, uint32_t deadtime, int flags)
+{
+  if (period < 2 || deadtime > MCPWM_DEADTIME_MAX
+    || ((flags & HW_MCPWM_AC) && (flags & HW_MCPWM_DC))) {
+    return -1;
+  }
+
+  int pads[HW_MCPWM_CHANNELS * 2];
+  size_t i, j;
+  if (count > HW_MCPWM_CHANNELS * 2) {
+    return -1;
+  }
+  for (i = 0; i < count; i++) {
+    pads[i] = mcpwm_pad(pins[i]);
+    if (pads[i] < 0) {
+      return -1;
+    }
+    for (j = 0; j < i; j++) {
+      if (mcpwm_pads[pads[j]].output == mcpwm_pads[pads[i]].output) {
+        return -1;
+      }
+    }
+  }
+
+  hw_mcpwm_stop();
+
+  mcpwm.period = period;
+  mcpwm.flags = flags;
+
+  MCPWM_Init(LPC_MCPWM);
+  int channel;
+  for (channel = 0; channel < HW_MCPWM_CHANNELS; channel++) {
+    MCPWM_CHANNEL_CFG_Type config = {
+      .channelType = flags & HW_MCPWM_CENTER ? MCPWM_CHANNEL_CENTER_MODE : MCPWM_CHANNEL_EDGE_MODE,
+      .channelPolarity = flags & HW_MCPWM_ACTIVE_LOW ? MCPWM_CHANNEL_PASSIVE_HI : MCPWM_CHANNEL_PASSIVE_LO,
+      .channelDeadtimeEnable = deadtime ? ENABLE : DISABLE,
+      .channelDeadtimeValue = deadtime,
+      .channelUpdateEnable = ENABLE,
+      .channelTimercounterValue = 0,
+    };
+    mcpwm_channel_values(mcpwm.pulsewidths[channel], &config.channelPeriodValue, &config.channelPulsewidthValue);
+    MCPWM_ConfigChannel(LPC_MCPWM, channel, &config);
+  }
+  MCPWM_ACMode(LPC_MCPWM, flags & HW_MCPWM_AC ? ENABLE : DISABLE);
+  // DC mode drives no outputs until the first commutation
+  MCPWM_DCMode(LPC_MCPWM, flags & HW_MCPWM_DC ? ENABLE : DISABLE, DISABLE, 0);
+
+  for (i = 0; i < count; i++) {
+    scu_pinmux(mcpwm_pads[pads[i]].port, mcpwm_pads[pads[i]].pin, MD_PLN_FAST, mcpwm_pads[pads[i]].func);
+    mcpwm.pins[mcpwm_pads[pads[i]].output] = pins[i];
+  }
+
+  MCPWM_Start(LPC_MCPWM, ENABLE, flags & HW_MCPWM_DC ? DISABLE : ENABLE, flags & HW_MCPWM_DC ? DISABLE : ENABLE);
+  mcpwm.running = 1;
+  return 0;
+}
+
+
+// Sets a channel's pulse width in core clocks, taking effect at the end of
+// the current period. In AC and DC mode channel 0's period applies to all.
+int hw_mcpwm_pulsewidth (int channel, uint32_t pulsewidth)
+{
+  if (channel < 0 || channel >= HW_MCPWM_CHANNELS) {
+    return -1;
+  }
+  mcpwm.pulsewidths[channel] = pulsewidth;
+  if (mcpwm.running) {
+    MCPWM_CHANNEL_CFG_Type config;
+    mcpwm_channel_values(pulsewidth, &config.channelPeriodValue, &config.channelPulsewidthValue);
+    MCPWM_WriteToShadow(LPC_MCPWM, channel, &config);
+  }
+  return 0;
+}
+
+
+// In DC mode, selects the outputs channel 0 drives: bit 0 for MCOA0, 1 for
+// MCOB0, 2 for MCOA1 and so on. The others stay passive.
+int hw_mcpwm_commutate (uint32_t pattern)
+{
+  if (!mcpwm.running || !(mcpwm.flags & HW_MCPWM_DC) || pattern > 0x3F) {
+    return -1;
+  }
+  LPC_MCPWM->CCP = pattern;
+  return 0;
+}
+
+
+// Halts the channels and hands the pins back as GPIO inputs, leaving the
+// bridge to its own pulls
+void hw_mcpwm_stop (void)
+{
+  if (mcpwm.running) {
+    MCPWM_Stop(LPC_MCPWM, ENABLE, ENABLE, ENABLE);
+    mcpwm.running = 0;
+  }
+  int i;
+  for (i = 0; i < HW_MCPWM_CHANNELS * 2; i++) {
+    if (mcpwm.pins[i] >= 0) {
+      hw_digital_startup(mcpwm.pins[i]);
+      mcpwm.pins[i] = -1;
+    }
+  }
+}
+
+
+void hw_mcpwm_reset (void)
+{
+  hw_mcpwm_stop();
+  int channel;
+  for (channel = 0; channel < HW_MCPWM_CHANNELS; channel++) {
+    mcpwm.pulsewidths[channel] = 0;
+  }
+}
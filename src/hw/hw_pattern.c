@@ -0,0 +1,318 @@
+// Copyright 2014 Technical Machine, Inc. See the COPYRIGHT
+// file at the top-level directory of this distribution.
+//
+// Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+// http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+// <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+// option. This file may not be copied, modified, or distributed
+// except according to those terms.
+
+// Pattern generator. A pattern is compiled into a SET word and a CLR word
+// per step for one GPIO port, and two GPDMA channels copy them to the
+// port's SET and CLR registers. Both are paced by TIMER2: MR0 and MR1 hold
+// the same value, so the MAT2.0 and MAT2.1 requests fire together once per
+// step and the pins change with no CPU involvement or jitter. The logic
+// analyzer has TIMER1, so captures can run alongside playback; TIMER2 is
+// claimed from the PC sampler for the length of playback, so the two don't
+// run at once.
+//
+// Segments are [first step][steps][repeat] ranges of the compiled steps;
+// each becomes linked list items (repeats point at the same words), so
+// patterns chain without copying. Looped playback links the last item back
+// to the first.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "LPC18xx.h"
+#include "lpc18xx_cgu.h"
+#include "lpc18xx_gpdma.h"
+#include "variant.h"
+#include "tm.h"
+#include "colony.h"
+#include "hw.h"
+
+#define PATTERN_TIMER LPC_TIMER2
+#define PATTERN_TIMER_INDEX 2
+#define PATTERN_CHUNK 4095 // largest GPDMA transfer size
+#define PATTERN_PORTS 8
+
+typedef enum {
+	PATTERN_IDLE,
+	PATTERN_RUNNING,
+	PATTERN_DONE,
+	PATTERN_ERROR
+} pattern_state_t;
+
+static struct {
+	volatile pattern_state_t state;
+	uint32_t* set;
+	uint32_t* clr;
+	hw_GPDMA_Linked_List_Type* set_lli;
+	hw_GPDMA_Linked_List_Type* clr_lli;
+} pattern;
+
+static void pattern_complete (tm_event* event);
+static tm_event pattern_event = TM_EVENT_INIT(pattern_complete);
+
+static void pattern_halt (void)
+{
+	PATTERN_TIMER->TCR = 0;
+	hw_gpdma_cancel_transfer(HW_PATTERN_SET_DMA_CHANNEL);
+	hw_gpdma_cancel_transfer(HW_PATTERN_CLR_DMA_CHANNEL);
+	hw_timer_release(PATTERN_TIMER_INDEX, HW_TIMER_PATTERN);
+}
+
+static void pattern_finish (pattern_state_t state)
+{
+	pattern_halt();
+	pattern.state = state;
+	tm_event_trigger(&pattern_event);
+}
+
+// Called from DMA_IRQHandler.
+void hw_pattern_dma_irq (void)
+{
+	if (GPDMA_IntGetStatus(GPDMA_STAT_INTERR, HW_PATTERN_SET_DMA_CHANNEL)
+		|| GPDMA_IntGetStatus(GPDMA_STAT_INTERR, HW_PATTERN_CLR_DMA_CHANNEL)) {
+		GPDMA_ClearIntPending(GPDMA_STATCLR_INTERR, HW_PATTERN_SET_DMA_CHANNEL);
+		GPDMA_ClearIntPending(GPDMA_STATCLR_INTERR, HW_PATTERN_CLR_DMA_CHANNEL);
+		if (pattern.state == PATTERN_RUNNING) {
+			pattern_finish(PATTERN_ERROR);
+		}
+		return;
+	}
+
+	// Only the last CLR item interrupts, once the final step is out.
+	if (!GPDMA_IntGetStatus(GPDMA_STAT_INTTC, HW_PATTERN_CLR_DMA_CHANNEL)) {
+		return;
+	}
+	GPDMA_ClearIntPending(GPDMA_STATCLR_INTTC, HW_PATTERN_CLR_DMA_CHANNEL);
+	if (pattern.state == PATTERN_RUNNING) {
+		pattern_finish(PATTERN_DONE);
+	}
+}
+
+typedef struct {
+	uint32_t first;
+	uint32_t length;
+	uint32_t repeat;
+} pattern_segment_t;
+
+// Reads segment `index`, or the whole pattern once if none were given.
+static pattern_segment_t pattern_segment (const uint8_t* segments, size_t segment_count, size_t index, uint32_t steps)
+{
+	pattern_segment_t segment = { 0, steps, 1 };
+	if (segment_count) {
+		memcpy(&segment, &segments[index * sizeof(segment)], sizeof(segment));
+	}
+	return segment;
+}
+
+// Links `steps` words from `words` to `reg`, one item per chunk, and
+// returns the next free item.
+static hw_GPDMA_Linked_List_Type* pattern_link (hw_GPDMA_Linked_List_Type* lli,
+	const uint32_t* words, uint32_t steps, volatile uint32_t* reg)
+{
+	while (steps > 0) {
+		uint32_t size = steps < PATTERN_CHUNK ? steps : PATTERN_CHUNK;
+		lli->Source = (uint32_t) words;
+		lli->Destination = (uint32_t) reg;
+		lli->NextLLI = (uint32_t) (lli + 1);
+		lli->Control = GPDMA_DMACCxControl_TransferSize(size)
+			| GPDMA_DMACCxControl_SBSize(GPDMA_BSIZE_1)
+			| GPDMA_DMACCxControl_DBSize(GPDMA_BSIZE_1)
+			| GPDMA_DMACCxControl_SWidth(GPDMA_WIDTH_WORD)
+			| GPDMA_DMACCxControl_DWidth(GPDMA_WIDTH_WORD)
+			| GPDMA_DMACCxControl_SI;
+		words += size;
+		steps -= size;
+		lli++;
+	}
+	return lli;
+}
+
+// Plays `data` on `pins`, which must share a GPIO port, at `rate` steps per
+// second. Each step is 1, 2 or 4 bytes (by pin count, as logic captures
+// are) with bit i for pins[i]. `segments` holds [first step][steps][repeat]
+// uint32 triples played in order; without any, the whole pattern plays
+// once. With `loop` the sequence repeats until stopped.
+int hw_pattern_start (const uint8_t* pins, size_t count, uint32_t rate,
+	const uint8_t* data, size_t data_len, const uint8_t* segments, size_t segments_len, int loop)
+{
+	if (pattern.state == PATTERN_RUNNING) {
+		return -1;
+	}
+	if (count == 0 || count > HW_PATTERN_PINS_MAX || rate == 0 || rate > HW_PATTERN_RATE_MAX) {
+		return -1;
+	}
+
+	size_t i;
+	for (i = 0; i < count; i++) {
+		if (!hw_valid_pin(pins[i]) || g_APinDescription[pins[i]].portNum >= PATTERN_PORTS
+			|| g_APinDescription[pins[i]].portNum != g_APinDescription[pins[0]].portNum) {
+			return -1;
+		}
+	}
+
+	unsigned width = count <= 8 ? 1 : count <= 16 ? 2 : 4;
+	uint32_t steps = data_len / width;
+	if (steps == 0 || segments_len % sizeof(pattern_segment_t) != 0) {
+		return -1;
+	}
+
+	// Validate the segments and count the items they need.
+	size_t segment_count = segments_len / sizeof(pattern_segment_t);
+	size_t sequence = segment_count ? segment_count : 1;
+	uint32_t items = 0;
+	for (i = 0; i < sequence; i++) {
+		pattern_segment_t segment = pattern_segment(segments, segment_count, i, steps);
+		if (segment.length == 0 || segment.first >= steps || segment.length > steps - segment.first) {
+			return -1;
+		}
+		uint32_t chunks = (segment.length + PATTERN_CHUNK - 1) / PATTERN_CHUNK;
+		if (segment.repeat > HW_PATTERN_LLI_MAX || chunks * segment.repeat > HW_PATTERN_LLI_MAX - items) {
+			return -1;
+		}
+		items += chunks * segment.repeat;
+	}
+	if (items == 0) {
+		return -1;
+	}
+
+	hw_pattern_reset();
+	if (hw_timer_claim(PATTERN_TIMER_INDEX, HW_TIMER_PATTERN)) {
+		return -1;
+	}
+
+	pattern.set = malloc(steps * sizeof(uint32_t));
+	pattern.clr = malloc(steps * sizeof(uint32_t));
+	pattern.set_lli = malloc(items * sizeof(hw_GPDMA_Linked_List_Type));
+	pattern.clr_lli = malloc(items * sizeof(hw_GPDMA_Linked_List_Type));
+	if (!pattern.set || !pattern.clr || !pattern.set_lli || !pattern.clr_lli) {
+		hw_pattern_reset();
+		return -1;
+	}
+
+	// Compile steps from pin order to port SET and CLR words.
+	uint8_t port = g_APinDescription[pins[0]].portNum;
+	uint32_t bit[HW_PATTERN_PINS_MAX];
+	for (i = 0; i < count; i++) {
+		bit[i] = 1u << g_APinDescription[pins[i]].bitNum;
+		hw_digital_output(pins[i]);
+	}
+	uint32_t s;
+	for (s = 0; s < steps; s++) {
+		uint32_t levels = 0;
+		memcpy(&levels, &data[s * width], width);
+		uint32_t set = 0, clr = 0;
+		for (i = 0; i < count; i++) {
+			if (levels & (1u << i)) {
+				set |= bit[i];
+			} else {
+				clr |= bit[i];
+			}
+		}
+		pattern.set[s] = set;
+		pattern.clr[s] = clr;
+	}
+
+	hw_GPDMA_Linked_List_Type* set_lli = pattern.set_lli;
+	hw_GPDMA_Linked_List_Type* clr_lli = pattern.clr_lli;
+	for (i = 0; i < sequence; i++) {
+		pattern_segment_t segment = pattern_segment(segments, segment_count, i, steps);
+		while (segment.repeat--) {
+			set_lli = pattern_link(set_lli, &pattern.set[segment.first], segment.length, &LPC_GPIO_PORT->SET[port]);
+			clr_lli = pattern_link(clr_lli, &pattern.clr[segment.first], segment.length, &LPC_GPIO_PORT->CLR[port]);
+		}
+	}
+
+	hw_GPDMA_Linked_List_Type* set_last = &pattern.set_lli[items - 1];
+	hw_GPDMA_Linked_List_Type* clr_last = &pattern.clr_lli[items - 1];
+	if (loop) {
+		set_last->NextLLI = (uint32_t) pattern.set_lli;
+		clr_last->NextLLI = (uint32_t) pattern.clr_lli;
+	} else {
+		set_last->NextLLI = 0;
+		clr_last->NextLLI = 0;
+		clr_last->Control |= GPDMA_DMACCxControl_I;
+	}
+
+	hw_GPDMA_Chan_Config set_config = {
+		.SrcConn = 0,
+		.DestConn = MAT2_0_CONN,
+		.TransferType = m2p,
+	};
+	hw_GPDMA_Chan_Config clr_config = {
+		.SrcConn = 0,
+		.DestConn = MAT2_1_CONN,
+		.TransferType = m2p,
+	};
+	if (hw_gpdma_transfer_config(HW_PATTERN_SET_DMA_CHANNEL, &set_config) != SUCCESS
+		|| hw_gpdma_transfer_config(HW_PATTERN_CLR_DMA_CHANNEL, &clr_config) != SUCCESS) {
+		hw_pattern_reset();
+		return -1;
+	}
+
+	CGU_ConfigPWR(CGU_PERIPHERAL_TIMER2, ENABLE);
+	PATTERN_TIMER->TCR = (1<<1); // stop and reset counter
+	PATTERN_TIMER->PR = 0;
+	PATTERN_TIMER->MR[0] = CGU_GetPCLKFrequency(CGU_PERIPHERAL_TIMER2) / rate - 1;
+	PATTERN_TIMER->MR[1] = PATTERN_TIMER->MR[0];
+	PATTERN_TIMER->MCR = (1<<1); // reset on MR0
+	PATTERN_TIMER->IR = 0xFFFFFFFF; // drop any stale DMA requests
+
+	pattern.state = PATTERN_RUNNING;
+	tm_event_ref(&pattern_event);
+	hw_gpdma_transfer_begin(HW_PATTERN_SET_DMA_CHANNEL, pattern.set_lli);
+	hw_gpdma_transfer_begin(HW_PATTERN_CLR_DMA_CHANNEL, pattern.clr_lli);
+	PATTERN_TIMER->TCR = (1<<0); // release reset and start
+	return 0;
+}
+
+// Stops playback after the current step; completion is reported as usual.
+void hw_pattern_stop (void)
+{
+	if (pattern.state != PATTERN_RUNNING) {
+		return;
+	}
+	__disable_irq();
+	pattern_finish(PATTERN_DONE);
+	__enable_irq();
+}
+
+void hw_pattern_reset (void)
+{
+	if (pattern.state != PATTERN_IDLE) {
+		pattern_halt();
+		tm_event_unref(&pattern_event);
+	}
+	pattern.state = PATTERN_IDLE;
+	hw_timer_release(PATTERN_TIMER_INDEX, HW_TIMER_PATTERN);
+	free(pattern.set);
+	free(pattern.clr);
+	free(pattern.set_lli);
+	free(pattern.clr_lli);
+	pattern.set = pattern.clr = NULL;
+	pattern.set_lli = pattern.clr_lli = NULL;
+}
+
+// Emits "pattern_complete" with an error flag once playback ends or is
+// stopped, then frees the pattern.
+static void pattern_complete (tm_event* event)
+{
+	(void) event;
+	if (pattern.state == PATTERN_RUNNING || pattern.state == PATTERN_IDLE) {
+		return;
+	}
+	int error = pattern.state == PATTERN_ERROR;
+	hw_pattern_reset();
+
+	lua_State* L = tm_lua_state;
+	if (!L) return;
+
+	lua_getglobal(L, "_colony_emit");
+	lua_pushstring(L, "pattern_complete");
+	lua_pushboolean(L, error);
+	tm_checked_call(L, 2);
+}
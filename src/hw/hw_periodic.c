@@ -0,0 +1,117 @@
+// Copyright 2014 Technical Machine, Inc. See the COPYRIGHT
+// file at the top-level directory of this distribution.
+//
+// Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+// http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+// <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+// option. This file may not be copied, modified, or distributed
+// except according to those terms.
+
+// Periodic callbacks on a hashed timing wheel driven by SysTick. Each tick
+// only visits the slot that is due, entries are inserted and cancelled in
+// O(1), and SysTick is stopped whenever nothing is scheduled.
+
+#include "hw.h"
+#include "linker.h"
+#include "LPC18xx.h"
+#include "lpc18xx_cgu.h"
+
+#define WHEEL_SLOTS 256
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+
+static hw_periodic_t* wheel[WHEEL_SLOTS];
+static uint32_t wheel_now = 0;
+static uint32_t wheel_count = 0;
+
+// Link an entry so that it fires `ticks` ticks from now. IRQs must be off.
+_ramfunc static void wheel_insert (hw_periodic_t* periodic, uint32_t ticks)
+{
+	hw_periodic_t** slot = &wheel[(wheel_now + ticks) & WHEEL_MASK];
+	periodic->rounds = (ticks - 1) / WHEEL_SLOTS;
+	periodic->next = *slot;
+	if (periodic->next) {
+		periodic->next->pprev = &periodic->next;
+	}
+	periodic->pprev = slot;
+	*slot = periodic;
+}
+
+_ramfunc static void wheel_remove (hw_periodic_t* periodic)
+{
+	*periodic->pprev = periodic->next;
+	if (periodic->next) {
+		periodic->next->pprev = periodic->pprev;
+	}
+	periodic->next = NULL;
+	periodic->pprev = NULL;
+}
+
+void hw_periodic_start (hw_periodic_t* periodic, uint32_t period_ms, void (*callback)(hw_periodic_t* periodic))
+{
+	if (period_ms == 0) {
+		period_ms = 1;
+	}
+
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	if (periodic->pprev) {
+		wheel_remove(periodic);
+		wheel_count--;
+	}
+	periodic->period = period_ms / HW_PERIODIC_TICK_MS;
+	if (periodic->period == 0) {
+		periodic->period = 1;
+	}
+	periodic->count = 0;
+	periodic->callback = callback;
+	wheel_insert(periodic, periodic->period);
+
+	if (wheel_count++ == 0) {
+		NVIC_SetPriority(SysTick_IRQn, ((0x02<<3)|0x01));
+		SysTick_Config(CGU_GetPCLKFrequency(CGU_PERIPHERAL_M3CORE) / (1000 / HW_PERIODIC_TICK_MS));
+	}
+	__set_PRIMASK(primask);
+}
+
+void hw_periodic_cancel (hw_periodic_t* periodic)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	if (periodic->pprev) {
+		wheel_remove(periodic);
+		if (--wheel_count == 0) {
+			SysTick->CTRL = 0;
+		}
+	}
+	__set_PRIMASK(primask);
+}
+
+_ramfunc void SysTick_Handler (void)
+{
+	wheel_now++;
+
+	// Detach the due slot so callbacks can restart or cancel freely.
+	hw_periodic_t* periodic = wheel[wheel_now & WHEEL_MASK];
+	wheel[wheel_now & WHEEL_MASK] = NULL;
+	if (periodic) {
+		periodic->pprev = &periodic;
+	}
+
+	while (periodic) {
+		hw_periodic_t* entry = periodic;
+		wheel_remove(entry);
+
+		if (entry->rounds > 0) {
+			// Not due for another revolution
+			uint32_t rounds = entry->rounds;
+			wheel_insert(entry, WHEEL_SLOTS);
+			entry->rounds = rounds - 1;
+			continue;
+		}
+
+		// Reschedule before calling so the callback may cancel itself.
+		wheel_insert(entry, entry->period);
+		entry->count++;
+		entry->callback(entry);
+	}
+}
@@ -8,68 +8,500 @@
 // except according to those terms.
 
 #include "hw.h"
+#include "tm.h"
+#include "colony.h"
 #include "variant.h"
 #include "LPC18xx.h"
 #include "lpc18xx_sct.h"
+#include "lpc18xx_gpdma.h"
+
+// PWM runs in up to two period groups, one per SCT counter half: group 0 on
+// the L counter and group 1 on the H counter, when NeoPixels or pulse
+// capture don't hold it. Each group reserves a period event and match
+// register, then each pin an event, match register and output on its
+// group's half. The halves are 16 bits, so longer periods are prescaled and
+// pulse widths scaled to match. Periods too long even prescaled run group 0
+// on the whole SCT as one 32 bit counter, when nothing else holds any of it.
+//
+// A sequence plays a buffer of pulse widths on one pin, one per period: a
+// GPDMA channel fed by the group's period event writes each into the pin's
+// match reload register, which the SCT loads at the next period.
 
-#define SCT_CONFIG_UNIFY (1 << 0)
-#define SCT_CTRL_HALT (1 << 2)
-#define SCT_CTRL_CLEAR (1 << 3)
 #define SCT_EVENT_CTRL_MATCH(x) (x << 0)
+#define SCT_EVENT_CTRL_HEVENT (1 << 4)
 #define SCT_EVENT_CTRL_MATCH_ONLY (1 << 12)
 
-int hw_pwm_port_period (uint32_t period)
+#define PWM_DMA_CHUNK 4095 // largest GPDMA transfer size
+
+static hw_sct_owner_t pwm_sct = { .user = SCT_PWM };
+
+// per counter half, with `event` -1 while stopped
+static struct {
+  int8_t event;
+  int8_t reg;
+  uint32_t prescale;
+} pwm_groups[2] = {
+  [0 ... 1] = { .event = -1, .reg = -1, .prescale = 1 },
+};
+
+// group 0 holds the whole SCT, unified
+static int pwm_unified;
+
+// per output, with `event` -1 while unused
+static struct {
+  int8_t event;
+  int8_t reg;
+  int8_t group;
+  uint8_t pin;
+  uint32_t pulsewidth;
+} pwm_outputs[HW_SCT_OUTPUTS] = {
+  [0 ... HW_SCT_OUTPUTS - 1] = { .event = -1, .reg = -1 },
+};
+
+// the playing sequence, with `channel` -1 while there's none
+static struct {
+  int channel;
+  int dma;
+  int repeat;
+  volatile int done;
+  volatile int error;
+  uint16_t* values;
+  hw_GPDMA_Linked_List_Type* lli;
+} pwm_sequence = { .channel = -1, .dma = -1 };
+
+static void pwm_sequence_complete (tm_event* event);
+static tm_event pwm_sequence_event = TM_EVENT_INIT(pwm_sequence_complete);
+
+
+static uint32_t pwm_ticks (int group, uint32_t pulsewidth)
+{
+  uint32_t ticks = pulsewidth / pwm_groups[group].prescale;
+  return ticks > 0xFFFF && !pwm_unified ? 0xFFFF : ticks;
+}
+
+
+static void pwm_match (int group, int reg, uint32_t ticks)
+{
+  if (pwm_unified) {
+    hw_sct_match_unified(reg, ticks);
+  } else {
+    hw_sct_match(group, reg, ticks);
+  }
+}
+
+
+static void pwm_output_update (int channel)
+{
+  int group = pwm_outputs[channel].group;
+  pwm_match(group, pwm_outputs[channel].reg, pwm_ticks(group, pwm_outputs[channel].pulsewidth));
+}
+
+
+// Stops an output driving PWM, keeping its pin and group
+static void pwm_output_stop (int channel)
+{
+  if (pwm_sequence.channel == channel) {
+    hw_pwm_sequence_stop();
+  }
+  LPC_SCT->OUT[channel].SET = 0;
+  LPC_SCT->OUT[channel].CLR = 0;
+  hw_sct_free_event(&pwm_sct, pwm_outputs[channel].event);
+  hw_sct_free_reg(&pwm_sct, pwm_outputs[channel].group, pwm_outputs[channel].reg);
+  pwm_outputs[channel].event = -1;
+  pwm_outputs[channel].reg = -1;
+}
+
+
+// Stops a group and its outputs, handing back its counter half
+static void pwm_group_stop (int group)
+{
+  int channel;
+  for (channel = 0; channel < HW_SCT_OUTPUTS; channel++) {
+    if (pwm_outputs[channel].event >= 0 && pwm_outputs[channel].group == group) {
+      pwm_output_stop(channel);
+    }
+  }
+  // Also undoes a claim whose event or register ran out
+  hw_sct_free_event(&pwm_sct, pwm_groups[group].event);
+  hw_sct_free_reg(&pwm_sct, group, pwm_groups[group].reg);
+  pwm_groups[group].event = -1;
+  pwm_groups[group].reg = -1;
+  hw_sct_release_counter(&pwm_sct, group);
+
+  // Nothing left, so let the outputs go too. Pins keep their groups until
+  // hw_pwm_reset.
+  if (pwm_groups[!group].event < 0) {
+    hw_sct_release(&pwm_sct);
+    pwm_unified = 0;
+  }
+}
+
+
+// Sets the period of group HW_SCT_L or HW_SCT_H. Returns 0, -1 for a bad
+// group or a period too long for group 1, or the SCT's user if the group's
+// counter half (or for long periods the whole SCT) or its events are taken.
+// A zero period stops the group.
+int hw_pwm_group_period (int group, uint32_t period)
 {
-  // Halt the SCT
-  LPC_SCT->CTRL_H = SCT_CTRL_HALT;
-  LPC_SCT->CTRL_L = SCT_CTRL_HALT;
+  if (group != HW_SCT_L && group != HW_SCT_H) {
+    return -1;
+  }
+  if (period == 0) {
+    pwm_group_stop(group);
+    return 0;
+  }
+  int unified = period > HW_PWM_GROUP_PERIOD_MAX;
+  if (unified && group != HW_SCT_L) {
+    return -1;
+  }
+  if ((unified || pwm_unified) && pwm_groups[!group].event >= 0) {
+    return SCT_PWM; // the other group holds the H counter, or needs it
+  }
+
+  // Moving between a half and the whole SCT starts over, bringing back the
+  // pins that were running
+  uint32_t restart = 0;
+  int channel;
+  if (pwm_groups[group].event >= 0 && unified != pwm_unified) {
+    for (channel = 0; channel < HW_SCT_OUTPUTS; channel++) {
+      if (pwm_outputs[channel].event >= 0 && pwm_outputs[channel].group == group) {
+        restart |= (1 << channel);
+      }
+    }
+    pwm_group_stop(group);
+  }
 
-  LPC_SCT->CONFIG = SCT_CONFIG_UNIFY; // 32bit, Clocked from peripheral clock
-  LPC_SCT->REGMODE_L = 0;             // All registers are match registers
+  if (pwm_groups[group].event < 0) {
+    int status = unified ? hw_sct_claim_unified(&pwm_sct) : hw_sct_claim_counter(&pwm_sct, group);
+    if (status) {
+      return status;
+    }
+    pwm_unified = unified;
+    pwm_groups[group].event = hw_sct_alloc_event(&pwm_sct);
+    pwm_groups[group].reg = hw_sct_alloc_reg(&pwm_sct, group, 0);
+    if (pwm_groups[group].event < 0 || pwm_groups[group].reg < 0) {
+      status = hw_sct_busy(&pwm_sct);
+      pwm_group_stop(group);
+      return status;
+    }
+  }
+
+  // A sequence's pulse widths were scaled for the old period
+  if (pwm_sequence.channel >= 0 && pwm_outputs[pwm_sequence.channel].group == group) {
+    hw_pwm_sequence_stop();
+  }
 
-  // Event 0 at counter period
-  LPC_SCT->EVENT[0].CTRL = SCT_EVENT_CTRL_MATCH(0) | SCT_EVENT_CTRL_MATCH_ONLY; // match register 0, match condition only, no state change
-  LPC_SCT->EVENT[0].STATE = (1 << 0); // in state 0
-  LPC_SCT->MATCH[0].U = period;
-  LPC_SCT->MATCHREL[0].U = period;
+  // Halt the counter
+  uint32_t prescale = pwm_unified ? 1 : (period + 0xFFFF) / 0x10000;
+  pwm_groups[group].prescale = prescale;
+  hw_sct_counter(group, prescale, 0);
 
-  // Event 0 resets the counter
-  LPC_SCT->LIMIT_L = (1 << 0);
+  // Event at counter period
+  int event = pwm_groups[group].event;
+  LPC_SCT->EVENT[event].CTRL = SCT_EVENT_CTRL_MATCH(pwm_groups[group].reg) | SCT_EVENT_CTRL_MATCH_ONLY
+    | (group == HW_SCT_H ? SCT_EVENT_CTRL_HEVENT : 0); // match condition only, no state change
+  LPC_SCT->EVENT[event].STATE = (1 << 0); // in state 0
+  pwm_match(group, pwm_groups[group].reg, period / prescale - 1);
 
-  // Start in state 0
-  LPC_SCT->STATE_L = 0;
+  // The period event resets the counter, which starts in state 0
+  if (group == HW_SCT_H) {
+    LPC_SCT->LIMIT_H = (1 << event);
+    LPC_SCT->STATE_H = 0;
+  } else {
+    LPC_SCT->LIMIT_L = (1 << event);
+    LPC_SCT->STATE_L = 0;
+  }
 
-  if (period != 0) {
-    // Clear the counter and un-halt the SCT;
-    LPC_SCT->CTRL_U = SCT_CTRL_CLEAR;
+  // Rescale pulse widths already set
+  for (channel = 0; channel < HW_SCT_OUTPUTS; channel++) {
+    if (pwm_outputs[channel].event >= 0 && pwm_outputs[channel].group == group) {
+      pwm_output_update(channel);
+    }
   }
 
+  // Clear the counter and un-halt it
+  hw_sct_counter(group, prescale, 1);
+
+  for (channel = 0; channel < HW_SCT_OUTPUTS; channel++) {
+    if (restart & (1 << channel)) {
+      hw_pwm_pin_pulsewidth(pwm_outputs[channel].pin, pwm_outputs[channel].pulsewidth);
+    }
+  }
   return 0;
 }
 
+
+// The period of group 0, which pins use unless moved
+int hw_pwm_port_period (uint32_t period)
+{
+  return hw_pwm_group_period(HW_SCT_L, period);
+}
+
+
+// Moves a pin to period group HW_SCT_L or HW_SCT_H, carrying its pulse
+// width over if the group has a period. Returns 0 or -1 for a non-PWM pin
+// or a bad group.
+int hw_pwm_pin_group (int pin, int group)
+{
+  if (g_APinDescription[pin].alternate != PWM_MODE || (group != HW_SCT_L && group != HW_SCT_H)) {
+    return -1;
+  }
+  int channel = g_APinDescription[pin].pwm_channel;
+  if (pwm_outputs[channel].group == group) {
+    return 0;
+  }
+
+  int running = pwm_outputs[channel].event >= 0;
+  if (running) {
+    pwm_output_stop(channel);
+  }
+  pwm_outputs[channel].group = group;
+  if (running && pwm_groups[group].event >= 0) {
+    return hw_pwm_pin_pulsewidth(pin, pwm_outputs[channel].pulsewidth);
+  }
+  return 0;
+}
+
+
+// Returns 0, -1 if the pin has no PWM or its group no period, or the SCT's
+// user if the pin's output or an event is taken.
 int hw_pwm_pin_pulsewidth (int pin, uint32_t pulsewidth)
 {
   if (g_APinDescription[pin].alternate != PWM_MODE) {
     return -1; // Not a PWM pin
   }
 
-  // This is the output channel ({8,5,10} on TM-00-04). They're also
-  // used as event indicies for convenience,
+  // This is the output channel ({8,5,10} on TM-00-04)
   int channel = g_APinDescription[pin].pwm_channel;
+  int group = pwm_outputs[channel].group;
+  if (pwm_groups[group].event < 0) {
+    return -1;
+  }
 
-  // Event N at counter match
-  LPC_SCT->EVENT[channel].CTRL = SCT_EVENT_CTRL_MATCH(channel) | SCT_EVENT_CTRL_MATCH_ONLY; // match register 1, match condition only, no state change
-  LPC_SCT->EVENT[channel].STATE = (1 << 0); // in state 0
-  LPC_SCT->MATCH[channel].U = pulsewidth;
-  LPC_SCT->MATCHREL[channel].U = pulsewidth;
+  if (pwm_outputs[channel].event < 0) {
+    int status = hw_sct_claim_output(&pwm_sct, channel);
+    if (status) {
+      return status;
+    }
+    int event = hw_sct_alloc_event(&pwm_sct);
+    int reg = hw_sct_alloc_reg(&pwm_sct, group, 0);
+    if (event < 0 || reg < 0) {
+      hw_sct_free_event(&pwm_sct, event);
+      hw_sct_free_reg(&pwm_sct, group, reg);
+      return hw_sct_busy(&pwm_sct);
+    }
+    pwm_outputs[channel].event = event;
+    pwm_outputs[channel].reg = reg;
+    pwm_outputs[channel].pin = pin;
 
-  LPC_SCT->OUT[channel].SET = (1 << 0); // Event 0 sets the output
-  LPC_SCT->OUT[channel].CLR = (1 << channel); // Event N clears the output
+    // Event at counter match
+    LPC_SCT->EVENT[event].CTRL = SCT_EVENT_CTRL_MATCH(reg) | SCT_EVENT_CTRL_MATCH_ONLY
+      | (group == HW_SCT_H ? SCT_EVENT_CTRL_HEVENT : 0); // match condition only, no state change
+    LPC_SCT->EVENT[event].STATE = (1 << 0); // in state 0
 
-  scu_pinmux(g_APinDescription[pin].port,
-    g_APinDescription[pin].pin,
-    PUP_DISABLE | PDN_DISABLE,
-    g_APinDescription[pin].alternate_func);
+    LPC_SCT->OUT[channel].SET = (1 << pwm_groups[group].event); // The period event sets the output
+    LPC_SCT->OUT[channel].CLR = (1 << event); // The pin's event clears the output
+
+    scu_pinmux(g_APinDescription[pin].port,
+      g_APinDescription[pin].pin,
+      PUP_DISABLE | PDN_DISABLE,
+      g_APinDescription[pin].alternate_func);
+  }
+
+  if (pwm_sequence.channel == channel) {
+    hw_pwm_sequence_stop();
+  }
+  pwm_outputs[channel].pulsewidth = pulsewidth;
+  pwm_output_update(channel);
 
   return 0;
 }
+
+
+// Links DMA items writing `count` values into `reload`, one per request.
+// Returns the item after the last.
+static hw_GPDMA_Linked_List_Type* pwm_sequence_link (hw_GPDMA_Linked_List_Type* lli,
+  uint16_t* values, size_t count, volatile uint16_t* reload)
+{
+  while (count > 0) {
+    size_t size = count < PWM_DMA_CHUNK ? count : PWM_DMA_CHUNK;
+    lli->Source = (uint32_t) values;
+    lli->Destination = (uint32_t) reload;
+    lli->NextLLI = (uint32_t) (lli + 1);
+    lli->Control = GPDMA_DMACCxControl_TransferSize(size)
+      | GPDMA_DMACCxControl_SBSize(GPDMA_BSIZE_1)
+      | GPDMA_DMACCxControl_DBSize(GPDMA_BSIZE_1)
+      | GPDMA_DMACCxControl_SWidth(GPDMA_WIDTH_HALFWORD)
+      | GPDMA_DMACCxControl_DWidth(GPDMA_WIDTH_HALFWORD)
+      | GPDMA_DMACCxControl_SI;
+    values += size;
+    count -= size;
+    lli++;
+  }
+  return lli;
+}
+
+
+// Plays `count` pulse widths on a pin, one per period of its group, then
+// emits "pwm_sequence_complete" with an error flag, holding the last; with
+// `repeat`, loops until stopped. Returns 0, -1 if the pin has no PWM, its
+// group no period or one on the whole SCT, or memory ran out, or the SCT's
+// user if a DMA request or event is taken.
+int hw_pwm_pin_sequence (int pin, const uint32_t* pulsewidths, size_t count, int repeat)
+{
+  // Sequences write 16 bit match registers
+  if (count == 0 || pwm_unified) {
+    return -1;
+  }
+  hw_pwm_sequence_stop();
+
+  // Start on the first pulse width, which sets the pin up
+  int status = hw_pwm_pin_pulsewidth(pin, pulsewidths[0]);
+  if (status) {
+    return status;
+  }
+  int channel = g_APinDescription[pin].pwm_channel;
+  int group = pwm_outputs[channel].group;
+
+  if (count == 1) {
+    // Nothing left to feed; the width is already playing
+    pwm_sequence.channel = channel;
+    pwm_sequence.repeat = repeat;
+    pwm_sequence.error = 0;
+    if (!repeat) {
+      tm_event_ref(&pwm_sequence_event);
+      pwm_sequence.done = 1;
+      tm_event_trigger(&pwm_sequence_event);
+    }
+    return 0;
+  }
+
+  // The first width is already loaded, so DMA starts on the second; a
+  // repeating sequence then loops over all of them.
+  size_t first = (count - 1 + PWM_DMA_CHUNK - 1) / PWM_DMA_CHUNK;
+  size_t items = first + (repeat ? (count + PWM_DMA_CHUNK - 1) / PWM_DMA_CHUNK : 0);
+  pwm_sequence.values = malloc(count * sizeof(uint16_t));
+  pwm_sequence.lli = malloc(items * sizeof(hw_GPDMA_Linked_List_Type));
+  pwm_sequence.dma = hw_sct_alloc_dma(&pwm_sct);
+  pwm_sequence.channel = channel;
+  pwm_sequence.repeat = repeat;
+  pwm_sequence.done = 0;
+  pwm_sequence.error = 0;
+  if (!repeat) {
+    // Held until it completes
+    tm_event_ref(&pwm_sequence_event);
+  }
+  if (!pwm_sequence.values || !pwm_sequence.lli || pwm_sequence.dma < 0) {
+    status = pwm_sequence.dma < 0 ? hw_sct_busy(&pwm_sct) : -1;
+    hw_pwm_sequence_stop();
+    return status;
+  }
+
+  size_t i;
+  for (i = 0; i < count; i++) {
+    pwm_sequence.values[i] = pwm_ticks(group, pulsewidths[i]);
+  }
+  pwm_outputs[channel].pulsewidth = pulsewidths[count - 1];
+
+  // Each period loads the next value into the pin's match reload register
+  volatile uint16_t* reload = group == HW_SCT_H
+    ? &LPC_SCT->MATCHREL_H[pwm_outputs[channel].reg]
+    : &LPC_SCT->MATCHREL_L[pwm_outputs[channel].reg];
+  hw_GPDMA_Linked_List_Type* last = pwm_sequence_link(pwm_sequence.lli,
+    &pwm_sequence.values[1], count - 1, reload) - 1;
+  if (repeat) {
+    last = pwm_sequence_link(last + 1, pwm_sequence.values, count, reload) - 1;
+    last->NextLLI = (uint32_t) &pwm_sequence.lli[first];
+  } else {
+    last->NextLLI = 0;
+    last->Control |= GPDMA_DMACCxControl_I;
+  }
+
+  hw_GPDMA_Chan_Config config = {
+    .SrcConn = 0,
+    .DestConn = pwm_sequence.dma == 0 ? SCT0_CONN : SCT1_CONN,
+    .TransferType = m2p,
+  };
+  hw_gpdma_transfer_config(HW_PWM_SEQUENCE_DMA_CHANNEL, &config);
+  hw_gpdma_transfer_begin(HW_PWM_SEQUENCE_DMA_CHANNEL, pwm_sequence.lli);
+  hw_sct_dma_events(pwm_sequence.dma, 1 << pwm_groups[group].event);
+
+  return 0;
+}
+
+
+// Stops the sequence, if any, leaving its pin on the value it reached.
+// A stopped sequence never reports completion.
+void hw_pwm_sequence_stop (void)
+{
+  if (pwm_sequence.channel < 0) {
+    return;
+  }
+  hw_gpdma_cancel_transfer(HW_PWM_SEQUENCE_DMA_CHANNEL);
+  hw_sct_free_dma(&pwm_sct, pwm_sequence.dma);
+  pwm_sequence.channel = -1;
+  pwm_sequence.dma = -1;
+  free(pwm_sequence.values);
+  free(pwm_sequence.lli);
+  pwm_sequence.values = NULL;
+  pwm_sequence.lli = NULL;
+  if (!pwm_sequence.repeat) {
+    tm_event_unref(&pwm_sequence_event);
+  }
+}
+
+
+// Called from DMA_IRQHandler
+void hw_pwm_dma_irq (void)
+{
+  if (GPDMA_IntGetStatus(GPDMA_STAT_INTERR, HW_PWM_SEQUENCE_DMA_CHANNEL)) {
+    GPDMA_ClearIntPending(GPDMA_STATCLR_INTERR, HW_PWM_SEQUENCE_DMA_CHANNEL);
+    pwm_sequence.error = 1;
+    pwm_sequence.done = 1;
+    tm_event_trigger(&pwm_sequence_event);
+  }
+  if (GPDMA_IntGetStatus(GPDMA_STAT_INTTC, HW_PWM_SEQUENCE_DMA_CHANNEL)) {
+    GPDMA_ClearIntPending(GPDMA_STATCLR_INTTC, HW_PWM_SEQUENCE_DMA_CHANNEL);
+    pwm_sequence.done = 1;
+    tm_event_trigger(&pwm_sequence_event);
+  }
+}
+
+
+static void pwm_sequence_complete (tm_event* event)
+{
+  (void) event;
+  // Stopped, or replaced by a sequence still playing, since the IRQ
+  if (pwm_sequence.channel < 0 || !pwm_sequence.done) {
+    return;
+  }
+  int error = pwm_sequence.error;
+  hw_pwm_sequence_stop();
+
+  lua_State* L = tm_lua_state;
+  if (!L) return;
+  lua_getglobal(L, "_colony_emit");
+  lua_pushstring(L, "pwm_sequence_complete");
+  lua_pushboolean(L, error);
+  tm_checked_call(L, 2);
+}
+
+
+// Stops PWM and hands its SCT resources back
+void hw_pwm_reset (void)
+{
+  hw_pwm_sequence_stop();
+  hw_sct_release(&pwm_sct);
+  pwm_unified = 0;
+  int group;
+  for (group = 0; group < 2; group++) {
+    pwm_groups[group].event = -1;
+    pwm_groups[group].reg = -1;
+  }
+  int channel;
+  for (channel = 0; channel < HW_SCT_OUTPUTS; channel++) {
+    pwm_outputs[channel].event = -1;
+    pwm_outputs[channel].reg = -1;
+    pwm_outputs[channel].group = HW_SCT_L;
+  }
+}
@@ -0,0 +1,170 @@
+// Copyright 2014 Technical Machine, Inc. See the COPYRIGHT
+// file at the top-level directory of this distribution.
+//
+// Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+// http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+// <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+// option. This file may not be copied, modified, or distributed
+// except according to those terms.
+
+// Quadrature encoder interface. The QEI counts phase A/B edges (or clock
+// and direction pulses) into the position, captures the edges counted over
+// each velocity period and counts index pulses, all in hardware, so
+// tracking an encoder takes no CPU at any speed. The only interrupt is on
+// index pulses when the position is to zero on each, since the hardware
+// only arms that reset for the next one.
+//
+// The QEI inputs are fixed to PA_3 (phase A), PA_2 (phase B) and PA_1
+// (index); a board that doesn't bring them out can't use it.
+
+#include "hw.h"
+#include "variant.h"
+#include "LPC18xx.h"
+#include "lpc18xx_qei.h"
+
+enum {
+  QEI_PHA,
+  QEI_PHB,
+  QEI_IDX,
+  QEI_INPUTS
+};
+
+static const struct {
+  uint8_t port;
+  uint8_t pin;
+  uint8_t func;
+} qei_pads[QEI_INPUTS] = {
+  [QEI_PHA] = { 0xA, 3, FUNC1 },
+  [QEI_PHB] = { 0xA, 2, FUNC1 },
+  [QEI_IDX] = { 0xA, 1, FUNC1 },
+};
+
+// board pin routed to each input, or -1
+static int qei_pins[QEI_INPUTS] = { [0 ... QEI_INPUTS - 1] = -1 };
+static int qei_running;
+
+
+static int qei_pad_matches (int input, int pin)
+{
+  return hw_valid_pin(pin)
+    && g_APinDescription[pin].port == qei_pads[input].port
+    && g_APinDescription[pin].pin == qei_pads[input].pin;
+}
+
+
+void __attribute__ ((interrupt)) QEI_IRQHandler (void)
+{
+  if (QEI_GetIntStatus(QEI_0, QEI_INTFLAG_INX_Int)) {
+    QEI_IntClear(QEI_0, QEI_INTFLAG_INX_Int);
+    QEI_Reset(QEI_0, QEI_RESET_POSOnIDX);
+  }
+}
+
+
+// Starts decoding phases on pins `pha` and `phb`, with index pulses on
+// `idx` or none if it's negative. The position counts up to `max_position`
+// then wraps to 0 (and back), velocity is captured every `velocity_us` and
+// inputs must hold for `filter` core clocks to count. `flags` are
+// HW_QEI_*. Returns -1 if a pin isn't on its QEI input.
+int hw_qei_start (int pha, int phb, int idx, int flags, uint32_t max_position, uint32_t velocity_us, uint32_t filter)
+{
+  if (!qei_pad_matches(QEI_PHA, pha) || !qei_pad_matches(QEI_PHB, phb)
+    || (idx >= 0 && !qei_pad_matches(QEI_IDX, idx))
+    || (idx < 0 && (flags & HW_QEI_INDEX_RESET))) {
+    return -1;
+  }
+
+  uint64_t reload = (uint64_t) CGU_GetPCLKFrequency(CGU_PERIPHERAL_QEI) * velocity_us / 1000000;
+  if (reload == 0 || reload > 0xFFFFFFFF) {
+    return -1;
+  }
+
+  hw_qei_stop();
+
+  QEI_CFG_Type config = {
+    .DirectionInvert = flags & HW_QEI_INVERT_DIRECTION ? QEI_DIRINV_CMPL : QEI_DIRINV_NONE,
+    .SignalMode = flags & HW_QEI_CLOCK_DIRECTION ? QEI_SIGNALMODE_CLKDIR : QEI_SIGNALMODE_QUAD,
+    .CaptureMode = flags & HW_QEI_4X ? QEI_CAPMODE_4X : QEI_CAPMODE_2X,
+    .InvertIndex = flags & HW_QEI_INVERT_INDEX ? QEI_INVINX_EN : QEI_INVINX_NONE,
+  };
+  QEI_Init(QEI_0, &config);
+  QEI_SetMaxPosition(QEI_0, max_position ? max_position : 0xFFFFFFFF);
+
+  QEI_RELOADCFG_Type velocity = {
+    .ReloadOption = QEI_TIMERRELOAD_TICKVAL,
+    .ReloadValue = (uint32_t) reload,
+  };
+  QEI_SetTimerReload(QEI_0, &velocity);
+
+  st_Qei_FilterCfg filters = { filter, filter, filter };
+  QEI_SetDigiFilter(QEI_0, filters);
+
+  int inputs[QEI_INPUTS] = { pha, phb, idx };
+  int input;
+  for (input = 0; input < QEI_INPUTS; input++) {
+    if (inputs[input] >= 0) {
+      scu_pinmux(qei_pads[input].port, qei_pads[input].pin,
+        PUP_DISABLE | PDN_DISABLE | INBUF_ENABLE, qei_pads[input].func);
+      qei_pins[input] = inputs[input];
+    }
+  }
+
+  if (flags & HW_QEI_INDEX_RESET) {
+    QEI_Reset(QEI_0, QEI_RESET_POSOnIDX);
+    QEI_IntCmd(QEI_0, QEI_INTFLAG_INX_Int, ENABLE);
+    NVIC_EnableIRQ(QEI_IRQn);
+  }
+  qei_running = 1;
+  return 0;
+}
+
+
+uint32_t hw_qei_position (void)
+{
+  return qei_running ? QEI_GetPosition(QEI_0) : 0;
+}
+
+// 1 when the encoder last moved backwards
+int hw_qei_direction (void)
+{
+  return qei_running && QEI_GetStatus(QEI_0, QEI_STATUS_DIR) == SET;
+}
+
+// Edges counted over the last full velocity period
+uint32_t hw_qei_velocity (void)
+{
+  return qei_running ? QEI_GetVelocityCap(QEI_0) : 0;
+}
+
+// Index pulses seen
+uint32_t hw_qei_index (void)
+{
+  return qei_running ? QEI_GetIndex(QEI_0) : 0;
+}
+
+// Zeroes the position and index count
+void hw_qei_zero (void)
+{
+  if (qei_running) {
+    QEI_Reset(QEI_0, QEI_RESET_POS);
+    QEI_Reset(QEI_0, QEI_RESET_IDX);
+  }
+}
+
+
+void hw_qei_stop (void)
+{
+  NVIC_DisableIRQ(QEI_IRQn);
+  if (qei_running) {
+    QEI_IntCmd(QEI_0, QEI_INTFLAG_INX_Int, DISABLE);
+    QEI_IntClear(QEI_0, QEI_INTFLAG_INX_Int);
+    qei_running = 0;
+  }
+  int input;
+  for (input = 0; input < QEI_INPUTS; input++) {
+    if (qei_pins[input] >= 0) {
+      hw_digital_startup(qei_pins[input]);
+      qei_pins[input] = -1;
+    }
+  }
+}
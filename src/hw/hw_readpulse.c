@@ -15,24 +15,22 @@ extern "C" {
 #include "tm.h"
 #include "hw.h"
 #include "colony.h"
+#include "event_stats.h"
 #include <stdint.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <variant.h>
 #include <lpc18xx_sct.h>
 
-// Event definitions
-#define EVENT_TIMEOUT           1
-#define EVENT_START_TIMING      2
-#define EVENT_END_TIMING        3
-
-// State definitions
-#define STATE_TIMING            0
-#define STATE_ACTIVE            1
-#define STATE_RETURN            2
-
-// Input definitions
-#define SCT_INPUT_PIN           5
+// Pulse measurement runs on one of the SCT's 16 bit counter halves,
+// prescaled to SCT_PULSE_TICKS_PER_US and shared by up to
+// SCT_PULSE_CHANNELS channels, one per SCT input routed to a Tessel pin.
+// Each channel reserves two events (rising and falling edge on its input)
+// and the two capture registers they latch the counter into, so every edge
+// is timed in hardware and channels measure independently. A wrap event
+// counts the counter's overflows to extend captures to 32 bits. The
+// interrupt only subtracts captures; timeouts run off hw_periodic.
 
 // Macro to define register bits and mask in CMSIS style
 #define LPCLIB_DEFINE_REG_BIT(name,pos,width) \
@@ -41,224 +39,615 @@ extern "C" {
     name##_MSK = (int)(((1ul << width) - 1) << pos), \
   }
 
-// SCT control positions using CMSIS style macro
-LPCLIB_DEFINE_REG_BIT(STOP_L,   1,  1);
-LPCLIB_DEFINE_REG_BIT(HALT_L,   2,  1);
-LPCLIB_DEFINE_REG_BIT(CLRCTR_L, 3,  1);
-LPCLIB_DEFINE_REG_BIT(PRE_L,    5,  8);
-
-// SCT config positions using CMSIS style macro
-LPCLIB_DEFINE_REG_BIT(UNIFY,    0,  1);
-
 // Event control positions using CMSIS style macro
 LPCLIB_DEFINE_REG_BIT(MATCHSEL, 0,  4);
+LPCLIB_DEFINE_REG_BIT(HEVENT,   4,  1);
 LPCLIB_DEFINE_REG_BIT(IOSEL,    6,  4);
 LPCLIB_DEFINE_REG_BIT(IOCOND,   10, 2);
 LPCLIB_DEFINE_REG_BIT(COMBMODE, 12, 2);
 LPCLIB_DEFINE_REG_BIT(STATELD,  14, 1);
 LPCLIB_DEFINE_REG_BIT(STATEV,   15, 5);
 
+// Edge conditions for IOCOND
+#define IOCOND_RISE             1
+#define IOCOND_FALL             2
+
+#define PULSE_RING_SIZE         256
+#define PULSE_RING_MASK         (PULSE_RING_SIZE - 1)
+
+// SCT inputs that can be routed to a pin, by SCU pad
+static const struct {
+  uint8_t port;
+  uint8_t pin;
+  uint8_t func;
+  uint8_t input;
+} sct_inputs[SCT_PULSE_CHANNELS] = {
+  { 4u, 8u,  FUNC1, 5 },   // P4_8  | CTIN_5 | GPIO bank G3
+  { 4u, 10u, FUNC1, 2 },   // P4_10 | CTIN_2 | GPIO bank G2
+  { 7u, 2u,  FUNC1, 4 },   // P7_2  | CTIN_4 | port C G2
+  { 4u, 9u,  FUNC1, 6 },   // P4_9  | CTIN_6 | config button
+};
+
+typedef enum {
+  PULSE_IDLE,
+  PULSE_WAITING,     // single pulse, waiting for its leading edge
+  PULSE_TIMING,      // single pulse, waiting for its trailing edge
+  PULSE_STREAMING,
+  PULSE_DONE
+} pulse_phase_t;
+
+typedef struct {
+  tm_event event;
+  hw_periodic_t timeout;
+  uint8_t pin;
+  uint8_t stream;
+  volatile pulse_phase_t phase;
+
+  // SCT events and capture registers for each edge
+  int8_t rise_event;
+  int8_t fall_event;
+  int8_t rise_reg;
+  int8_t fall_reg;
+
+  // single pulse
+  hw_sct_pulse_type_t type;
+  uint32_t start;
+  uint32_t ticks;
+
+  // streaming: [ticks][level] per pulse, level being the one that just ended
+  uint8_t continuous;
+  uint8_t started;
+  uint32_t last;
+  uint32_t batch;
+  uint32_t recorded;
+  volatile uint32_t edges;
+  uint32_t checked_edges;
+  uint32_t (*ring)[2];
+  volatile uint32_t head;
+  volatile uint32_t tail;
+  volatile uint32_t overflow;
+} pulse_channel_t;
+
 // Prototypes
-void sct_set_scu_pin(uint8_t pin);
-void sct_driver_configure (hw_sct_pulse_type_t type, uint32_t timeout);
-void sct_driver_start (void);
-void sct_read_pulse_complete ();
-void sct_log_registers (void);
+void sct_set_scu_pin(uint8_t channel);
+void sct_read_pulse_complete (tm_event* event);
+static void sct_pulse_irq (uint32_t flags);
+
+static pulse_channel_t channels[SCT_PULSE_CHANNELS] = {
+  [0 ... SCT_PULSE_CHANNELS - 1] = {
+    .event = TM_EVENT_INIT(sct_read_pulse_complete),
+    .rise_event = -1, .fall_event = -1, .rise_reg = -1, .fall_reg = -1,
+  },
+};
 
-// The recorded number of ticks over the pulse
-uint32_t pulse_ticks = 0;
+static hw_sct_owner_t pulse_sct = { .user = SCT_READPULSE, .irq = sct_pulse_irq };
 
-// Event triggered when read pulse is complete
-tm_event sct_read_pulse_complete_event = TM_EVENT_INIT(sct_read_pulse_complete);
+// the counter half in use, or -1, and its wrap event
+static int pulse_half = -1;
+static int pulse_wrap_event = -1;
+static int pulse_wrap_reg = -1;
+static volatile uint32_t pulse_epoch;
 
 
-// Begins waiting for pulse in
-uint8_t sct_read_pulse (hw_sct_pulse_type_t type, uint32_t timeout)
+// Returns the channel whose SCT input is routed to `pin`, or -1
+static int sct_pulse_channel (uint8_t pin)
 {
-  // really clear the SCT: ( 1 << 5 ) is an LPC18xx.h include workaround
-  LPC_RGU->RESET_CTRL1 = ( 1 << 5 );
+  if (!hw_valid_pin(pin)) {
+    return -1;
+  }
+  int channel;
+  for (channel = 0; channel < SCT_PULSE_CHANNELS; channel++) {
+    if (g_APinDescription[pin].port == sct_inputs[channel].port
+      && g_APinDescription[pin].pin == sct_inputs[channel].pin) {
+      return channel;
+    }
+  }
+  return -1;
+}
 
-  // set the pin configuration
-  sct_set_scu_pin(E_G3);
 
-  // initialize the driver
-  sct_driver_configure(type, timeout);
+// Sets up the input pin
+void sct_set_scu_pin(uint8_t channel)
+{
+  scu_pinmux(sct_inputs[channel].port,
+    sct_inputs[channel].pin,
+    PUP_DISABLE | PDN_DISABLE | FILTER_ENABLE | INBUF_ENABLE,
+    sct_inputs[channel].func);
+}
 
-  // allow SCT IRQs
-  NVIC_EnableIRQ(SCT_IRQn);
 
-  // start the driver
-  sct_driver_start();
+// Hands the counter half back once no channel is measuring
+static void sct_pulse_unclaim (void)
+{
+  hw_sct_release(&pulse_sct);
+  pulse_half = -1;
+  pulse_wrap_event = -1;
+  pulse_wrap_reg = -1;
+}
 
-  // hold the event queue open until we're done
-  tm_event_ref(&sct_read_pulse_complete_event);
 
-  // successful return
-  return 0;
+// Hands back a channel's events and capture registers
+static void sct_pulse_free (pulse_channel_t* ch)
+{
+  hw_sct_free_event(&pulse_sct, ch->rise_event);
+  hw_sct_free_event(&pulse_sct, ch->fall_event);
+  if (pulse_half >= 0) {
+    hw_sct_free_reg(&pulse_sct, pulse_half, ch->rise_reg);
+    hw_sct_free_reg(&pulse_sct, pulse_half, ch->fall_reg);
+  }
+  ch->rise_event = ch->fall_event = ch->rise_reg = ch->fall_reg = -1;
 }
 
 
-// Sets up the input pin
-void sct_set_scu_pin(uint8_t pin)
+static int sct_pulse_idle (void)
 {
-  scu_pinmux(g_APinDescription[pin].port,
-    g_APinDescription[pin].pin,
-    PUP_DISABLE | PDN_DISABLE | FILTER_ENABLE | INBUF_ENABLE,
-    g_APinDescription[pin].alternate_func);
+  int i;
+  for (i = 0; i < SCT_PULSE_CHANNELS; i++) {
+    if (channels[i].phase != PULSE_IDLE) {
+      return 0;
+    }
+  }
+  return 1;
 }
 
 
-// Configures the driver for the SCT
-void sct_driver_configure (hw_sct_pulse_type_t type, uint32_t timeout)
+// Starts a free counter half running with the first channel, H first to
+// leave L to PWM
+static int sct_pulse_start_counter (void)
 {
-  // what edge to look for at start and end (rising edge = 1, falling edge = 2)
-  int type_start = (type == SCT_PULSE_HIGH) ? 1 : 2;
-  int type_end   = (type == SCT_PULSE_HIGH) ? 2 : 1;
-
-  // set the config to be a unity 32 bit counter (timeout is a uint32)
-  LPC_SCT->CONFIG |= (1 << UNIFY_POS);
-
-  // set the sct control register
-  LPC_SCT->CTRL_U = 0
-    | ( 0 << STOP_L_POS )              // clear the stop register
-    | ( 1 << HALT_L_POS )              // halt while configuring the SCT
-    | ( 1 << CLRCTR_L_POS )            // clear the other bits
-    | ( 0 << PRE_L_POS )               // set prescaler to match sys clock
+  int half = HW_SCT_H;
+  int status = hw_sct_claim_counter(&pulse_sct, half);
+  if (status) {
+    half = HW_SCT_L;
+    status = hw_sct_claim_counter(&pulse_sct, half);
+  }
+  if (status) {
+    return status;
+  }
+
+  pulse_wrap_event = hw_sct_alloc_event(&pulse_sct);
+  pulse_wrap_reg = hw_sct_alloc_reg(&pulse_sct, half, 0);
+  if (pulse_wrap_event < 0 || pulse_wrap_reg < 0) {
+    status = hw_sct_busy(&pulse_sct);
+    sct_pulse_unclaim();
+    return status;
+  }
+  pulse_half = half;
+  pulse_epoch = 0;
+
+  // the counter runs free, wrapping after 0xFFFF
+  hw_sct_match(half, pulse_wrap_reg, 0xFFFF);
+  LPC_SCT->EVENT[pulse_wrap_event].STATE = ( 1 << 0 );
+  LPC_SCT->EVENT[pulse_wrap_event].CTRL = 0
+    | ( pulse_wrap_reg << MATCHSEL_POS )
+    | ( half << HEVENT_POS )
+    | ( 1 << COMBMODE_POS )            // match only
     ;
+  __disable_irq();
+  LPC_SCT->EVEN |= ( 1 << pulse_wrap_event );
+  __enable_irq();
 
-  // set the match and capture register ( match = 0, capture = 1 )
-  LPC_SCT->REGMODE_L = ( 0 << 0 ) | ( 1 << 1 );
+  hw_sct_counter(half, SCT_PULSE_PRESCALE, 1);
+  return 0;
+}
 
-  // set the timeout as a match limit
-  LPC_SCT->MATCH[0].U = ( timeout * SYSTEM_CORE_CLOCK_MS );
 
-  // start timing event state can start once we start the clock
-  LPC_SCT->EVENT[EVENT_START_TIMING].STATE = ( 1 << STATE_TIMING );
+// Reserves what a channel needs, starting the shared counter with the
+// first. Returns 0, or the SCT's user if anything is taken.
+static int sct_pulse_claim (int channel)
+{
+  pulse_channel_t* ch = &channels[channel];
+  if (ch->phase != PULSE_IDLE) {
+    return SCT_READPULSE;
+  }
+  if (pulse_half < 0) {
+    int status = sct_pulse_start_counter();
+    if (status) {
+      return status;
+    }
+  }
 
-  // start timing event control
-  LPC_SCT->EVENT[EVENT_START_TIMING].CTRL = 0
-    | ( type_start << IOCOND_POS )     // looks for rising or falling edge
-    | ( SCT_INPUT_PIN << IOSEL_POS )   // selects the input pin
-    | ( 2 << COMBMODE_POS )            // look for IO and not a match
-    | ( 1 << STATELD_POS )             // load the state in STATEV
-    | ( STATE_ACTIVE << STATEV_POS )   // state to load when event triggers
-    ;
+  ch->rise_event = hw_sct_alloc_event(&pulse_sct);
+  ch->fall_event = hw_sct_alloc_event(&pulse_sct);
+  ch->rise_reg = hw_sct_alloc_reg(&pulse_sct, pulse_half, 1);
+  ch->fall_reg = hw_sct_alloc_reg(&pulse_sct, pulse_half, 1);
+  if (ch->rise_event < 0 || ch->fall_event < 0 || ch->rise_reg < 0 || ch->fall_reg < 0) {
+    int status = hw_sct_busy(&pulse_sct);
+    sct_pulse_free(ch);
+    if (sct_pulse_idle()) {
+      sct_pulse_unclaim();
+    }
+    return status;
+  }
+  return 0;
+}
 
-  // end timing event state can only happen once we're actively timing
-  LPC_SCT->EVENT[EVENT_END_TIMING].STATE = ( 1 << STATE_ACTIVE );
 
-  // end timing event control
-  LPC_SCT->EVENT[EVENT_END_TIMING].CTRL = 0
-    | ( type_end << IOCOND_POS )       // looks for rising or falling edge
-    | ( SCT_INPUT_PIN << IOSEL_POS )   // selects the input pin
+// Routes the channel's input and enables its edge events
+static void sct_pulse_arm (int channel)
+{
+  pulse_channel_t* ch = &channels[channel];
+  uint8_t input = sct_inputs[channel].input;
+  sct_set_scu_pin(channel);
+
+  LPC_SCT->EVENT[ch->rise_event].STATE = ( 1 << 0 );
+  LPC_SCT->EVENT[ch->rise_event].CTRL = 0
+    | ( pulse_half << HEVENT_POS )     // in our counter half's state
+    | ( IOCOND_RISE << IOCOND_POS )    // looks for a rising edge
+    | ( input << IOSEL_POS )           // selects the input pin
+    | ( 2 << COMBMODE_POS )            // look for IO and not a match
+    ;
+  LPC_SCT->EVENT[ch->fall_event].STATE = ( 1 << 0 );
+  LPC_SCT->EVENT[ch->fall_event].CTRL = 0
+    | ( pulse_half << HEVENT_POS )     // in our counter half's state
+    | ( IOCOND_FALL << IOCOND_POS )    // looks for a falling edge
+    | ( input << IOSEL_POS )           // selects the input pin
     | ( 2 << COMBMODE_POS )            // look for IO and not a match
-    | ( 1 << STATELD_POS )             // load the state in STATEV
-    | ( STATE_RETURN << STATEV_POS )   // state to load when event triggers
     ;
 
-  // timeouts occur after looking for a rising/falling edge for too long
-  LPC_SCT->EVENT[EVENT_TIMEOUT].STATE = ( 1 << STATE_TIMING );
+  // each edge captures the counter into its own register
+  hw_sct_capture_events(pulse_half, ch->rise_reg, ( 1 << ch->rise_event ));
+  hw_sct_capture_events(pulse_half, ch->fall_reg, ( 1 << ch->fall_event ));
 
-  // timout event control
-  LPC_SCT->EVENT[EVENT_TIMEOUT].CTRL = 0
-    | ( 0 << MATCHSEL_POS )            // match to value in 0 match register
-    | ( 1 << COMBMODE_POS )            // match event, not an IO event
-    | ( 1 << STATELD_POS )             // load the state in STATEV
-    | ( STATE_RETURN << STATEV_POS )   // state to load when event triggers
-    ;
+  uint32_t events = ( 1 << ch->rise_event ) | ( 1 << ch->fall_event );
+  __disable_irq();
+  LPC_SCT->EVFLAG = events;
+  LPC_SCT->EVEN |= events;
+  __enable_irq();
+}
 
-  // set the end timing event to capture the counter value
-  LPC_SCT->CAPCTRL[1].U = ( 1 << EVENT_END_TIMING );
 
-  // let the start event reset the counter so end event captures pulse length
-  LPC_SCT->LIMIT_L = ( 1 << EVENT_START_TIMING );
+// Disables the channel's events. Call with IRQs off or from the SCT IRQ.
+static void sct_pulse_disarm (int channel)
+{
+  pulse_channel_t* ch = &channels[channel];
+  uint32_t events = ( 1 << ch->rise_event ) | ( 1 << ch->fall_event );
+  LPC_SCT->EVEN &= ~events;
+  LPC_SCT->EVENT[ch->rise_event].STATE = 0;
+  LPC_SCT->EVENT[ch->fall_event].STATE = 0;
+  LPC_SCT->EVFLAG = events;
+}
 
-  // let the timeout and end timing event halt
-  LPC_SCT->HALT_L = ( 1 << EVENT_TIMEOUT ) | ( 1 << EVENT_END_TIMING );
 
-  // let timeout and end time set the interupt flag
-  LPC_SCT->EVFLAG = (1 << EVENT_END_TIMING) | (1 << EVENT_TIMEOUT);
+// Ends a channel's measurement and hands the event off to JS. Call with
+// IRQs off or from the SCT IRQ.
+static void sct_pulse_finish (pulse_channel_t* ch)
+{
+  sct_pulse_disarm(ch - channels);
+  ch->phase = PULSE_DONE;
+  event_stats_trigger(EVENT_SOURCE_READPULSE);
+  tm_event_trigger(&ch->event);
+}
+
+
+// Frees a channel, and the counter half with the last one
+static void sct_pulse_release (int channel)
+{
+  pulse_channel_t* ch = &channels[channel];
+  if (ch->phase == PULSE_IDLE) {
+    return;
+  }
+
+  hw_periodic_cancel(&ch->timeout);
+  __disable_irq();
+  sct_pulse_disarm(channel);
+  ch->phase = PULSE_IDLE;
+  __enable_irq();
+  sct_pulse_free(ch);
+  free(ch->ring);
+  ch->ring = NULL;
+  tm_event_unref(&ch->event);
+  hw_digital_startup(ch->pin);
+
+  if (sct_pulse_idle()) {
+    sct_pulse_unclaim();
+  }
+}
+
 
-  // let timeout and end time trigger interupts
-  LPC_SCT->EVEN = (1 << EVENT_END_TIMING) | (1 << EVENT_TIMEOUT);
+// A single pulse times out if its leading edge never comes
+static void sct_read_pulse_timeout (hw_periodic_t* periodic)
+{
+  pulse_channel_t* ch = (pulse_channel_t*) ((uint8_t*) periodic - offsetof(pulse_channel_t, timeout));
+  hw_periodic_cancel(periodic);
+  __disable_irq();
+  if (ch->phase == PULSE_WAITING) {
+    ch->ticks = 0;
+    sct_pulse_finish(ch);
+  }
+  __enable_irq();
 }
 
 
-// Starts the actual driver by unhalting the SCT
-void sct_driver_start (void)
+// Begins waiting for a pulse on `pin`. Returns 0, -1 if the pin has no SCT
+// input, or the SCT's current user if it is busy.
+int sct_read_pulse (uint8_t pin, hw_sct_pulse_type_t type, uint32_t timeout)
 {
-  // set the initial state
-  LPC_SCT->STATE_L = STATE_TIMING;
+  int channel = sct_pulse_channel(pin);
+  if (channel < 0) {
+    return -1;
+  }
+  int status = sct_pulse_claim(channel);
+  if (status) {
+    return status;
+  }
+
+  pulse_channel_t* ch = &channels[channel];
+  ch->pin = pin;
+  ch->stream = 0;
+  ch->type = type;
+  ch->ticks = 0;
+  ch->phase = PULSE_WAITING;
+
+  // hold the event queue open until we're done
+  tm_event_ref(&ch->event);
+  sct_pulse_arm(channel);
+  hw_periodic_start(&ch->timeout, timeout, sct_read_pulse_timeout);
 
-  // start the SCT
-  LPC_SCT->CTRL_L &= ~( 1 << HALT_L_POS );
+  // successful return
+  return 0;
 }
 
 
-// Function called when event has been completed and should exit event queue
-void sct_read_pulse_complete ()
+// Streaming ends once a whole timeout passes without an edge
+static void sct_read_pulses_timeout (hw_periodic_t* periodic)
 {
-  // reset the SCT
-  sct_read_pulse_reset();
+  pulse_channel_t* ch = (pulse_channel_t*) ((uint8_t*) periodic - offsetof(pulse_channel_t, timeout));
+  int idle = 0;
+  __disable_irq();
+  uint32_t edges = ch->edges;
+  if (edges == ch->checked_edges && ch->phase == PULSE_STREAMING) {
+    sct_pulse_finish(ch);
+    idle = 1;
+  }
+  __enable_irq();
+  ch->checked_edges = edges;
 
-  // get the Lua state or return if there is no state
-  lua_State* L = tm_lua_state;
-  if (!L) return;
+  // cancelled outside the lock, as in sct_read_pulse_timeout
+  if (idle) {
+    hw_periodic_cancel(periodic);
+  }
+}
 
-  // push the _colony_emit helper function onto the stack
-  lua_getglobal(L, "_colony_emit");
 
-  // the process message identifier
-  lua_pushstring(L, "read_pulse_complete");
+// Starts recording consecutive pulse widths on `pin`. A batch is delivered
+// every `batch` pulses; unless `continuous`, recording ends after the first
+// batch. It also ends once a whole `timeout` ms passes without an edge,
+// delivering whatever was recorded. Returns as sct_read_pulse does, and -1
+// for a batch larger than the ring.
+int sct_read_pulses (uint8_t pin, uint32_t batch, uint32_t timeout, int continuous)
+{
+  int channel = sct_pulse_channel(pin);
+  if (channel < 0 || batch == 0 || batch > PULSE_RING_SIZE || timeout == 0) {
+    return -1;
+  }
+  if (channels[channel].phase != PULSE_IDLE) {
+    return SCT_READPULSE;
+  }
+  uint32_t (*ring)[2] = malloc(PULSE_RING_SIZE * sizeof(*ring));
+  if (!ring) {
+    return -1;
+  }
+  int status = sct_pulse_claim(channel);
+  if (status) {
+    free(ring);
+    return status;
+  }
 
-  // the number of milliseconds the pulse was high
-  lua_pushnumber(L, (((double)pulse_ticks)/SYSTEM_CORE_CLOCK_MS_F));
+  pulse_channel_t* ch = &channels[channel];
+  ch->pin = pin;
+  ch->stream = 1;
+  ch->ring = ring;
+  ch->continuous = continuous;
+  ch->started = 0;
+  ch->batch = batch;
+  ch->recorded = 0;
+  ch->edges = ch->checked_edges = 0;
+  ch->head = ch->tail = ch->overflow = 0;
+  ch->phase = PULSE_STREAMING;
+
+  tm_event_ref(&ch->event);
+  sct_pulse_arm(channel);
+  hw_periodic_start(&ch->timeout, timeout, sct_read_pulses_timeout);
+  return 0;
+}
 
-  // reconfigure the pin back to gpio in
-  hw_digital_startup(E_G3);
 
-  // call _colony_emit to run the JS callback
-  tm_checked_call(L, 2);
+// Ends a streaming capture early, delivering what was recorded.
+void sct_read_pulses_stop (uint8_t pin)
+{
+  int channel = sct_pulse_channel(pin);
+  if (channel < 0) {
+    return;
+  }
+  pulse_channel_t* ch = &channels[channel];
+  __disable_irq();
+  if (ch->phase == PULSE_STREAMING) {
+    sct_pulse_finish(ch);
+  }
+  __enable_irq();
 }
 
+
+// Stops every channel and hands the SCT back, when a script ends
 void sct_read_pulse_reset (void)
 {
-  // set the SCT state back to inactive
-  hw_sct_status = SCT_INACTIVE;
+  int channel;
+  for (channel = 0; channel < SCT_PULSE_CHANNELS; channel++) {
+    sct_pulse_release(channel);
+  }
+  sct_pulse_unclaim();
+}
 
-  // disable the SCT IRQ
-  NVIC_DisableIRQ(SCT_IRQn);
 
-  // halt the SCT
-  LPC_SCT->CTRL_U = ( 1 << HALT_L_POS );
+static void sct_read_pulses_push (pulse_channel_t* ch, uint32_t capture, uint32_t level)
+{
+  ch->edges++;
+  // the span before the first edge is not a pulse
+  if (!ch->started) {
+    ch->started = 1;
+    ch->last = capture;
+    return;
+  }
+
+  uint32_t head = ch->head;
+  if (head - ch->tail >= PULSE_RING_SIZE) {
+    ch->overflow++;
+  } else {
+    ch->ring[head & PULSE_RING_MASK][0] = capture - ch->last;
+    ch->ring[head & PULSE_RING_MASK][1] = level;
+    ch->head = head + 1;
+  }
+  ch->last = capture;
+
+  if (++ch->recorded % ch->batch == 0) {
+    if (!ch->continuous) {
+      sct_pulse_finish(ch);
+    } else {
+      event_stats_trigger(EVENT_SOURCE_READPULSE);
+      tm_event_trigger(&ch->event);
+    }
+  }
+}
+
+
+// Handles one edge; `rising` ends a low level
+static void sct_pulse_edge (pulse_channel_t* ch, int rising, uint32_t capture)
+{
+  int leading = (ch->type == SCT_PULSE_HIGH) == rising;
+  switch (ch->phase) {
+    case PULSE_STREAMING:
+      sct_read_pulses_push(ch, capture, !rising);
+      break;
+    case PULSE_WAITING:
+      if (leading) {
+        ch->start = capture;
+        ch->phase = PULSE_TIMING;
+      }
+      break;
+    case PULSE_TIMING:
+      if (!leading) {
+        ch->ticks = capture - ch->start;
+        sct_pulse_finish(ch);
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+
+// Extends a capture to 32 bits. A wrap flagged in this same interrupt
+// hasn't been counted yet; captures from after it are the small ones.
+static uint32_t sct_pulse_time (uint16_t capture, uint32_t wrapped)
+{
+  uint32_t epoch = pulse_epoch;
+  if (wrapped && capture < 0x8000) {
+    epoch++;
+  }
+  return (epoch << 16) | capture;
+}
 
-  // really clear the SCT: ( 1 << 5 ) is an LPC18xx.h include workaround
-  LPC_RGU->RESET_CTRL1 = ( 1 << 5 );
 
-  // unreference the event
-  tm_event_unref(&sct_read_pulse_complete_event);
+// IRQ handler for our events
+static void sct_pulse_irq (uint32_t flags)
+{
+  LPC_SCT->EVFLAG = flags;
+  uint32_t wrapped = pulse_wrap_event >= 0 && (flags & ( 1 << pulse_wrap_event ));
+
+  int channel;
+  for (channel = 0; channel < SCT_PULSE_CHANNELS; channel++) {
+    pulse_channel_t* ch = &channels[channel];
+    if (ch->phase == PULSE_IDLE) {
+      continue;
+    }
+    uint32_t rise = flags & ( 1 << ch->rise_event );
+    uint32_t fall = flags & ( 1 << ch->fall_event );
+    if (!rise && !fall) {
+      continue;
+    }
+
+    // Both edges latched means one pulse was shorter than this interrupt's
+    // latency; the input's current level says which edge came last.
+    int rise_last = (LPC_SCT->INPUT & ( 1 << sct_inputs[channel].input )) != 0;
+    if (fall && rise_last) {
+      sct_pulse_edge(ch, 0, sct_pulse_time(hw_sct_capture(pulse_half, ch->fall_reg), wrapped));
+    }
+    if (rise) {
+      sct_pulse_edge(ch, 1, sct_pulse_time(hw_sct_capture(pulse_half, ch->rise_reg), wrapped));
+    }
+    if (fall && !rise_last) {
+      sct_pulse_edge(ch, 0, sct_pulse_time(hw_sct_capture(pulse_half, ch->fall_reg), wrapped));
+    }
+  }
+
+  if (wrapped) {
+    pulse_epoch++;
+  }
 }
 
 
-// IRQ handler called if there's an interupt
-void sct_readpulse_irq_handler (void)
+// Emits a single pulse as "read_pulse_complete" with its length in ms (0
+// on timeout) and pin, or a stream batch as "read_pulses" with the pin, a
+// buffer of [ticks][level] little-endian uint32 pairs (level 1 for a high
+// pulse), the pulses dropped while the ring was full and whether
+// recording has ended.
+void sct_read_pulse_complete (tm_event* event)
 {
-  // interupt triggered by the end of a pulse (set the pulse length)
-  if (LPC_SCT->EVFLAG & (1 << EVENT_END_TIMING))
-  {
-    pulse_ticks = LPC_SCT->CAP[1].U;
-    LPC_SCT->EVFLAG = (1 << EVENT_END_TIMING);
+  pulse_channel_t* ch = (pulse_channel_t*) event;
+  if (ch->phase == PULSE_IDLE) return;
+
+  lua_State* L = tm_lua_state;
+
+  if (!ch->stream) {
+    if (ch->phase != PULSE_DONE) return;
+    uint32_t ticks = ch->ticks;
+    sct_pulse_release(ch - channels);
+
+    if (!L) return;
+    event_stats_begin(EVENT_SOURCE_READPULSE);
+    lua_getglobal(L, "_colony_emit");
+    lua_pushstring(L, "read_pulse_complete");
+    lua_pushnumber(L, ((double)ticks) / (SCT_PULSE_TICKS_PER_US * 1000.0));
+    lua_pushnumber(L, ch->pin);
+    tm_checked_call(L, 3);
+    event_stats_end();
+    return;
   }
 
-  // interupt triggered by a timeout (set the pulse length to zero)
-  else if (LPC_SCT->EVFLAG & (1 << EVENT_TIMEOUT))
-  {
-    pulse_ticks = 0;
-    LPC_SCT->EVFLAG = (1 << EVENT_TIMEOUT);
+  __disable_irq();
+  uint32_t tail = ch->tail;
+  uint32_t count = ch->head - tail;
+  uint32_t overflow = ch->overflow;
+  uint8_t done = ch->phase == PULSE_DONE;
+  ch->overflow = 0;
+  __enable_irq();
+
+  if (L) {
+    event_stats_begin(EVENT_SOURCE_READPULSE);
+    lua_getglobal(L, "_colony_emit");
+    lua_pushstring(L, "read_pulses");
+    lua_pushnumber(L, ch->pin);
+    uint32_t* out = (uint32_t*) colony_createbuffer(L, count * sizeof(ch->ring[0]));
+    uint32_t i;
+    for (i = 0; i < count; i++) {
+      out[i * 2] = ch->ring[(tail + i) & PULSE_RING_MASK][0];
+      out[i * 2 + 1] = ch->ring[(tail + i) & PULSE_RING_MASK][1];
+    }
+    lua_pushnumber(L, overflow);
+    lua_pushboolean(L, done);
   }
+  ch->tail = tail + count;
 
-  // trigger the event complete for the event queue
-  tm_event_trigger(&sct_read_pulse_complete_event);
+  // free the channel first so JS can start another capture right away
+  if (done) {
+    sct_pulse_release(ch - channels);
+  }
+
+  if (L) {
+    tm_checked_call(L, 5);
+    event_stats_end();
+  }
 }
 
 
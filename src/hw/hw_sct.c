@@ -0,0 +1,410 @@
+// Copyright 2014 Technical Machine, Inc. See the COPYRIGHT
+// file at the top-level directory of this distribution.
+//
+// Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+// http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+// <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+// option. This file may not be copied, modified, or distributed
+// except according to those terms.
+
+// SCT resource allocator. Rather than one driver taking the whole SCT, the
+// SCT runs as two 16 bit counters, L and H, each with its own state
+// variable, prescaler and limit/halt events, and drivers reserve a counter
+// half along with the events, match/capture registers and outputs they
+// use. SCT_IRQHandler hands each owner the flags of its own events. A
+// driver that needs the whole SCT (the input clocked edge counter) claims
+// it unified, once nobody else holds anything.
+
+#include "hw.h"
+#include "LPC18xx.h"
+
+#define SCT_CONFIG_UNIFY (1 << 0)
+#define SCT_CTRL_HALT (1 << 2)
+#define SCT_CTRL_CLRCTR (1 << 3)
+#define SCT_CTRL_PRE(x) (((x) - 1) << 5)
+
+static hw_sct_owner_t* sct_halves[2];
+static hw_sct_owner_t* sct_events[HW_SCT_EVENTS];
+static hw_sct_owner_t* sct_outputs[HW_SCT_OUTPUTS];
+static hw_sct_owner_t* sct_regs[2][HW_SCT_REGS];
+static hw_sct_owner_t* sct_dmareqs[HW_SCT_DMAREQS];
+
+
+// Returns the user holding anything but `owner`, or SCT_INACTIVE
+static hw_sct_status_t sct_other_user (hw_sct_owner_t* owner)
+{
+	int i;
+	for (i = 0; i < 2; i++) {
+		if (sct_halves[i] && sct_halves[i] != owner) {
+			return sct_halves[i]->user;
+		}
+	}
+	for (i = 0; i < HW_SCT_EVENTS; i++) {
+		if (sct_events[i] && sct_events[i] != owner) {
+			return sct_events[i]->user;
+		}
+	}
+	for (i = 0; i < HW_SCT_OUTPUTS; i++) {
+		if (sct_outputs[i] && sct_outputs[i] != owner) {
+			return sct_outputs[i]->user;
+		}
+	}
+	for (i = 0; i < HW_SCT_DMAREQS; i++) {
+		if (sct_dmareqs[i] && sct_dmareqs[i] != owner) {
+			return sct_dmareqs[i]->user;
+		}
+	}
+	for (i = 0; i < HW_SCT_REGS; i++) {
+		if (sct_regs[0][i] && sct_regs[0][i] != owner) {
+			return sct_regs[0][i]->user;
+		}
+		if (sct_regs[1][i] && sct_regs[1][i] != owner) {
+			return sct_regs[1][i]->user;
+		}
+	}
+	return SCT_INACTIVE;
+}
+
+
+// Resets the SCT once its last resource is handed back, or before the
+// first is handed out
+static void sct_power (int on)
+{
+	NVIC_DisableIRQ(SCT_IRQn);
+
+	// really clear the SCT: ( 1 << 5 ) is an LPC18xx.h include workaround
+	LPC_RGU->RESET_CTRL1 = ( 1 << 5 );
+
+	if (on) {
+		// two halted 16 bit counters, clocked from the peripheral clock
+		LPC_SCT->CONFIG = 0;
+		LPC_SCT->CTRL_U = SCT_CTRL_HALT | (SCT_CTRL_HALT << 16);
+		NVIC_EnableIRQ(SCT_IRQn);
+	}
+}
+
+
+// The user holding resources besides `owner`, for error reporting when an
+// allocation fails. Falls back to `owner`'s own user.
+int hw_sct_busy (hw_sct_owner_t* owner)
+{
+	hw_sct_status_t user = sct_other_user(owner);
+	return user != SCT_INACTIVE ? user : owner->user;
+}
+
+
+// Claims counter half HW_SCT_L or HW_SCT_H, halted and cleared, with its
+// state, limit and halt events reset. Returns 0 or the current holder.
+int hw_sct_claim_counter (hw_sct_owner_t* owner, int half)
+{
+	if (sct_halves[half]) {
+		return sct_halves[half]->user;
+	}
+	if (sct_other_user(NULL) == SCT_INACTIVE) {
+		sct_power(1);
+	}
+	sct_halves[half] = owner;
+
+	if (half == HW_SCT_H) {
+		LPC_SCT->CTRL_H = SCT_CTRL_HALT | SCT_CTRL_CLRCTR;
+		LPC_SCT->LIMIT_H = 0;
+		LPC_SCT->HALT_H = 0;
+		LPC_SCT->STOP_H = 0;
+		LPC_SCT->START_H = 0;
+		LPC_SCT->STATE_H = 0;
+	} else {
+		LPC_SCT->CTRL_L = SCT_CTRL_HALT | SCT_CTRL_CLRCTR;
+		LPC_SCT->LIMIT_L = 0;
+		LPC_SCT->HALT_L = 0;
+		LPC_SCT->STOP_L = 0;
+		LPC_SCT->START_L = 0;
+		LPC_SCT->STATE_L = 0;
+	}
+	return 0;
+}
+
+
+// Claims the whole SCT as one 32 bit counter, with both halves. Only
+// possible while nobody else holds anything. Returns 0 or a holder.
+int hw_sct_claim_unified (hw_sct_owner_t* owner)
+{
+	hw_sct_status_t user = sct_other_user(NULL);
+	if (user != SCT_INACTIVE) {
+		return user;
+	}
+	sct_power(1);
+	sct_halves[HW_SCT_L] = sct_halves[HW_SCT_H] = owner;
+	LPC_SCT->CONFIG = SCT_CONFIG_UNIFY;
+	return 0;
+}
+
+
+// Claims an output, which is fixed by the pin it is routed to. Returns 0 or
+// the current holder.
+int hw_sct_claim_output (hw_sct_owner_t* owner, int output)
+{
+	if (sct_outputs[output] && sct_outputs[output] != owner) {
+		return sct_outputs[output]->user;
+	}
+	sct_outputs[output] = owner;
+	return 0;
+}
+
+
+// Reserves `count` consecutive disabled events, so one DMA burst can write
+// them all. Returns the first index, or -1 if there is no such run.
+int hw_sct_alloc_events (hw_sct_owner_t* owner, int count)
+{
+	int i, j;
+	for (i = 0; i + count <= HW_SCT_EVENTS; i++) {
+		for (j = 0; j < count && !sct_events[i + j]; j++) { }
+		if (j < count) {
+			i += j;
+			continue;
+		}
+		for (j = i; j < i + count; j++) {
+			sct_events[j] = owner;
+			owner->events |= (1 << j);
+			LPC_SCT->EVENT[j].STATE = 0;
+			LPC_SCT->EVENT[j].CTRL = 0;
+			LPC_SCT->EVFLAG = (1 << j);
+		}
+		return i;
+	}
+	return -1;
+}
+
+
+// Reserves a disabled event. Returns its index, or -1 if none is free.
+int hw_sct_alloc_event (hw_sct_owner_t* owner)
+{
+	return hw_sct_alloc_events(owner, 1);
+}
+
+
+// Reserves a match (or, with `capture`, capture) register of a counter
+// half. Returns its index, or -1 if none is free.
+int hw_sct_alloc_reg (hw_sct_owner_t* owner, int half, int capture)
+{
+	int i;
+	for (i = 0; i < HW_SCT_REGS; i++) {
+		if (!sct_regs[half][i]) {
+			sct_regs[half][i] = owner;
+			if (half == HW_SCT_H) {
+				LPC_SCT->REGMODE_H = (LPC_SCT->REGMODE_H & ~(1 << i)) | ((capture ? 1 : 0) << i);
+				LPC_SCT->CAPCTRL_H[i] = 0;
+			} else {
+				LPC_SCT->REGMODE_L = (LPC_SCT->REGMODE_L & ~(1 << i)) | ((capture ? 1 : 0) << i);
+				LPC_SCT->CAPCTRL_L[i] = 0;
+			}
+			return i;
+		}
+	}
+	return -1;
+}
+
+
+// Reserves one of the SCT's two DMA requests, fed to GPDMA as SCT0_CONN or
+// SCT1_CONN, with no events selected. Returns its index, or -1 if both are
+// taken.
+int hw_sct_alloc_dma (hw_sct_owner_t* owner)
+{
+	int i;
+	for (i = 0; i < HW_SCT_DMAREQS; i++) {
+		if (!sct_dmareqs[i]) {
+			sct_dmareqs[i] = owner;
+			hw_sct_dma_events(i, 0);
+			return i;
+		}
+	}
+	return -1;
+}
+
+
+// Selects the events that raise DMA request `dma`
+void hw_sct_dma_events (int dma, uint32_t events)
+{
+	if (dma == 0) {
+		LPC_SCT->DMAREQ0 = events;
+	} else {
+		LPC_SCT->DMAREQ1 = events;
+	}
+}
+
+
+// Disables and hands back an event
+void hw_sct_free_event (hw_sct_owner_t* owner, int event)
+{
+	if (event < 0 || sct_events[event] != owner) {
+		return;
+	}
+	__disable_irq();
+	LPC_SCT->EVEN &= ~(1 << event);
+	LPC_SCT->EVENT[event].STATE = 0;
+	LPC_SCT->EVENT[event].CTRL = 0;
+	LPC_SCT->EVFLAG = (1 << event);
+	owner->events &= ~(1 << event);
+	sct_events[event] = NULL;
+	__enable_irq();
+}
+
+
+// Hands back a DMA request, with no events selected
+void hw_sct_free_dma (hw_sct_owner_t* owner, int dma)
+{
+	if (dma < 0 || sct_dmareqs[dma] != owner) {
+		return;
+	}
+	hw_sct_dma_events(dma, 0);
+	sct_dmareqs[dma] = NULL;
+}
+
+
+// Hands back a match/capture register
+void hw_sct_free_reg (hw_sct_owner_t* owner, int half, int reg)
+{
+	if (reg < 0 || sct_regs[half][reg] != owner) {
+		return;
+	}
+	if (half == HW_SCT_H) {
+		LPC_SCT->CAPCTRL_H[reg] = 0;
+	} else {
+		LPC_SCT->CAPCTRL_L[reg] = 0;
+	}
+	sct_regs[half][reg] = NULL;
+}
+
+
+// Halts and hands back one counter half, for owners that run the halves
+// separately. The SCT is reset with the last owner gone.
+void hw_sct_release_counter (hw_sct_owner_t* owner, int half)
+{
+	if (sct_halves[half] != owner) {
+		return;
+	}
+	if (half == HW_SCT_H) {
+		LPC_SCT->CTRL_H = SCT_CTRL_HALT;
+	} else {
+		LPC_SCT->CTRL_L = SCT_CTRL_HALT;
+	}
+	sct_halves[half] = NULL;
+
+	if (sct_other_user(NULL) == SCT_INACTIVE) {
+		sct_power(0);
+	}
+}
+
+
+// Hands back everything `owner` holds: its counter halves are halted, its
+// events disabled, its outputs driven low and its DMA requests cleared. The SCT is reset with the
+// last owner gone.
+void hw_sct_release (hw_sct_owner_t* owner)
+{
+	int i;
+	for (i = 0; i < 2; i++) {
+		if (sct_halves[i] == owner) {
+			if (i == HW_SCT_H) {
+				LPC_SCT->CTRL_H = SCT_CTRL_HALT;
+			} else {
+				LPC_SCT->CTRL_L = SCT_CTRL_HALT;
+			}
+			sct_halves[i] = NULL;
+		}
+	}
+	for (i = 0; i < HW_SCT_EVENTS; i++) {
+		hw_sct_free_event(owner, i);
+	}
+	for (i = 0; i < HW_SCT_OUTPUTS; i++) {
+		if (sct_outputs[i] == owner) {
+			LPC_SCT->OUT[i].SET = 0;
+			LPC_SCT->OUT[i].CLR = 0;
+			LPC_SCT->RES &= ~(3 << (2 * i));
+			LPC_SCT->OUTPUT &= ~(1 << i);
+			sct_outputs[i] = NULL;
+		}
+	}
+	for (i = 0; i < HW_SCT_REGS; i++) {
+		hw_sct_free_reg(owner, HW_SCT_L, i);
+		hw_sct_free_reg(owner, HW_SCT_H, i);
+	}
+	for (i = 0; i < HW_SCT_DMAREQS; i++) {
+		if (sct_dmareqs[i] == owner) {
+			hw_sct_dma_events(i, 0);
+			sct_dmareqs[i] = NULL;
+		}
+	}
+
+	if (sct_other_user(NULL) == SCT_INACTIVE) {
+		sct_power(0);
+	}
+}
+
+
+// Halts a counter half, or sets it running from zero with the peripheral
+// clock divided by `prescale` (1 to 256)
+void hw_sct_counter (int half, uint32_t prescale, int run)
+{
+	uint16_t ctrl = SCT_CTRL_PRE(prescale) | SCT_CTRL_CLRCTR | (run ? 0 : SCT_CTRL_HALT);
+	if (half == HW_SCT_H) {
+		LPC_SCT->CTRL_H = ctrl;
+	} else {
+		LPC_SCT->CTRL_L = ctrl;
+	}
+}
+
+
+// Sets a match register and its reload value
+void hw_sct_match (int half, int reg, uint16_t value)
+{
+	if (half == HW_SCT_H) {
+		LPC_SCT->MATCH_H[reg] = value;
+		LPC_SCT->MATCHREL_H[reg] = value;
+	} else {
+		LPC_SCT->MATCH_L[reg] = value;
+		LPC_SCT->MATCHREL_L[reg] = value;
+	}
+}
+
+
+// Sets a match register and its reload value of the unified counter
+void hw_sct_match_unified (int reg, uint32_t value)
+{
+	LPC_SCT->MATCH[reg].U = value;
+	LPC_SCT->MATCHREL[reg].U = value;
+}
+
+
+// Selects the events that latch a half's counter into a capture register
+void hw_sct_capture_events (int half, int reg, uint32_t events)
+{
+	if (half == HW_SCT_H) {
+		LPC_SCT->CAPCTRL_H[reg] = events;
+	} else {
+		LPC_SCT->CAPCTRL_L[reg] = events;
+	}
+}
+
+
+uint16_t hw_sct_capture (int half, int reg)
+{
+	return half == HW_SCT_H ? LPC_SCT->CAP_H[reg] : LPC_SCT->CAP_L[reg];
+}
+
+
+// Each owner handles its own event flags
+void SCT_IRQHandler (void)
+{
+	uint32_t flags = LPC_SCT->EVFLAG & LPC_SCT->EVEN;
+	while (flags) {
+		int event = __builtin_ctz(flags);
+		hw_sct_owner_t* owner = sct_events[event];
+		if (!owner || !owner->irq) {
+			LPC_SCT->EVFLAG = (1 << event);
+			flags &= ~(1 << event);
+			continue;
+		}
+		uint32_t mine = flags & owner->events;
+		flags &= ~mine;
+		owner->irq(mine);
+	}
+}
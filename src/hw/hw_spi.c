@@ -8,6 +8,7 @@
 // except according to those terms.
 
 #include "hw.h"
+#include "trace.h"
 #include "variant.h"
 #include "lpc18xx_cgu.h"
 
@@ -41,7 +42,9 @@ int hw_spi_transfer_sync (size_t port, const uint8_t *txbuf, uint8_t *rxbuf, siz
 	xferConfig.rx_data = rxbuf;
 	xferConfig.length = buf_len;
 
+	TRACE_BEGIN(TRACE_SPI_SYNC);
 	SSP_ReadWrite(SPIx->port, &xferConfig, SSP_TRANSFER_POLLING);
+	TRACE_END(TRACE_SPI_SYNC);
 
 	// Return the data
 	// Caller is responsible for sizing upon return
@@ -10,6 +10,7 @@
 #include "hw.h"
 #include "tm.h"
 #include "colony.h"
+#include "event_stats.h"
 
 static const uint8_t tx_chan = 0;
 static const uint8_t rx_chan = 1;
@@ -73,6 +74,7 @@ void default_complete_cb() {
     spi_async_status.chunk_offset = 0;
     
     if (--spi_async_status.repeat == 0) {
+      event_stats_trigger(EVENT_SOURCE_SPI_ASYNC);
       tm_event_trigger(&async_spi_event);
       return;
     }
@@ -197,6 +199,7 @@ void async_spi_callback (void) {
   lua_State* L = tm_lua_state;
   if (!L) return;
 
+  event_stats_begin(EVENT_SOURCE_SPI_ASYNC);
   // Push the _colony_emit helper function onto the stack
   lua_getglobal(L, "_colony_emit");
   // The process message identifier
@@ -207,6 +210,7 @@ void async_spi_callback (void) {
   hw_spi_async_cleanup();
   // Call _colony_emit to run the JS callback
   tm_checked_call(L, 2);
+  event_stats_end();
 }
 
 int hw_spi_transfer_setup (size_t port, size_t buffer_length, const uint8_t *txbuf, uint8_t *rxbuf, 
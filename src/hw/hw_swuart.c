@@ -139,6 +139,11 @@ static void swu_setup_tx(hw_swuart_bitlength_t bit_length) {
 **
 ******************************************************************************/
 int hw_swuart_transmit(unsigned char const* ptr_out, uint32_t data_size, hw_swuart_bitlength_t bit_length) {
+  // TIMER1 may be pacing a logic capture instead
+  if (hw_timer_user(1) != HW_TIMER_SWUART) {
+    return -1;
+  }
+
   // This is only needed for TX, RX will mess up if this bit is set
   LPC_TIMER1->MCR = 2;// TC will be reset if MR0 matches it.
 
@@ -394,6 +399,11 @@ void swu_rx_callback(void)
 **
 ******************************************************************************/
 int hw_swuart_enable() {
+  // TIMER1 is busy while a logic capture runs
+  if (hw_timer_claim(1, HW_TIMER_SWUART)) {
+    return -1;
+  }
+
   //setup the software uart
   swu_tx_cnt = 0; //no data in the swu tx FIFO
   tx_fifo_wr_ind = 0; //last char written was on 0
@@ -427,6 +437,16 @@ int hw_swuart_enable() {
 }
 
 int hw_swuart_disable(){
+  if (hw_timer_user(1) != HW_TIMER_SWUART) {
+    return 0;
+  }
   NVIC_DisableIRQ(TIMER1_IRQn);
+  LPC_TIMER1->TCR = 0x00; //stop the timer
+  LPC_TIMER1->MCR = 0;
+  LPC_TIMER1->EMR = 0;
+  LPC_TIMER1->CCR = 0;
+  LPC_TIMER1->IR = 0x0FF;
+  NVIC_ClearPendingIRQ(TIMER1_IRQn);
+  hw_timer_release(1, HW_TIMER_SWUART);
   return 0;
 }
@@ -0,0 +1,48 @@
+// Copyright 2014 Technical Machine, Inc. See the COPYRIGHT
+// file at the top-level directory of this distribution.
+//
+// Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+// http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+// <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+// option. This file may not be copied, modified, or distributed
+// except according to those terms.
+
+// Match timer allocator. TIMER1 and TIMER2 each have more than one driver
+// that could use them, so a driver claims the timer before programming it
+// and releases it once the timer is stopped. TIMER0 (hw_wait) and TIMER3
+// (uptime) have a single owner and aren't tracked.
+
+#include "hw.h"
+#include "LPC18xx.h"
+
+static volatile hw_timer_user_t timer_users[HW_TIMER_COUNT];
+
+// Claims `timer` for `user`. Returns 0, also if `user` already holds it,
+// or the current holder.
+int hw_timer_claim (int timer, hw_timer_user_t user)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	hw_timer_user_t holder = timer_users[timer];
+	if (holder == HW_TIMER_FREE) {
+		timer_users[timer] = user;
+	}
+	__set_PRIMASK(primask);
+	return holder == HW_TIMER_FREE || holder == user ? 0 : holder;
+}
+
+// Hands `timer` back, if `user` holds it. Safe from an interrupt.
+void hw_timer_release (int timer, hw_timer_user_t user)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	if (timer_users[timer] == user) {
+		timer_users[timer] = HW_TIMER_FREE;
+	}
+	__set_PRIMASK(primask);
+}
+
+hw_timer_user_t hw_timer_user (int timer)
+{
+	return timer_users[timer];
+}
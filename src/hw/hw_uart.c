@@ -15,6 +15,8 @@
 #include <stdio.h>
 #include "tessel.h"
 #include "colony.h"
+#include "event_stats.h"
+#include "trace.h"
 
 /* buffer size definition */
 #define UART_RING_BUFSIZE 2048
@@ -119,7 +121,10 @@ void process_UART_interrupt(UART* uart) {
 
   // Receive Data Available or Character time-out
   if ((tmp == UART_IIR_INTID_RDA) || (tmp == UART_IIR_INTID_CTI)){
+      TRACE_BEGIN(TRACE_UART_RX);
       UART_IntReceive(uart);
+      TRACE_END(TRACE_UART_RX);
+      event_stats_trigger(EVENT_SOURCE_UART_RX);
       tm_event_trigger(&uart->rx_event);
   }
 
@@ -170,7 +175,8 @@ void uart_rx_event_callback(tm_event* event) {
 
   lua_State* L = tm_lua_state;
   if (!L) return;
-  
+
+  event_stats_begin(EVENT_SOURCE_UART_RX);
   int bytes_available = hw_uart_rx_available(uart);
 
   lua_getglobal(L, "_colony_emit");
@@ -180,6 +186,7 @@ void uart_rx_event_callback(tm_event* event) {
   int bytes_read = hw_uart_receive(portnum, buffer, bytes_available);
   assert(bytes_read == bytes_available);
   tm_checked_call(L, 3);
+  event_stats_end();
 }
 
 /********************************************************************//**
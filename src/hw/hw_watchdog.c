@@ -0,0 +1,249 @@
+// Copyright 2014 Technical Machine, Inc. See the COPYRIGHT
+// file at the top-level directory of this distribution.
+//
+// Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+// http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+// <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+// option. This file may not be copied, modified, or distributed
+// except according to those terms.
+
+// Event loop stall detector on the windowed watchdog. The loop feeds it each
+// time it comes back to hw_wait_for_event, and a periodic callback feeds it
+// while the loop sleeps. If neither happens within the timeout, the warning
+// interrupt records the PC it preempted and installs a Lua hook that reports
+// the JS stack as soon as the VM runs again.
+//
+// The WWDT counts the 12MHz IRC divided by 4 and WARNINT is at most 0x3FF
+// ticks, so the warning comes about 340us before the timeout. WDEN and
+// WDRESET cannot be cleared once set, so "stopping" the watchdog only turns
+// the warning handler into a plain feed, and reset mode is armed from the
+// warning handler itself rather than up front.
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "LPC18xx.h"
+#include "lpc18xx_wwdt.h"
+#include "hw.h"
+#include "tm.h"
+#include "colony.h"
+#include "crash.h"
+
+#define WATCHDOG_TICKS_PER_MS 3000
+#define WATCHDOG_MAX_MS (WWDT_TIMEOUT_MAX / WATCHDOG_TICKS_PER_MS)
+
+static const char* watchdog_mode_names[] = { "off", "report", "recover", "reset" };
+
+static volatile hw_watchdog_mode_t watchdog_mode = HW_WATCHDOG_OFF;
+static uint32_t watchdog_timeout_ms = 0;
+static uint8_t watchdog_running = 0;
+static volatile uint8_t watchdog_idle = 0;
+static hw_periodic_t watchdog_periodic;
+
+// Set by the warning handler, cleared once the stall has been reported.
+static volatile uint8_t watchdog_stalled = 0;
+static uint32_t watchdog_pc = 0;
+static uint32_t watchdog_lr = 0;
+
+// Hook that was installed when the warning handler took over.
+static lua_State* watchdog_hooked = NULL;
+static lua_Hook watchdog_saved_hook = NULL;
+static int watchdog_saved_mask = 0;
+static int watchdog_saved_count = 0;
+
+static void watchdog_feed ()
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	WWDT_Feed();
+	__set_PRIMASK(primask);
+}
+
+static void watchdog_unhook ()
+{
+	if (watchdog_hooked) {
+		lua_sethook(watchdog_hooked, watchdog_saved_hook, watchdog_saved_mask, watchdog_saved_count);
+		watchdog_hooked = NULL;
+	}
+}
+
+static void watchdog_report (const char* stack)
+{
+	char* report = NULL;
+	int len = asprintf(&report, "Event loop stalled for over %lums (%s) at pc 0x%08lx, lr 0x%08lx\n%s",
+		(unsigned long) watchdog_timeout_ms, watchdog_mode_names[watchdog_mode],
+		(unsigned long) watchdog_pc, (unsigned long) watchdog_lr, stack);
+	if (len > 0) {
+		hw_send_usb_msg('H', (uint8_t*) report, len);
+	}
+	free(report);
+	watchdog_stalled = 0;
+}
+
+static void watchdog_hook (lua_State* L, lua_Debug* ar)
+{
+	(void) ar;
+	watchdog_unhook();
+
+	if (watchdog_mode == HW_WATCHDOG_RESET) {
+		crash_capture_lua();
+	}
+
+	lua_getfield(L, LUA_GLOBALSINDEX, "debug");
+	lua_getfield(L, -1, "traceback");
+	lua_remove(L, -2);
+	if (lua_isfunction(L, -1)) {
+		lua_call(L, 0, 1);
+	}
+	const char* stack = lua_isstring(L, -1) ? lua_tostring(L, -1) : "";
+	watchdog_report(stack);
+	lua_pop(L, 1);
+
+	if (watchdog_mode == HW_WATCHDOG_RESET) {
+		// The report may not make it out before the reset, but the crash
+		// record will be there on the next boot.
+		crash_finish();
+	} else if (watchdog_mode == HW_WATCHDOG_RECOVER) {
+		luaL_error(L, "event loop stalled for over %dms", (int) watchdog_timeout_ms);
+	}
+}
+
+// Called from WDT_IRQHandler with the exception frame it preempted.
+__attribute__ ((used)) void hw_watchdog_warning (uint32_t* frame, uint32_t exc_return)
+{
+	// WDINT clears by writing one, WDTOF by writing zero.
+	LPC_WWDT->MOD = (LPC_WWDT->MOD & ~WWDT_WDMOD_WDTOF) | WWDT_WDMOD_WDINT;
+
+	if (watchdog_mode == HW_WATCHDOG_OFF) {
+		watchdog_feed();
+		return;
+	}
+
+	if (watchdog_stalled) {
+		if (watchdog_mode == HW_WATCHDOG_RESET) {
+			// Still stuck after the grace period; let the reset happen.
+			return;
+		}
+		watchdog_feed();
+		return;
+	}
+
+	watchdog_stalled = 1;
+	watchdog_pc = frame[6];
+	watchdog_lr = frame[5];
+
+	if (watchdog_mode == HW_WATCHDOG_RESET) {
+		// Save what we know now in case the Lua hook never gets to run.
+		crash_capture(CRASH_WATCHDOG, frame, exc_return, "event loop stalled");
+		crash_commit();
+		LPC_WWDT->MOD |= WWDT_WDMOD_WDRESET;
+	}
+
+	// Give the hook one more timeout to run.
+	watchdog_feed();
+
+	lua_State* L = tm_lua_state;
+	if (L && !watchdog_hooked) {
+		watchdog_saved_hook = lua_gethook(L);
+		watchdog_saved_mask = lua_gethookmask(L);
+		watchdog_saved_count = lua_gethookcount(L);
+		watchdog_hooked = L;
+		lua_sethook(L, watchdog_hook, LUA_MASKCOUNT, 1);
+	}
+}
+
+__attribute__ ((naked)) void WDT_IRQHandler (void)
+{
+	__asm volatile (
+		"tst lr, #4\n"
+		"ite eq\n"
+		"mrseq r0, msp\n"
+		"mrsne r0, psp\n"
+		"mov r1, lr\n"
+		"b hw_watchdog_warning\n"
+	);
+}
+
+static void watchdog_periodic_tick (hw_periodic_t* periodic)
+{
+	(void) periodic;
+	if (watchdog_idle || watchdog_mode == HW_WATCHDOG_OFF) {
+		watchdog_feed();
+	}
+}
+
+int hw_watchdog_start (uint32_t timeout_ms, hw_watchdog_mode_t mode)
+{
+	if (mode == HW_WATCHDOG_OFF) {
+		hw_watchdog_stop();
+		return 0;
+	}
+	if (timeout_ms == 0 || timeout_ms > WATCHDOG_MAX_MS) {
+		return -1;
+	}
+
+	watchdog_timeout_ms = timeout_ms;
+	watchdog_stalled = 0;
+
+	__disable_irq();
+	if (!watchdog_running) {
+		WWDT_Init();
+		LPC_WWDT->WARNINT = WWDT_WARNINT_MAX;
+		LPC_WWDT->MOD = WWDT_WDMOD_WDEN;
+		NVIC_SetPriority(WWDT_IRQn, 0);
+		NVIC_EnableIRQ(WWDT_IRQn);
+		watchdog_running = 1;
+	}
+	LPC_WWDT->TC = timeout_ms * WATCHDOG_TICKS_PER_MS;
+	watchdog_mode = mode;
+	WWDT_Feed();
+	__enable_irq();
+
+	// Feed while idle at a quarter of the timeout.
+	hw_periodic_start(&watchdog_periodic, timeout_ms / 4, watchdog_periodic_tick);
+	return 0;
+}
+
+void hw_watchdog_stop (void)
+{
+	if (!watchdog_running) {
+		return;
+	}
+
+	// The watchdog cannot be disabled, so stretch it to the longest timeout
+	// and feed it rarely, leaving SysTick nearly idle.
+	watchdog_mode = HW_WATCHDOG_OFF;
+	watchdog_unhook();
+	watchdog_stalled = 0;
+
+	__disable_irq();
+	LPC_WWDT->TC = WATCHDOG_MAX_MS * WATCHDOG_TICKS_PER_MS;
+	WWDT_Feed();
+	__enable_irq();
+
+	hw_periodic_start(&watchdog_periodic, WATCHDOG_MAX_MS / 4, watchdog_periodic_tick);
+}
+
+// Called each time the event loop gets back to hw_wait_for_event.
+void hw_watchdog_feed (void)
+{
+	if (!watchdog_running) {
+		return;
+	}
+	watchdog_feed();
+
+	if (watchdog_stalled) {
+		// The loop came back without the hook running, so the stall was
+		// outside Lua. Report it without a JS stack.
+		watchdog_unhook();
+		watchdog_report("(no JS stack: stalled outside the Lua VM)");
+		if (watchdog_mode == HW_WATCHDOG_RESET) {
+			crash_finish();
+		}
+	}
+}
+
+void hw_watchdog_idle (int idle)
+{
+	watchdog_idle = idle;
+}
@@ -22,6 +22,9 @@
 #include "tessel.h"
 #include "tm.h"
 #include "tessel_wifi.h"
+#include "event_stats.h"
+#include "trace.h"
+#include "crash.h"
 
 #include "audio-vs1053b.h"
 #include "gps-a2235h.h"
@@ -86,6 +89,75 @@ static int l_hw_reset_board()
 	return 0;
 }
 
+static int l_hw_gc_configure(lua_State* L)
+{
+	int budget_us = (int)lua_tonumber(L, ARG1);
+	int step_kb = (int)lua_tonumber(L, ARG1 + 1);
+	int pause = (int)lua_tonumber(L, ARG1 + 2);
+	int stepmul = (int)lua_tonumber(L, ARG1 + 3);
+
+	tessel_gc_configure(budget_us, step_kb, pause, stepmul);
+	return 0;
+}
+
+static int l_hw_event_stats(lua_State* L)
+{
+	char* stats = event_stats_json();
+	if (!stats) {
+		return 0;
+	}
+	lua_pushstring(L, stats);
+	free(stats);
+	return 1;
+}
+
+static int l_hw_event_stats_reset(lua_State* L)
+{
+	(void) L;
+	event_stats_reset();
+	return 0;
+}
+
+static int l_hw_cycles(lua_State* L)
+{
+	lua_pushnumber(L, trace_cycles());
+	return 1;
+}
+
+static int l_hw_crash_report(lua_State* L)
+{
+	char* report = crash_report_json();
+	if (!report) {
+		return 0;
+	}
+	lua_pushstring(L, report);
+	free(report);
+	return 1;
+}
+
+static int l_hw_crash_report_clear(lua_State* L)
+{
+	(void) L;
+	crash_report_clear();
+	return 0;
+}
+
+static int l_hw_watchdog_start(lua_State* L)
+{
+	uint32_t timeout_ms = (uint32_t)lua_tonumber(L, ARG1);
+	hw_watchdog_mode_t mode = (hw_watchdog_mode_t)lua_tonumber(L, ARG1 + 1);
+
+	lua_pushnumber(L, hw_watchdog_start(timeout_ms, mode));
+	return 1;
+}
+
+static int l_hw_watchdog_stop(lua_State* L)
+{
+	(void) L;
+	hw_watchdog_stop();
+	return 0;
+}
+
 
 // spi
 
@@ -127,6 +199,8 @@ static int l_hw_spi_transfer(lua_State* L)
 		lua_pushnumber(L, -1);
 		return 1;
 	}
+	TRACE_BEGIN(TRACE_LUA_SPI);
+
 	// Grab the spi port number
 	uint32_t port = (uint32_t)lua_tonumber(L, ARG1);
 	// Create the tx/rx buffers
@@ -163,6 +237,7 @@ static int l_hw_spi_transfer(lua_State* L)
 	uint32_t cs_delay_us = (uint32_t) lua_tonumber(L, ARG1 + 7);
 	// Begin the transfer
 	hw_spi_transfer(port, buffer_length, txbuf, rxbuf, txref, rxref, chunk_size, repeat, chip_select, cs_delay_us, NULL);
+	TRACE_END(TRACE_LUA_SPI);
 	// Push a success code onto the stack
 	lua_pushnumber(L, 0);
 	return 1;
@@ -459,25 +534,66 @@ static int l_hw_digital_get_mode(lua_State* L)
 	return 1;
 }
 
+// Pins are passed as a buffer of pin numbers; bit i of the value is pins[i].
+
+static int l_hw_digital_write_pins(lua_State* L)
+{
+	size_t count = 0;
+	const uint8_t* pins = colony_toconstdata(L, ARG1, &count);
+	uint32_t values = (uint32_t)lua_tonumber(L, ARG1 + 1);
+
+	lua_pushnumber(L, hw_digital_write_pins(pins, count, values));
+
+	return 1;
+}
+
+static int l_hw_digital_read_pins(lua_State* L)
+{
+	size_t count = 0;
+	const uint8_t* pins = colony_toconstdata(L, ARG1, &count);
+	uint32_t values = 0;
+
+	if (hw_digital_read_pins(pins, count, &values) < 0) {
+		lua_pushnumber(L, -1);
+	} else {
+		lua_pushnumber(L, values);
+	}
+
+	return 1;
+}
+
 
 // SCT
 
 static int l_sct_read_pulse(lua_State* L)
 {
-	if (hw_sct_status != SCT_INACTIVE) {
-		lua_pushnumber(L, hw_sct_status);
-		return 1;
-	}
+	uint8_t pin = (uint8_t)lua_tonumber(L, ARG1);
+	hw_sct_pulse_type_t type = (hw_sct_pulse_type_t)lua_tonumber(L, ARG1 + 1);
+	uint32_t timeout = (uint32_t)lua_tonumber(L, ARG1 + 2);
 
-	hw_sct_status = SCT_READPULSE;
+	lua_pushnumber(L, sct_read_pulse(pin, type, timeout));
+	return 1;
+}
 
-	hw_sct_pulse_type_t type = (hw_sct_pulse_type_t)lua_tonumber(L, ARG1);
-	uint32_t timeout = (uint32_t)lua_tonumber(L, ARG1 + 1);
+static int l_sct_read_pulses(lua_State* L)
+{
+	uint8_t pin = (uint8_t)lua_tonumber(L, ARG1);
+	uint32_t batch = (uint32_t)lua_tonumber(L, ARG1 + 1);
+	uint32_t timeout = (uint32_t)lua_tonumber(L, ARG1 + 2);
+	int continuous = lua_toboolean(L, ARG1 + 3);
 
-	lua_pushnumber(L, sct_read_pulse(type,timeout));
+	lua_pushnumber(L, sct_read_pulses(pin, batch, timeout, continuous));
 	return 1;
 }
 
+static int l_sct_read_pulses_stop(lua_State* L)
+{
+	uint8_t pin = (uint8_t)lua_tonumber(L, ARG1);
+
+	sct_read_pulses_stop(pin);
+	return 0;
+}
+
 
 // interrupts
 
@@ -521,6 +637,108 @@ static int l_hw_acquire_available_interrupt(lua_State* L)
 }
 
 
+// gpio group interrupts
+
+static int l_hw_gint_watch(lua_State* L)
+{
+	int index = (int)lua_tonumber(L, ARG1);
+	size_t count = 0;
+	const uint8_t* pins = colony_toconstdata(L, ARG1 + 1, &count);
+	uint32_t levels = 0;
+
+	if (hw_gint_watch(index, pins, count, &levels) < 0) {
+		lua_pushnumber(L, -1);
+	} else {
+		lua_pushnumber(L, levels);
+	}
+
+	return 1;
+}
+
+static int l_hw_gint_unwatch(lua_State* L)
+{
+	int index = (int)lua_tonumber(L, ARG1);
+
+	lua_pushnumber(L, hw_gint_unwatch(index));
+
+	return 1;
+}
+
+// edge counters
+
+static int l_hw_counter_start(lua_State* L)
+{
+	int index = (int)lua_tonumber(L, ARG1);
+	int pin = (int)lua_tonumber(L, ARG1 + 1);
+	int mode = (int)lua_tonumber(L, ARG1 + 2);
+	uint32_t window_ms = (uint32_t)lua_tonumber(L, ARG1 + 3);
+
+	lua_pushnumber(L, hw_counter_start(index, pin, mode, window_ms));
+
+	return 1;
+}
+
+static int l_hw_counter_stop(lua_State* L)
+{
+	int index = (int)lua_tonumber(L, ARG1);
+
+	lua_pushnumber(L, hw_counter_stop(index));
+
+	return 1;
+}
+
+// logic analyzer
+
+static int l_hw_logic_start(lua_State* L)
+{
+	size_t count = 0;
+	const uint8_t* pins = colony_toconstdata(L, ARG1, &count);
+	uint32_t rate = (uint32_t)lua_tonumber(L, ARG1 + 1);
+	hw_logic_trigger_t trigger = (hw_logic_trigger_t)lua_tonumber(L, ARG1 + 2);
+	uint32_t trigger_mask = (uint32_t)lua_tonumber(L, ARG1 + 3);
+	uint32_t trigger_value = (uint32_t)lua_tonumber(L, ARG1 + 4);
+	uint32_t pre = (uint32_t)lua_tonumber(L, ARG1 + 5);
+	uint32_t post = (uint32_t)lua_tonumber(L, ARG1 + 6);
+	int usb = lua_toboolean(L, ARG1 + 7);
+
+	lua_pushnumber(L, hw_logic_start(pins, count, rate, trigger, trigger_mask, trigger_value, pre, post, usb));
+
+	return 1;
+}
+
+static int l_hw_logic_stop(lua_State* L)
+{
+	(void) L;
+	hw_logic_stop();
+	return 0;
+}
+
+// pattern generator
+
+static int l_hw_pattern_start(lua_State* L)
+{
+	size_t count = 0;
+	const uint8_t* pins = colony_toconstdata(L, ARG1, &count);
+	uint32_t rate = (uint32_t)lua_tonumber(L, ARG1 + 1);
+	size_t data_len = 0;
+	const uint8_t* data = colony_toconstdata(L, ARG1 + 2, &data_len);
+	size_t segments_len = 0;
+	const uint8_t* segments = colony_toconstdata(L, ARG1 + 3, &segments_len);
+	int loop = lua_toboolean(L, ARG1 + 4);
+
+	lua_pushnumber(L, hw_pattern_start(pins, count, rate, data, data_len, segments, segments_len, loop));
+
+	return 1;
+}
+
+static int l_hw_pattern_stop(lua_State* L)
+{
+	(void) L;
+	hw_pattern_stop();
+	return 0;
+}
+
+
 // Old interrupt stuff:
 // static int l_hw_interrupt_record (lua_State* L)
 // {
@@ -617,6 +835,126 @@ static int l_hw_pwm_pin_pulsewidth(lua_State* L)
 	return 1;
 }
 
+static int l_hw_pwm_group_period(lua_State *L) {
+	int group = (int)lua_tonumber(L, ARG1);
+	uint32_t period = (uint32_t)lua_tonumber(L, ARG1 + 1);
+	lua_pushnumber(L, hw_pwm_group_period(group, period));
+	return 1;
+}
+
+static int l_hw_pwm_pin_group(lua_State *L) {
+	size_t pin = (size_t)lua_tonumber(L, ARG1);
+	int group = (int)lua_tonumber(L, ARG1 + 1);
+	lua_pushnumber(L, hw_pwm_pin_group(pin, group));
+	return 1;
+}
+
+// pwm_pin_sequence(pin, pulsewidths, repeat) with pulse widths as 32 bit
+// little endian words
+static int l_hw_pwm_pin_sequence(lua_State *L) {
+	size_t pin = (size_t)lua_tonumber(L, ARG1);
+	size_t len = 0;
+	const uint8_t* buf = colony_toconstdata(L, ARG1 + 1, &len);
+	int repeat = lua_toboolean(L, ARG1 + 2);
+
+	size_t count = len / sizeof(uint32_t);
+	uint32_t* pulsewidths = malloc(count * sizeof(uint32_t) + 1);
+	if (!pulsewidths) {
+		lua_pushnumber(L, -1);
+		return 1;
+	}
+	memcpy(pulsewidths, buf, count * sizeof(uint32_t));
+	int ret = hw_pwm_pin_sequence(pin, pulsewidths, count, repeat);
+	free(pulsewidths);
+	lua_pushnumber(L, ret);
+	return 1;
+}
+
+static int l_hw_pwm_sequence_stop(lua_State *L) {
+	(void) L;
+	hw_pwm_sequence_stop();
+	return 0;
+}
+
+// motor control pwm
+
+// mcpwm_start(pins, period, deadtime, flags)
+static int l_hw_mcpwm_start(lua_State *L) {
+	size_t count = 0;
+	const uint8_t* pins = colony_toconstdata(L, ARG1, &count);
+	uint32_t period = (uint32_t)lua_tonumber(L, ARG1 + 1);
+	uint32_t deadtime = (uint32_t)lua_tonumber(L, ARG1 + 2);
+	int flags = (int)lua_tonumber(L, ARG1 + 3);
+	lua_pushnumber(L, hw_mcpwm_start(pins, count, period, deadtime, flags));
+	return 1;
+}
+
+static int l_hw_mcpwm_pulsewidth(lua_State *L) {
+	int channel = (int)lua_tonumber(L, ARG1);
+	uint32_t pulsewidth = (uint32_t)lua_tonumber(L, ARG1 + 1);
+	lua_pushnumber(L, hw_mcpwm_pulsewidth(channel, pulsewidth));
+	return 1;
+}
+
+static int l_hw_mcpwm_commutate(lua_State *L) {
+	uint32_t pattern = (uint32_t)lua_tonumber(L, ARG1);
+	lua_pushnumber(L, hw_mcpwm_commutate(pattern));
+	return 1;
+}
+
+static int l_hw_mcpwm_stop(lua_State *L) {
+	(void) L;
+	hw_mcpwm_stop();
+	return 0;
+}
+
+// quadrature encoder
+
+// qei_start(pha, phb, idx, flags, max_position, velocity_us, filter)
+static int l_hw_qei_start(lua_State *L) {
+	int pha = (int)lua_tonumber(L, ARG1);
+	int phb = (int)lua_tonumber(L, ARG1 + 1);
+	int idx = (int)lua_tonumber(L, ARG1 + 2);
+	int flags = (int)lua_tonumber(L, ARG1 + 3);
+	uint32_t max_position = (uint32_t)lua_tonumber(L, ARG1 + 4);
+	uint32_t velocity_us = (uint32_t)lua_tonumber(L, ARG1 + 5);
+	uint32_t filter = (uint32_t)lua_tonumber(L, ARG1 + 6);
+	lua_pushnumber(L, hw_qei_start(pha, phb, idx, flags, max_position, velocity_us, filter));
+	return 1;
+}
+
+static int l_hw_qei_position(lua_State *L) {
+	lua_pushnumber(L, hw_qei_position());
+	return 1;
+}
+
+static int l_hw_qei_direction(lua_State *L) {
+	lua_pushnumber(L, hw_qei_direction());
+	return 1;
+}
+
+static int l_hw_qei_velocity(lua_State *L) {
+	lua_pushnumber(L, hw_qei_velocity());
+	return 1;
+}
+
+static int l_hw_qei_index(lua_State *L) {
+	lua_pushnumber(L, hw_qei_index());
+	return 1;
+}
+
+static int l_hw_qei_zero(lua_State *L) {
+	(void) L;
+	hw_qei_zero();
+	return 0;
+}
+
+static int l_hw_qei_stop(lua_State *L) {
+	(void) L;
+	hw_qei_stop();
+	return 0;
+}
+
 static int l_usb_send(lua_State* L)
 {
 	int tag = lua_tonumber(L, ARG1);
@@ -773,60 +1111,144 @@ static int l_gps_get_speed(lua_State* L) {
 	return 1;
 }
 
+// neopixel_animation_buffer(frameLength, pins, data...): one animation
+// buffer per pin, all strips animated in parallel
 static int l_neopixel_animation_buffer(lua_State* L) {
 
-	// if the SCT status is in use it's error time
-	if (hw_sct_status != SCT_INACTIVE) {
-		lua_pushnumber(L,hw_sct_status);
+	size_t frameLength =  lua_tonumber(L, ARG1);
+	size_t pinCount = 0;
+	const uint8_t* pins = colony_toconstdata(L, ARG1 + 1, &pinCount);
+	if (lua_gettop(L) - (ARG1 + 1) != (int) pinCount) {
+		lua_pushnumber(L, -1);
 		return 1;
 	}
 
-	// set the SCT state to be active with pulse read
-	hw_sct_status = SCT_NEOPIXEL;
+	// reserve the SCT H counter, events and outputs, or report who holds them
+	int status = neopixel_sct_claim(pins, pinCount);
+	if (status) {
+		lua_pushnumber(L, status);
+		return 1;
+	}
 
-	size_t frameLength =  lua_tonumber(L, ARG1);
+	neopixel_animation_status_t animations[MAX_SCT_CHANNELS] = {{{0}}};
+	neopixel_animation_status_t *channel_animations[MAX_SCT_CHANNELS];
 
-	size_t animationLength = 0;
-	size_t numFrames = 0;
-	const uint8_t* txbuf = colony_toconstdata(L, ARG1 + 1, &animationLength);
-	uint32_t frameRef = luaL_ref(L, LUA_REGISTRYINDEX);
+	for (size_t c = 0; c < pinCount; c++) {
+		size_t animationLength = 0;
+		const uint8_t* txbuf = colony_toconstdata(L, ARG1 + 2 + c, &animationLength);
+		channel_animations[c] = &animations[c];
 
-	// Allocate memory for an animation
-	neopixel_animation_status_t *channel_animation;
+		// If there are frames for this channel
+		if (frameLength != 0 && animationLength >= frameLength) {
 
-	// If there are frames for this channel
-	if (frameLength != 0 && animationLength != 0) {
+			size_t numFrames = animationLength/frameLength;
 
-		numFrames = animationLength/frameLength;
+			// Allocate memory for the frame pointers
+			const uint8_t **frames = malloc(sizeof(uint8_t *) * numFrames);
+			if (frames == NULL) {
+				continue;
+			}
 
-		// Allocate memory for an animation
-		channel_animation = malloc(sizeof(neopixel_animation_status_t));
+			// Iterate through frames
+			for (uint32_t i = 0; i < numFrames; i++) {
+				// Put the frame element onto the stack
+				frames[i] = (uint8_t *)&(txbuf[i * frameLength]);
+			}
 
-		// Allocate memory for the frame pointers
-		const uint8_t **frames = malloc(sizeof(uint8_t *) * numFrames);
-		// Allocate memory for the length of each frame (TODO Remove this. Don't need an array)
+			// Keep the buffer alive while it's being sent
+			lua_pushvalue(L, ARG1 + 2 + c);
 
-		// Iterate through frames
-		for (uint32_t i = 0; i < numFrames; i++) {
-			// Put the frame element onto the stack
-			frames[i] = (uint8_t *)&(txbuf[i * frameLength]);
+			animations[c].animation.frames = frames;
+			animations[c].animation.frameLength = frameLength;
+			animations[c].animation.frameRef = luaL_ref(L, LUA_REGISTRYINDEX);
+			animations[c].animation.numFrames = numFrames;
+			animations[c].framesSent = 0;
 		}
-
-		channel_animation->animation.frames = frames;
-		channel_animation->animation.frameLength = frameLength;
-		channel_animation->animation.frameRef = frameRef;
-		channel_animation->animation.numFrames = numFrames;
-		channel_animation->bytesSent = 0;
-		channel_animation->framesSent = 0;
 	}
 
-	// Begin the animation
-	writeAnimationBuffers(&channel_animation);
+	// Begin the animation, handing the SCT back if there's nothing to send
+	if (writeAnimationBuffers(channel_animations) < 0) {
+		neopixel_reset_animation();
+		lua_pushnumber(L, -1);
+		return 1;
+	}
 
 	lua_pushnumber(L,0);
 	return 1;
 }
 
+// neopixel_transform(gamma, brightness, order, pixelBrightness, fade):
+// gamma is an exponent or a 256 byte table, pixelBrightness may be empty
+static int l_neopixel_transform(lua_State* L) {
+	float gamma = 1;
+	const uint8_t* gammaTable = NULL;
+	if (lua_type(L, ARG1) == LUA_TNUMBER) {
+		gamma = lua_tonumber(L, ARG1);
+	} else {
+		size_t tableLength = 0;
+		gammaTable = colony_toconstdata(L, ARG1, &tableLength);
+		if (tableLength < 256) {
+			lua_pushnumber(L, -1);
+			return 1;
+		}
+	}
+	uint8_t brightness = (uint8_t) lua_tonumber(L, ARG1 + 1);
+	const char* order = lua_tostring(L, ARG1 + 2);
+	size_t pixelCount = 0;
+	const uint8_t* pixelScale = colony_toconstdata(L, ARG1 + 3, &pixelCount);
+	uint32_t fade = (uint32_t) lua_tonumber(L, ARG1 + 4);
+
+	lua_pushnumber(L, neopixel_set_transform(gamma, gammaTable, brightness, order, pixelScale, pixelCount, fade));
+	return 1;
+}
+
+// neopixel_stream_begin(frameLength, pins, udpPort): streams frames of
+// every strip in turn, written by neopixel_stream_write, USB or UDP
+static int l_neopixel_stream_begin(lua_State* L) {
+	size_t frameLength = lua_tonumber(L, ARG1);
+	size_t pinCount = 0;
+	const uint8_t* pins = colony_toconstdata(L, ARG1 + 1, &pinCount);
+	uint16_t udpPort = lua_tonumber(L, ARG1 + 2);
+
+	int status = neopixel_sct_claim(pins, pinCount);
+	if (status) {
+		lua_pushnumber(L, status);
+		return 1;
+	}
+	if (neopixel_stream_begin(frameLength, udpPort) < 0) {
+		neopixel_reset_animation();
+		lua_pushnumber(L, -1);
+		return 1;
+	}
+	lua_pushnumber(L, 0);
+	return 1;
+}
+
+// neopixel_stream_write(buffer, offset)
+static int l_neopixel_stream_write(lua_State* L) {
+	size_t length = 0;
+	const uint8_t* data = colony_toconstdata(L, ARG1, &length);
+	uint32_t offset = lua_tonumber(L, ARG1 + 1);
+	lua_pushnumber(L, neopixel_stream_write(offset, data, length));
+	return 1;
+}
+
+static int l_neopixel_stream_stop(lua_State* L) {
+	(void) L;
+	neopixel_reset_animation();
+	return 0;
+}
+
+static int l_neopixel_stream_shown(lua_State* L) {
+	lua_pushnumber(L, neopixel_stream_shown());
+	return 1;
+}
+
+static int l_neopixel_stream_dropped(lua_State* L) {
+	lua_pushnumber(L, neopixel_stream_dropped());
+	return 1;
+}
+
 /**
  * NTP
  */
@@ -988,6 +1410,62 @@ static int l_wifi_mac_address(lua_State* L) {
 	return 1;
 }
 
+// LuaJIT FFI
+
+#if HW_FFI
+#include "hw_ffi.h"
+
+// Builds hw.ffi from hw_ffi_entries with ffi.cast, so LuaJIT calls the C
+// functions directly. The wrappers drop the receiver colony passes as the
+// first argument of a method call.
+static const char l_hw_ffi_bind[] =
+	"local hw, entries = ...\n"
+	"local ok, ffi = pcall(require, 'ffi')\n"
+	"if not ok then return end\n"
+	"local wrap = {\n"
+	"  [0] = function (fn) return function (_) return fn() end end,\n"
+	"  [1] = function (fn) return function (_, a) return fn(a) end end,\n"
+	"  [2] = function (fn) return function (_, a, b) return fn(a, b) end end,\n"
+	"  [3] = function (fn) return function (_, a, b, c) return fn(a, b, c) end end,\n"
+	"}\n"
+	"local bound = {}\n"
+	"for _, entry in ipairs(entries) do\n"
+	"  bound[entry[1]] = wrap[entry[3]](ffi.cast(entry[2], entry[4]))\n"
+	"end\n"
+	"hw.ffi = bound\n"
+	"hw.ffi_enabled = true\n";
+
+// Expects the hw table on top of the stack and leaves it there.
+static void l_hw_bind_ffi(lua_State* L)
+{
+	if (luaL_loadstring(L, l_hw_ffi_bind) != 0) {
+		lua_pop(L, 1);
+		return;
+	}
+	lua_pushvalue(L, -2);
+
+	lua_newtable(L);
+	int i;
+	for (i = 0; hw_ffi_entries[i].name; i++) {
+		lua_newtable(L);
+		lua_pushstring(L, hw_ffi_entries[i].name);
+		lua_rawseti(L, -2, 1);
+		lua_pushstring(L, hw_ffi_entries[i].signature);
+		lua_rawseti(L, -2, 2);
+		lua_pushnumber(L, hw_ffi_entries[i].argc);
+		lua_rawseti(L, -2, 3);
+		lua_pushlightuserdata(L, hw_ffi_entries[i].fn);
+		lua_rawseti(L, -2, 4);
+		lua_rawseti(L, -2, i + 1);
+	}
+
+	// Falls back to the C API bindings on any error.
+	if (lua_pcall(L, 2, 0, 0) != 0) {
+		lua_pop(L, 1);
+	}
+}
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -1038,11 +1516,15 @@ LUALIB_API int luaopen_hw(lua_State* L)
 		{ "digital_read", l_hw_digital_read },
 		{ "digital_get_mode", l_hw_digital_get_mode},
 		{ "digital_set_mode", l_hw_digital_set_mode},
+		{ "digital_write_pins", l_hw_digital_write_pins },
+		{ "digital_read_pins", l_hw_digital_read_pins },
 		{ "analog_write", l_hw_analog_write },
 		{ "analog_read", l_hw_analog_read },
 
 		// sct
 		{ "sct_read_pulse", l_sct_read_pulse },
+		{ "sct_read_pulses", l_sct_read_pulses },
+		{ "sct_read_pulses_stop", l_sct_read_pulses_stop },
 
 		// external gpio interrupts
 		{ "interrupts_remaining", l_hw_interrupts_remaining },
@@ -1051,6 +1533,22 @@ LUALIB_API int luaopen_hw(lua_State* L)
 		{ "interrupt_assignment_query", l_hw_interrupt_assignment_query },
 		{ "acquire_available_interrupt", l_hw_acquire_available_interrupt },
 
+		// gpio group interrupts
+		{ "gint_watch", l_hw_gint_watch },
+		{ "gint_unwatch", l_hw_gint_unwatch },
+
+		// edge counters
+		{ "counter_start", l_hw_counter_start },
+		{ "counter_stop", l_hw_counter_stop },
+
+		// logic analyzer
+		{ "logic_start", l_hw_logic_start },
+		{ "logic_stop", l_hw_logic_stop },
+
+		// pattern generator
+		{ "pattern_start", l_hw_pattern_start },
+		{ "pattern_stop", l_hw_pattern_stop },
+
 		// buffer
 		{ "highspeedsignal_initialize", l_hw_highspeedsignal_initialize },
 		{ "highspeedsignal_update", l_hw_highspeedsignal_update },
@@ -1065,6 +1563,25 @@ LUALIB_API int luaopen_hw(lua_State* L)
 		// pwm
 		{ "pwm_port_period", l_hw_pwm_port_period },
 		{ "pwm_pin_pulsewidth", l_hw_pwm_pin_pulsewidth },
+		{ "pwm_group_period", l_hw_pwm_group_period },
+		{ "pwm_pin_group", l_hw_pwm_pin_group },
+		{ "pwm_pin_sequence", l_hw_pwm_pin_sequence },
+		{ "pwm_sequence_stop", l_hw_pwm_sequence_stop },
+
+		// motor control pwm
+		{ "mcpwm_start", l_hw_mcpwm_start },
+		{ "mcpwm_pulsewidth", l_hw_mcpwm_pulsewidth },
+		{ "mcpwm_commutate", l_hw_mcpwm_commutate },
+		{ "mcpwm_stop", l_hw_mcpwm_stop },
+
+		// quadrature encoder
+		{ "qei_start", l_hw_qei_start },
+		{ "qei_position", l_hw_qei_position },
+		{ "qei_direction", l_hw_qei_direction },
+		{ "qei_velocity", l_hw_qei_velocity },
+		{ "qei_index", l_hw_qei_index },
+		{ "qei_zero", l_hw_qei_zero },
+		{ "qei_stop", l_hw_qei_stop },
 
 		// usb
 		{ "usb_send", l_usb_send },
@@ -1093,6 +1610,12 @@ LUALIB_API int luaopen_hw(lua_State* L)
 
 		// Neopixel
 		{ "neopixel_animation_buffer", l_neopixel_animation_buffer },
+		{ "neopixel_transform", l_neopixel_transform },
+		{ "neopixel_stream_begin", l_neopixel_stream_begin },
+		{ "neopixel_stream_write", l_neopixel_stream_write },
+		{ "neopixel_stream_stop", l_neopixel_stream_stop },
+		{ "neopixel_stream_shown", l_neopixel_stream_shown },
+		{ "neopixel_stream_dropped", l_neopixel_stream_dropped },
 
 		// clock sync
 		{ "clocksync", l_clocksync },
@@ -1111,6 +1634,24 @@ LUALIB_API int luaopen_hw(lua_State* L)
 		//reset
 		{ "reset_board", l_hw_reset_board},
 
+		// gc
+		{ "gc_configure", l_hw_gc_configure },
+
+		// event loop stats
+		{ "event_stats", l_hw_event_stats },
+		{ "event_stats_reset", l_hw_event_stats_reset },
+
+		// tracing
+		{ "cycles", l_hw_cycles },
+
+		// crash capture
+		{ "crash_report", l_hw_crash_report },
+		{ "crash_report_clear", l_hw_crash_report_clear },
+
+		// watchdog
+		{ "watchdog_start", l_hw_watchdog_start },
+		{ "watchdog_stop", l_hw_watchdog_stop },
+
 		// End of array (must be last)
 		{ NULL, NULL }
 	};
@@ -1152,6 +1693,26 @@ LUALIB_API int luaopen_hw(lua_State* L)
 	luaL_setfieldnumber(L, "PIN_PULLDOWN",  PUP_DISABLE | PDN_ENABLE);
 	luaL_setfieldnumber(L, "PIN_NOPULL",    PUP_DISABLE | PDN_DISABLE);
 	luaL_setfieldnumber(L, "PIN_BUSKEEPER", PUP_ENABLE  | PDN_ENABLE);
+	luaL_setfieldnumber(L, "WATCHDOG_REPORT", HW_WATCHDOG_REPORT);
+	luaL_setfieldnumber(L, "WATCHDOG_RECOVER", HW_WATCHDOG_RECOVER);
+	luaL_setfieldnumber(L, "WATCHDOG_RESET", HW_WATCHDOG_RESET);
+	luaL_setfieldnumber(L, "GINT_COUNT", HW_GINT_COUNT);
+	luaL_setfieldnumber(L, "COUNTER_SCT", HW_COUNTER_SCT);
+	luaL_setfieldnumber(L, "SCT_TICKS_PER_US", SCT_PULSE_TICKS_PER_US);
+	luaL_setfieldnumber(L, "PWM_PERIOD_MAX", HW_PWM_PERIOD_MAX);
+	luaL_setfieldnumber(L, "PWM_GROUP_PERIOD_MAX", HW_PWM_GROUP_PERIOD_MAX);
+	luaL_setfieldnumber(L, "MCPWM_CENTER", HW_MCPWM_CENTER);
+	luaL_setfieldnumber(L, "MCPWM_AC", HW_MCPWM_AC);
+	luaL_setfieldnumber(L, "MCPWM_DC", HW_MCPWM_DC);
+	luaL_setfieldnumber(L, "MCPWM_ACTIVE_LOW", HW_MCPWM_ACTIVE_LOW);
+	luaL_setfieldnumber(L, "QEI_4X", HW_QEI_4X);
+	luaL_setfieldnumber(L, "QEI_CLOCK_DIRECTION", HW_QEI_CLOCK_DIRECTION);
+	luaL_setfieldnumber(L, "QEI_INVERT_DIRECTION", HW_QEI_INVERT_DIRECTION);
+	luaL_setfieldnumber(L, "QEI_INVERT_INDEX", HW_QEI_INVERT_INDEX);
+	luaL_setfieldnumber(L, "QEI_INDEX_RESET", HW_QEI_INDEX_RESET);
+	luaL_setfieldnumber(L, "LOGIC_TRIGGER_NONE", HW_LOGIC_TRIGGER_NONE);
+	luaL_setfieldnumber(L, "LOGIC_TRIGGER_MATCH", HW_LOGIC_TRIGGER_MATCH);
+	luaL_setfieldnumber(L, "LOGIC_TRIGGER_CHANGE", HW_LOGIC_TRIGGER_CHANGE);
 
 	luaL_setfieldnumber(L, "PIN_A_G1", A_G1);
 	luaL_setfieldnumber(L, "PIN_A_G2", A_G2);
@@ -1185,6 +1746,12 @@ LUALIB_API int luaopen_hw(lua_State* L)
 	luaL_setfieldnumber(L, "LOW", HW_LOW);
 	luaL_setfieldnumber(L, "HIGH", HW_HIGH);
 
+	lua_pushboolean(L, 0);
+	lua_setfield(L, -2, "ffi_enabled");
+#if HW_FFI
+	l_hw_bind_ffi(L);
+#endif
+
 	return 1;
 }
 
@@ -42,6 +42,10 @@
 #include "sdram_init.h"
 #include "spi_flash.h"
 #include "bootloader.h"
+#include "event_stats.h"
+#include "profiler.h"
+#include "trace.h"
+#include "crash.h"
 #include "utility/wlan.h"
 
 #include <lpc18xx_sct.h>
@@ -63,9 +67,19 @@ void __attribute__ ((interrupt)) GPIO7_IRQHandler(void)
 	_tessel_cc3000_irq_interrupt();
 }
 
+
 void __attribute__ ((interrupt)) DMA_IRQHandler (void)
 {
+	// Channels 0 and 1: async SPI
 	_hw_spi_irq_interrupt();
+	// Channel 2: logic analyzer
+	hw_logic_dma_irq();
+	// Channels 3 and 4: pattern generator
+	hw_pattern_dma_irq();
+	// Channels 5 and 6: NeoPixel buffers
+	neopixel_dma_irq();
+	// Channel 7: PWM sequences
+	hw_pwm_dma_irq();
 }
 
 
@@ -73,45 +87,7 @@ void __attribute__ ((interrupt)) DMA_IRQHandler (void)
   Fault Handler
  *---------------------------------------------------------------------------*/
 
-static __inline__ void fault_handler (void)
-{
-	const uint32_t led_next_time = 4e6;
-	volatile uint8_t led_state = 0;
-	volatile uint32_t ticks = 0;
-
-	while (1) {
-		ticks++;
-		if (ticks > led_next_time) {
-			ticks = 0;
-			hw_digital_write(LED1, led_state);
-			hw_digital_write(LED2, led_state);
-			hw_digital_write(CC3K_ERR_LED, led_state);
-			hw_digital_write(CC3K_CONN_LED, led_state);
-			led_state = !led_state;
-		}
-		__NOP();
-	}
-}
-
-void HardFault_Handler(void)
-{
-	fault_handler();
-}
-
-void MemManage_Handler(void)
-{
-	fault_handler();
-}
-
-void BusFault_Handler(void)
-{
-	fault_handler();
-}
-
-void UsageFault_Handler(void)
-{
-	fault_handler();
-}
+// HardFault, MemManage, BusFault and UsageFault handlers live in crash.c.
 
 
 /*----------------------------------------------------------------------------
@@ -158,7 +134,64 @@ void tessel_cmd_process (uint8_t cmd, uint8_t* buf, unsigned size)
 		buf = NULL; // So it won't get freed
 	} else if (cmd == 'G') {
 		TM_COMMAND('G', "\"pong\"");
+
+	} else if (cmd == 'e') {
+		// Event loop statistics; "r" resets them after reporting.
+		char* stats = event_stats_json();
+		if (stats) {
+			hw_send_usb_msg('e', (uint8_t*) stats, strlen(stats));
+			free(stats);
+		}
+		if (size > 0 && buf[0] == 'r') {
+			event_stats_reset();
+		}
+
+	} else if (cmd == 'p') {
+		// PC sampler; a little-endian rate in Hz starts it, zero or no payload
+		// stops it. Samples arrive as 's' messages. It runs on TIMER2, which
+		// the pattern generator holds while it plays; starting then answers
+		// with an error instead.
+		uint32_t hz = 0;
+		if (size >= 4) {
+			hz = buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((uint32_t) buf[3] << 24);
+		}
+		if (hz && profiler_start(hz)) {
+			TM_COMMAND('p', "{\"running\": false, \"hz\": 0, \"error\": \"TIMER2 is busy playing a pattern\"}");
+		} else {
+			if (!hz) {
+				profiler_stop();
+			}
+			TM_COMMAND('p', "{\"running\": %s, \"hz\": %u}", profiler_rate() ? "true" : "false", (unsigned) profiler_rate());
+		}
 	
+	} else if (cmd == 't') {
+		// Span trace ring; 'c' clears it, anything else dumps it as a 't'
+		// message.
+		if (size > 0 && buf[0] == 'c') {
+			trace_clear();
+		} else {
+			trace_dump();
+		}
+
+	} else if (cmd == 'F') {
+		// Crash record from the previous boot, or null; 'c' clears it.
+		char* report = crash_report_json();
+		if (report) {
+			hw_send_usb_msg('F', (uint8_t*) report, strlen(report));
+			free(report);
+		} else {
+			TM_COMMAND('F', "null");
+		}
+		if (size > 0 && buf[0] == 'c') {
+			crash_report_clear();
+		}
+
+	} else if (cmd == 'j') {
+		// JS profiler: 's' starts (optionally followed by a little-endian
+		// instruction interval), 'x' stops, 'c' clears and 'r' reports. Every
+		// op replies with the current report.
+		tessel_profile_command(buf, size);
+
 	} else if (cmd == 'M') {
 		if (tm_lua_state != NULL) {
 			colony_ipc_emit(tm_lua_state, "serialized-message", buf, size);
@@ -281,75 +314,32 @@ void tessel_cmd_process (uint8_t cmd, uint8_t* buf, unsigned size)
 
 
 /**
- * system tick handler
+ * LED animations
  */
 
-typedef struct tm_anim {
-	size_t millis;
-	size_t count;
-	void (*call)(size_t);
-	struct tm_anim * next;
-} tm_anim_t;
+// The CC3000 status blink runs in 64ms frames and toggles every eighth. It's
+// cancelled whenever the LED is steady so an idle Tessel takes no SysTicks,
+// and restarted by the CC3000 callbacks that blink it.
+static hw_periodic_t cc_animation_periodic;
 
-tm_anim_t* systick_anim_list = NULL;
-
-_ramfunc void SysTick_Handler (void)
+static void cc_animation_tick (hw_periodic_t* periodic)
 {
-	tm_anim_t* frame = systick_anim_list;
-	while (frame != NULL) {
-		frame->count++;
-		if (frame->count >= frame->millis) {
-			frame->call(frame->count / frame->millis);
-		}
-		frame = frame->next;
+	if (!_cc3000_cb_animation_tick(periodic->count >> 3)) {
+		hw_periodic_cancel(periodic);
 	}
 }
 
-void add_animation (tm_anim_t* anim)
-{
-	anim->next = systick_anim_list;
-	systick_anim_list = anim;
-
-	// Interrupt at 1000hz
-	NVIC_SetPriority(SysTick_IRQn, ((0x02<<3)|0x01));
-	SysTick_Config(CGU_GetPCLKFrequency(CGU_PERIPHERAL_M3CORE) >> 4);
-}
-
-tm_anim_t* create_animation (int millis, void (*call)(size_t))
-{
-	tm_anim_t* cc_anim = (tm_anim_t*) calloc(1, sizeof(tm_anim_t));
-	cc_anim->millis = millis >> 6;
-	cc_anim->call = call;
-	cc_anim->next = NULL;
-	return cc_anim;
-}
-
 void cc_animation ()
 {
-	tm_anim_t* anim = create_animation(512, _cc3000_cb_animation_tick);
-	add_animation(anim);
-}
-
-/**
- * SCT interupt handler
- */
-
-hw_sct_status_t hw_sct_status = SCT_INACTIVE;
-
-void SCT_IRQHandler (void) {
-  if (hw_sct_status == SCT_READPULSE) sct_readpulse_irq_handler();
-  else if (hw_sct_status == SCT_NEOPIXEL) sct_neopixel_irq_handler(); 
+	hw_periodic_start(&cc_animation_periodic, 64, cc_animation_tick);
 }
 
 /**
  * Main body of Tessel OS
  */
 
-void debugstack_hook(lua_State* L, lua_Debug *ar)
+void debugstack_send(lua_State* L)
 {
-	(void) ar;
-	lua_sethook(L, NULL, 0, 0);
-
 	lua_getfield(L, LUA_GLOBALSINDEX, "debug");
 	if (!lua_istable(L, -1)) {
 		lua_pop(L, 1);
@@ -368,6 +358,14 @@ void debugstack_hook(lua_State* L, lua_Debug *ar)
 	unsigned len = 0;
 	uint8_t* trace = (uint8_t*) lua_tolstring(L, -1, &len);
 	hw_send_usb_msg('k', trace, len);
+	lua_pop(L, 1);
+}
+
+void debugstack_hook(lua_State* L, lua_Debug *ar)
+{
+	(void) ar;
+	lua_sethook(L, NULL, 0, 0);
+	debugstack_send(L);
 }
 
 int debugstack() {
@@ -375,6 +373,11 @@ int debugstack() {
 		return -1;
 	}
 
+	// The profiler's hook sends the traceback on its next sample.
+	if (tessel_profile_request_traceback()) {
+		return 0;
+	}
+
 	if (lua_gethook(tm_lua_state) != 0) {
 		// Another hook probably means we're in the process of exiting
 		return -2;
@@ -432,15 +435,38 @@ void tm_events_lock() { __disable_irq(); }
 void tm_events_unlock() { __enable_irq(); }
 
 void hw_wait_for_event() {
+	// Close out the loop slice that just finished.
+	hw_watchdog_feed();
+	event_stats_loop_idle();
+	tessel_profile_idle_begin();
+
+	// Driver continuations run before the runtime dispatches anything else.
+	hw_priority_events_process();
+
+	// Spend a bounded slice of idle time on incremental garbage collection.
+	TRACE_BEGIN(TRACE_GC_IDLE);
+	tessel_gc_idle();
+	TRACE_END(TRACE_GC_IDLE);
+
 	__disable_irq();
-	if (!tm_events_pending()) {
+	if (!tm_events_pending() && !hw_priority_events_pending()) {
 		// Check for events after disabling interrupts to avoid the race
 		// condition where an event comes from an interrupt between check and
 		// sleep. Processor still wakes from sleep on interrupt request even
 		// when interrupts are disabled.
+		TRACE_BEGIN(TRACE_SLEEP);
+		hw_watchdog_idle(1);
 		__WFI();
+		hw_watchdog_idle(0);
+		TRACE_END(TRACE_SLEEP);
 	}
 	__enable_irq();
+
+	// Run continuations for whatever woke us before returning to the runtime.
+	hw_priority_events_process();
+
+	tessel_profile_idle_end();
+	event_stats_loop_wake();
 }
 
 void load_script(uint8_t* script_buf, unsigned script_buf_size, uint8_t speculative)
@@ -589,6 +615,25 @@ void load_script(uint8_t* script_buf, unsigned script_buf_size, uint8_t speculat
 	neopixel_reset_animation();
 	// Clean up the readPulse data and lua refs
 	sct_read_pulse_reset();
+	// Stop PWM, handing back the last of the SCT
+	hw_pwm_reset();
+	// Let go of motor PWM outputs and the encoder
+	hw_mcpwm_reset();
+	hw_qei_stop();
+	// Restore default idle GC settings for the next script
+	tessel_gc_reset();
+	// Drop profiler results along with the Lua state
+	tessel_profile_reset();
+	// Scripts opt in to the stall detector
+	hw_watchdog_stop();
+	// Release pin groups watched by the script
+	hw_gint_reset();
+	// Stop edge counters, freeing their interrupt slots and the SCT
+	hw_counter_reset();
+	// Abandon any logic capture and free its buffer
+	hw_logic_reset();
+	// Stop any pattern playback and free it
+	hw_pattern_reset();
 
 	initialize_GPIO_interrupts();
 	tessel_gpio_init(0);
@@ -618,6 +663,8 @@ int main (void)
 	tessel_gpio_init(1);
 
 	tm_uptime_init();
+	trace_init();
+	crash_init();
 
 	hw_usb_init();
 
@@ -703,10 +750,8 @@ void check_failed(uint8_t *file, uint32_t line)
 	/* User can add his own implementation to report the file name and line number,
 	 ex: printf("Wrong parameters value: file %s on line %d\r\n", file, line) */
 
-	(void) file;
-	(void) line;
-
-	/* Infinite loop */
-	while(1);
+	crash_capture_check((const char*) file, line);
+	crash_capture_lua();
+	crash_finish();
 }
 #endif
@@ -8,6 +8,7 @@
 // except according to those terms.
 
 #include "audio-vs1053b.h"
+#include "event_stats.h"
 
 #define DEBUG
 
@@ -137,6 +138,8 @@ static void shift_buffer(tm_event *event) {
     return;
   }
   else {
+    event_stats_begin(EVENT_SOURCE_AUDIO);
+
     // Save the stream id for our event emission
     uint16_t stream_id = operating_playback_buf->stream_id;
 
@@ -172,6 +175,7 @@ static void shift_buffer(tm_event *event) {
 
     // Emit the event that we finished playing that buffer
     audio_emit_completion(stream_id);
+    event_stats_end();
   }
 }
 
@@ -226,6 +230,7 @@ static void audio_continue_spi() {
     // If there are no bytes left
     if (operating_playback_buf->remaining_bytes <= 0) {
       // Shift the buffer and emit the finished event
+      event_stats_trigger(EVENT_SOURCE_AUDIO);
       tm_event_trigger(&buffer_shift_event);
     }
     else {
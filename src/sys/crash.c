@@ -0,0 +1,275 @@
+// Copyright 2014 Technical Machine, Inc. See the COPYRIGHT
+// file at the top-level directory of this distribution.
+//
+// Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+// http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+// <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+// option. This file may not be copied, modified, or distributed
+// except according to those terms.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "LPC18xx.h"
+#include "tm.h"
+#include "colony.h"
+#include "crash.h"
+#include "json.h"
+
+extern unsigned _estack;
+
+// Survives reset; startup only zeroes .bss.
+static crash_record_t crash_record __attribute__ ((section (".noinit")));
+
+// Record left by the previous boot, if any.
+static crash_record_t crash_previous;
+static uint8_t crash_previous_valid = 0;
+
+static const char* crash_type_names[CRASH_TYPE_COUNT] = {
+	"hardfault",
+	"memmanage",
+	"busfault",
+	"usagefault",
+	"check_failed",
+	"watchdog",
+};
+
+static uint32_t crash_checksum (const crash_record_t* record)
+{
+	const uint32_t* word = (const uint32_t*) record;
+	const uint32_t* end = &record->checksum;
+	uint32_t sum = 0;
+	while (word < end) {
+		sum = ((sum << 1) | (sum >> 31)) ^ *word++;
+	}
+	return sum;
+}
+
+// Whether [addr, addr + len) lies in RAM, per ldscript_rom_gnu.ld. Checked
+// before touching a stacked frame, since a bad SP is a common cause of faults.
+static int crash_readable (uint32_t addr, uint32_t len)
+{
+	uint32_t end = addr + len;
+	if (end < addr || (addr & 3)) {
+		return 0;
+	}
+	return (addr >= 0x10000000 && end <= 0x10018000)
+		|| (addr >= 0x10080000 && end <= (uint32_t) &_estack)
+		|| (addr >= 0x20000000 && end <= 0x20010000)
+		|| (addr >= 0x28000000 && end <= 0x2A000000);
+}
+
+// No printf here; it may allocate and the heap could be what broke.
+static void crash_append (const char* str)
+{
+	size_t len = strlen(crash_record.detail);
+	while (*str && len < CRASH_DETAIL_SIZE - 1) {
+		crash_record.detail[len++] = *str++;
+	}
+	crash_record.detail[len] = '\0';
+}
+
+static void crash_append_uint (uint32_t value)
+{
+	char buf[11];
+	char* p = &buf[10];
+	*p = '\0';
+	do {
+		*--p = '0' + (value % 10);
+		value /= 10;
+	} while (value);
+	crash_append(p);
+}
+
+// Returns 0, capturing nothing, if a capture is already under way
+int crash_capture (crash_type_t type, uint32_t* frame, uint32_t exc_return, const char* detail)
+{
+	crash_record_t* record = &crash_record;
+	if (record->magic == CRASH_MAGIC && record->stage != CRASH_STAGE_DONE) {
+		// Faulted again while capturing; keep the original context.
+		return 0;
+	}
+
+	memset(record, 0, sizeof(*record));
+	record->magic = CRASH_MAGIC;
+	record->stage = CRASH_STAGE_CORE;
+	record->type = type;
+	record->uptime = tm_uptime_micro();
+	record->exc_return = exc_return;
+
+	record->cfsr = SCB->CFSR;
+	record->hfsr = SCB->HFSR;
+	record->mmfar = SCB->MMFAR;
+	record->bfar = SCB->BFAR;
+
+	uint32_t* sp = (uint32_t*) __get_MSP();
+	if (frame && crash_readable((uint32_t) frame, sizeof(record->regs))) {
+		memcpy(record->regs, frame, sizeof(record->regs));
+		sp = frame + 8;
+	}
+	record->sp = (uint32_t) sp;
+
+	while (record->stack_words < CRASH_STACK_WORDS
+		&& crash_readable((uint32_t) &sp[record->stack_words], sizeof(uint32_t))) {
+		record->stack[record->stack_words] = sp[record->stack_words];
+		record->stack_words++;
+	}
+
+	record->trace_count = trace_tail(record->trace, CRASH_TRACE_ENTRIES);
+
+	if (detail) {
+		crash_append(detail);
+	}
+	return 1;
+}
+
+// A failed CHECK_PARAM, with its file and line as the detail
+void crash_capture_check (const char* file, uint32_t line)
+{
+	if (crash_capture(CRASH_CHECK_FAILED, NULL, 0, file)) {
+		crash_append(":");
+		crash_append_uint(line);
+	}
+}
+
+// Appends the Lua call stack to the record. Only attempted once per crash:
+// a fault while walking a corrupt Lua state lands back in crash_capture with
+// the stage still set, which skips straight to crash_finish.
+void crash_capture_lua ()
+{
+	lua_State* L = tm_lua_state;
+	if (crash_record.stage != CRASH_STAGE_CORE || !L) {
+		return;
+	}
+	crash_record.stage = CRASH_STAGE_LUA;
+
+	lua_Debug ar;
+	int level;
+	for (level = 0; lua_getstack(L, level, &ar); level++) {
+		if (!lua_getinfo(L, "Sl", &ar)) {
+			break;
+		}
+		crash_append(crash_record.detail[0] ? "\n" : "");
+		crash_append(ar.short_src);
+		crash_append(":");
+		crash_append_uint(ar.currentline > 0 ? ar.currentline : 0);
+	}
+}
+
+// Makes the record valid across a reset without resetting, for captures
+// that may be overtaken by a hardware reset (the watchdog).
+void crash_commit ()
+{
+	crash_record.checksum = crash_checksum(&crash_record);
+}
+
+void crash_finish ()
+{
+	crash_record.stage = CRASH_STAGE_DONE;
+	crash_record.checksum = crash_checksum(&crash_record);
+	NVIC_SystemReset();
+	while (1) { }
+}
+
+// Called from the fault handlers below with the stacked exception frame.
+__attribute__ ((used)) void crash_fault (uint32_t* frame, uint32_t exc_return, uint32_t type)
+{
+	crash_capture(type, frame, exc_return, NULL);
+
+	// A fault inside HardFault locks up the core, so only the configurable
+	// handlers try the Lua stack; a fault there escalates to HardFault.
+	if (type != CRASH_HARDFAULT) {
+		crash_capture_lua();
+	}
+	crash_finish();
+}
+
+#define CRASH_HANDLER(name, type) \
+	__attribute__ ((naked)) void name (void) \
+	{ \
+		__asm volatile ( \
+			"tst lr, #4\n" \
+			"ite eq\n" \
+			"mrseq r0, msp\n" \
+			"mrsne r0, psp\n" \
+			"mov r1, lr\n" \
+			"movs r2, %0\n" \
+			"b crash_fault\n" \
+			:: "i" (type) \
+		); \
+	}
+
+CRASH_HANDLER(HardFault_Handler, CRASH_HARDFAULT)
+CRASH_HANDLER(MemManage_Handler, CRASH_MEMMANAGE)
+CRASH_HANDLER(BusFault_Handler, CRASH_BUSFAULT)
+CRASH_HANDLER(UsageFault_Handler, CRASH_USAGEFAULT)
+
+void crash_init ()
+{
+	// Let memory, bus and usage faults reach their own handlers instead of
+	// escalating, so there is a chance to walk the Lua stack.
+	SCB->SHCSR |= SCB_SHCSR_MEMFAULTENA_Msk | SCB_SHCSR_BUSFAULTENA_Msk | SCB_SHCSR_USGFAULTENA_Msk;
+
+	if (crash_record.magic == CRASH_MAGIC && crash_record.stage != CRASH_STAGE_NONE
+		&& crash_record.checksum == crash_checksum(&crash_record)) {
+		crash_previous = crash_record;
+		crash_previous_valid = 1;
+	}
+	memset(&crash_record, 0, sizeof(crash_record));
+}
+
+void crash_report_clear ()
+{
+	crash_previous_valid = 0;
+}
+
+// Returns a malloc'd JSON description of the previous boot's crash, or NULL
+// if there was none.
+char* crash_report_json ()
+{
+	if (!crash_previous_valid) {
+		return NULL;
+	}
+
+	size_t size = 512 + CRASH_STACK_WORDS * 14 + CRASH_TRACE_ENTRIES * 64 + CRASH_DETAIL_SIZE * 2;
+	json_t json;
+	if (json_begin(&json, size)) {
+		return NULL;
+	}
+
+	crash_record_t* record = &crash_previous;
+	static const char* reg_names[8] = { "r0", "r1", "r2", "r3", "r12", "lr", "pc", "xpsr" };
+	unsigned i;
+
+	json_append(&json, "{\"type\": \"%s\", \"uptime\": %lu, \"registers\": {",
+		record->type < CRASH_TYPE_COUNT ? crash_type_names[record->type] : "unknown",
+		(unsigned long) record->uptime);
+	for (i = 0; i < 8; i++) {
+		json_append(&json, "\"%s\": \"0x%08lx\", ", reg_names[i], (unsigned long) record->regs[i]);
+	}
+	json_append(&json, "\"sp\": \"0x%08lx\", \"exc_return\": \"0x%08lx\"}",
+		(unsigned long) record->sp, (unsigned long) record->exc_return);
+
+	json_append(&json, ", \"cfsr\": \"0x%08lx\", \"hfsr\": \"0x%08lx\", \"mmfar\": \"0x%08lx\", \"bfar\": \"0x%08lx\"",
+		(unsigned long) record->cfsr, (unsigned long) record->hfsr,
+		(unsigned long) record->mmfar, (unsigned long) record->bfar);
+
+	json_append(&json, ", \"stack\": [");
+	for (i = 0; i < record->stack_words && i < CRASH_STACK_WORDS; i++) {
+		json_append(&json, i ? ", \"0x%08lx\"" : "\"0x%08lx\"", (unsigned long) record->stack[i]);
+	}
+
+	json_append(&json, "], \"trace\": [");
+	for (i = 0; i < record->trace_count && i < CRASH_TRACE_ENTRIES; i++) {
+		trace_entry_t* entry = &record->trace[i];
+		json_append(&json, "%s{\"cycles\": %lu, \"name\": \"%s\", \"phase\": \"%s\"}",
+			i ? ", " : "", (unsigned long) entry->cycles, trace_name(entry->id),
+			entry->phase == TRACE_PHASE_END ? "end" : "begin");
+	}
+
+	json_append(&json, "], \"detail\": ");
+	record->detail[CRASH_DETAIL_SIZE - 1] = '\0';
+	json_append_string(&json, record->detail);
+	json_append(&json, "}");
+	return json_end(&json);
+}
@@ -0,0 +1,76 @@
+// Copyright 2014 Technical Machine, Inc. See the COPYRIGHT
+// file at the top-level directory of this distribution.
+//
+// Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+// http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+// <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+// option. This file may not be copied, modified, or distributed
+// except according to those terms.
+
+// Crash capture. Fault handlers snapshot the stacked registers, fault status
+// registers, a bounded stack dump, the tail of the trace ring and (where it
+// is safe to try) the Lua stack into a .noinit record, then reset. The next
+// boot picks the record up and reports it over USB and to JS.
+
+#pragma once
+
+#include <stdint.h>
+#include "trace.h"
+
+#define CRASH_MAGIC 0x43525348
+#define CRASH_STACK_WORDS 64
+#define CRASH_TRACE_ENTRIES 32
+#define CRASH_DETAIL_SIZE 512
+
+typedef enum {
+	CRASH_HARDFAULT = 0,
+	CRASH_MEMMANAGE,
+	CRASH_BUSFAULT,
+	CRASH_USAGEFAULT,
+	CRASH_CHECK_FAILED,
+	CRASH_WATCHDOG,
+	CRASH_TYPE_COUNT
+} crash_type_t;
+
+typedef enum {
+	CRASH_STAGE_NONE = 0,
+	CRASH_STAGE_CORE,
+	CRASH_STAGE_LUA,
+	CRASH_STAGE_DONE,
+} crash_stage_t;
+
+typedef struct {
+	uint32_t magic;
+	uint32_t stage;
+	uint32_t type;
+	uint32_t uptime;
+
+	// r0-r3, r12, lr, pc, xpsr as stacked on exception entry
+	uint32_t regs[8];
+	uint32_t sp;
+	uint32_t exc_return;
+
+	uint32_t cfsr;
+	uint32_t hfsr;
+	uint32_t mmfar;
+	uint32_t bfar;
+
+	uint32_t stack_words;
+	uint32_t stack[CRASH_STACK_WORDS];
+
+	uint32_t trace_count;
+	trace_entry_t trace[CRASH_TRACE_ENTRIES];
+
+	char detail[CRASH_DETAIL_SIZE];
+
+	uint32_t checksum;
+} crash_record_t;
+
+void crash_init ();
+int crash_capture (crash_type_t type, uint32_t* frame, uint32_t exc_return, const char* detail);
+void crash_capture_check (const char* file, uint32_t line);
+void crash_capture_lua ();
+void crash_commit ();
+void crash_finish ();
+char* crash_report_json ();
+void crash_report_clear ();
@@ -0,0 +1,179 @@
+// Copyright 2014 Technical Machine, Inc. See the COPYRIGHT
+// file at the top-level directory of this distribution.
+//
+// Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+// http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+// <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+// option. This file may not be copied, modified, or distributed
+// except according to those terms.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "tm.h"
+#include "event_stats.h"
+#include "json.h"
+
+typedef struct {
+	volatile uint8_t pending;
+	volatile uint32_t triggered_at;
+	uint32_t count;
+	uint32_t delay_max;
+	uint32_t run_max;
+	uint32_t delay[EVENT_STATS_BUCKETS];
+	uint32_t run[EVENT_STATS_BUCKETS];
+} event_stats_t;
+
+static const char* event_source_names[EVENT_SOURCE_COUNT] = {
+	"timer",
+	"uart_rx",
+	"interrupt",
+	"spi_async",
+	"usb_msg_out",
+	"usb_msg_in",
+	"cc3k_irq",
+	"wifi",
+	"readpulse",
+	"neopixel",
+	"audio",
+};
+
+static event_stats_t event_stats[EVENT_SOURCE_COUNT];
+
+// Handler currently running, or -1 if none.
+static int event_stats_current = -1;
+static uint32_t event_stats_started = 0;
+
+// Bookkeeping for the loop slice between leaving and re-entering
+// hw_wait_for_event, used to account for runtime-dispatched events.
+static uint8_t event_stats_awake = 0;
+static uint32_t event_stats_woke = 0;
+static uint32_t event_stats_claimed = 0;
+
+static void event_stats_record (uint32_t* hist, uint32_t* max, uint32_t us)
+{
+	unsigned bucket = us == 0 ? 0 : 32 - __builtin_clz(us);
+	if (bucket >= EVENT_STATS_BUCKETS) {
+		bucket = EVENT_STATS_BUCKETS - 1;
+	}
+	hist[bucket]++;
+	if (us > *max) {
+		*max = us;
+	}
+}
+
+// Safe to call from interrupt context. Coalesced triggers are measured from
+// the first one, as that is how long the oldest work has been waiting.
+void event_stats_trigger (event_source_t source)
+{
+	event_stats_t* stats = &event_stats[source];
+	if (!stats->pending) {
+		stats->triggered_at = tm_uptime_micro();
+		stats->pending = 1;
+	}
+}
+
+void event_stats_begin (event_source_t source)
+{
+	event_stats_t* stats = &event_stats[source];
+	uint32_t now = tm_uptime_micro();
+
+	if (stats->pending) {
+		stats->pending = 0;
+		event_stats_record(stats->delay, &stats->delay_max, now - stats->triggered_at);
+	}
+	stats->count++;
+
+	event_stats_current = source;
+	event_stats_started = now;
+}
+
+void event_stats_end ()
+{
+	if (event_stats_current < 0) {
+		return;
+	}
+
+	event_stats_t* stats = &event_stats[event_stats_current];
+	uint32_t run = tm_uptime_micro() - event_stats_started;
+	event_stats_record(stats->run, &stats->run_max, run);
+
+	event_stats_claimed += run;
+	event_stats_current = -1;
+}
+
+void event_stats_loop_wake ()
+{
+	event_stats_woke = tm_uptime_micro();
+	event_stats_claimed = 0;
+	event_stats_awake = 1;
+}
+
+void event_stats_loop_idle ()
+{
+	if (!event_stats_awake) {
+		return;
+	}
+	event_stats_awake = 0;
+
+	// A timer that fired before the loop woke was dispatched during this
+	// slice. Charge it with the time no firmware handler claimed.
+	event_stats_t* stats = &event_stats[EVENT_SOURCE_TIMER];
+	if (!stats->pending || (int32_t) (event_stats_woke - stats->triggered_at) < 0) {
+		return;
+	}
+	stats->pending = 0;
+	stats->count++;
+
+	uint32_t slice = tm_uptime_micro() - event_stats_woke;
+	event_stats_record(stats->delay, &stats->delay_max, event_stats_woke - stats->triggered_at);
+	event_stats_record(stats->run, &stats->run_max, slice > event_stats_claimed ? slice - event_stats_claimed : 0);
+}
+
+void event_stats_reset ()
+{
+	unsigned i;
+	for (i = 0; i < EVENT_SOURCE_COUNT; i++) {
+		event_stats_t* stats = &event_stats[i];
+		stats->count = 0;
+		stats->delay_max = 0;
+		stats->run_max = 0;
+		memset(stats->delay, 0, sizeof(stats->delay));
+		memset(stats->run, 0, sizeof(stats->run));
+	}
+}
+
+static void json_append_hist (json_t* json, const uint32_t* hist)
+{
+	unsigned i;
+	json_append(json, "[");
+	for (i = 0; i < EVENT_STATS_BUCKETS; i++) {
+		json_append(json, i ? ", %lu" : "%lu", (unsigned long) hist[i]);
+	}
+	json_append(json, "]");
+}
+
+// Returns a malloc'd JSON array with one object per event source, or NULL.
+char* event_stats_json ()
+{
+	size_t size = EVENT_SOURCE_COUNT * (128 + 2 * EVENT_STATS_BUCKETS * 12) + 4;
+	json_t json;
+	if (json_begin(&json, size)) {
+		return NULL;
+	}
+
+	unsigned i;
+	json_append(&json, "[");
+	for (i = 0; i < EVENT_SOURCE_COUNT; i++) {
+		event_stats_t* stats = &event_stats[i];
+		json_append(&json, "%s{\"name\": \"%s\", \"count\": %lu, \"delay_max\": %lu, \"run_max\": %lu, \"delay\": ",
+			i ? ", " : "", event_source_names[i], (unsigned long) stats->count,
+			(unsigned long) stats->delay_max, (unsigned long) stats->run_max);
+		json_append_hist(&json, stats->delay);
+		json_append(&json, ", \"run\": ");
+		json_append_hist(&json, stats->run);
+		json_append(&json, "}");
+	}
+	json_append(&json, "]");
+	return json_end(&json);
+}
@@ -0,0 +1,48 @@
+// Copyright 2014 Technical Machine, Inc. See the COPYRIGHT
+// file at the top-level directory of this distribution.
+//
+// Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+// http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+// <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+// option. This file may not be copied, modified, or distributed
+// except according to those terms.
+
+// Event loop instrumentation. Each event source records when it was
+// triggered (usually from an ISR) and when its handler began and ended, and
+// keeps log2 histograms of queueing delay and handler run time in µs.
+
+#pragma once
+
+#include <stdint.h>
+
+typedef enum {
+	// Events dispatched by the runtime itself (timers, setImmediate). The
+	// firmware never sees these handlers, so they are charged with whatever
+	// loop time no instrumented handler claimed.
+	EVENT_SOURCE_TIMER = 0,
+	EVENT_SOURCE_UART_RX,
+	EVENT_SOURCE_INTERRUPT,
+	EVENT_SOURCE_SPI_ASYNC,
+	EVENT_SOURCE_USB_MSG_OUT,
+	EVENT_SOURCE_USB_MSG_IN,
+	EVENT_SOURCE_CC3K_IRQ,
+	EVENT_SOURCE_WIFI,
+	EVENT_SOURCE_READPULSE,
+	EVENT_SOURCE_NEOPIXEL,
+	EVENT_SOURCE_AUDIO,
+	EVENT_SOURCE_COUNT
+} event_source_t;
+
+// Bucket 0 holds 0µs, bucket n holds [2^(n-1), 2^n) µs and the last bucket
+// holds everything longer.
+#define EVENT_STATS_BUCKETS 20
+
+void event_stats_trigger (event_source_t source);
+void event_stats_begin (event_source_t source);
+void event_stats_end ();
+
+void event_stats_loop_idle ();
+void event_stats_loop_wake ();
+
+void event_stats_reset ();
+char* event_stats_json ();
@@ -0,0 +1,71 @@
+// Copyright 2014 Technical Machine, Inc. See the COPYRIGHT
+// file at the top-level directory of this distribution.
+//
+// Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+// http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+// <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+// option. This file may not be copied, modified, or distributed
+// except according to those terms.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdint.h>
+
+#include "json.h"
+
+// Allocates `size` bytes for a report. Returns -1 if there's no memory.
+int json_begin (json_t* json, size_t size)
+{
+	json->buf = malloc(size);
+	json->size = size;
+	json->len = 0;
+	json->overflow = json->buf == NULL;
+	if (json->buf) {
+		json->buf[0] = '\0';
+	}
+	return json->buf ? 0 : -1;
+}
+
+void json_append (json_t* json, const char* format, ...)
+{
+	if (json->overflow) {
+		return;
+	}
+	va_list args;
+	va_start(args, format);
+	int n = vsnprintf(json->buf + json->len, json->size - json->len, format, args);
+	va_end(args);
+	if (n < 0 || (size_t) n >= json->size - json->len) {
+		json->overflow = 1;
+		return;
+	}
+	json->len += n;
+}
+
+// Appends `str` as a quoted, escaped JSON string
+void json_append_string (json_t* json, const char* str)
+{
+	json_append(json, "\"");
+	for (; *str && !json->overflow; str++) {
+		if (*str == '"' || *str == '\\') {
+			json_append(json, "\\%c", *str);
+		} else if ((uint8_t) *str < 0x20) {
+			json_append(json, "\\u%04x", (uint8_t) *str);
+		} else {
+			json_append(json, "%c", *str);
+		}
+	}
+	json_append(json, "\"");
+}
+
+// Returns the finished report, for the caller to free, or NULL if it didn't
+// fit (or was never allocated).
+char* json_end (json_t* json)
+{
+	if (json->overflow) {
+		free(json->buf);
+		json->buf = NULL;
+	}
+	return json->buf;
+}
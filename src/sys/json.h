@@ -0,0 +1,28 @@
+// Copyright 2014 Technical Machine, Inc. See the COPYRIGHT
+// file at the top-level directory of this distribution.
+//
+// Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+// http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+// <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+// option. This file may not be copied, modified, or distributed
+// except according to those terms.
+
+// JSON reports built into a fixed size malloc'd buffer. An append that
+// doesn't fit marks the report as overflowed rather than cutting it short,
+// so a report is either whole or not handed out at all.
+
+#pragma once
+
+#include <stddef.h>
+
+typedef struct {
+	char* buf;
+	size_t size;
+	size_t len;
+	int overflow;
+} json_t;
+
+int json_begin (json_t* json, size_t size);
+void json_append (json_t* json, const char* format, ...) __attribute__ ((format (printf, 2, 3)));
+void json_append_string (json_t* json, const char* str);
+char* json_end (json_t* json);
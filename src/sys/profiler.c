@@ -0,0 +1,160 @@
+// Copyright 2014 Technical Machine, Inc. See the COPYRIGHT
+// file at the top-level directory of this distribution.
+//
+// Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+// http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+// <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+// option. This file may not be copied, modified, or distributed
+// except according to those terms.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "LPC18xx.h"
+#include "lpc18xx_cgu.h"
+#include "hw.h"
+#include "profiler.h"
+
+#define TIMER LPC_TIMER2
+#define TIMER_INDEX 2
+
+// Must be a power of two.
+#define PROFILER_RING_SIZE 1024
+#define PROFILER_RING_MASK (PROFILER_RING_SIZE - 1)
+
+// Ship samples once this many are buffered.
+#define PROFILER_FLUSH_SAMPLES 128
+
+typedef struct {
+	uint32_t pc;
+	uint32_t lr;
+} profiler_sample_t;
+
+static profiler_sample_t profiler_ring[PROFILER_RING_SIZE];
+static volatile uint32_t profiler_head = 0;
+static volatile uint32_t profiler_tail = 0;
+static volatile uint32_t profiler_dropped = 0;
+static uint32_t profiler_hz = 0;
+
+static void profiler_flush (hw_priority_event* event);
+static hw_priority_event profiler_flush_event = HW_PRIORITY_EVENT_INIT(profiler_flush);
+
+// Called from TIMER2_IRQHandler with the exception frame it interrupted.
+__attribute__ ((used)) void profiler_sample (uint32_t* frame)
+{
+	TIMER->IR = TIMER->IR;
+
+	uint32_t head = profiler_head;
+	if (head - profiler_tail >= PROFILER_RING_SIZE) {
+		profiler_dropped++;
+	} else {
+		// Stacked frame is r0-r3, r12, lr, pc, xpsr.
+		profiler_ring[head & PROFILER_RING_MASK].pc = frame[6];
+		profiler_ring[head & PROFILER_RING_MASK].lr = frame[5];
+		profiler_head = ++head;
+	}
+
+	if (head - profiler_tail >= PROFILER_FLUSH_SAMPLES) {
+		hw_priority_event_trigger(&profiler_flush_event);
+	}
+}
+
+// Pick whichever stack the interrupted code was using and hand its frame to
+// profiler_sample.
+__attribute__ ((naked)) void TIMER2_IRQHandler (void)
+{
+	__asm volatile (
+		"tst lr, #4\n"
+		"ite eq\n"
+		"mrseq r0, msp\n"
+		"mrsne r0, psp\n"
+		"b profiler_sample\n"
+	);
+}
+
+static void profiler_flush (hw_priority_event* event)
+{
+	(void) event;
+
+	uint32_t tail = profiler_tail;
+	uint32_t count = profiler_head - tail;
+	if (count == 0) {
+		return;
+	}
+
+	uint32_t* buf = malloc((2 + count * 2) * sizeof(uint32_t));
+	if (!buf) {
+		return;
+	}
+
+	__disable_irq();
+	buf[0] = profiler_dropped;
+	profiler_dropped = 0;
+	__enable_irq();
+	buf[1] = count;
+
+	uint32_t i;
+	for (i = 0; i < count; i++) {
+		profiler_sample_t* sample = &profiler_ring[(tail + i) & PROFILER_RING_MASK];
+		buf[2 + i * 2] = sample->pc;
+		buf[3 + i * 2] = sample->lr;
+	}
+	profiler_tail = tail + count;
+
+	hw_send_usb_msg('s', (uint8_t*) buf, (2 + count * 2) * sizeof(uint32_t));
+	free(buf);
+}
+
+// Starts (or changes the rate of) sampling. Returns 0, or the TIMER2 user
+// holding the timer.
+int profiler_start (uint32_t hz)
+{
+	if (hz == 0) {
+		hz = PROFILER_DEFAULT_HZ;
+	} else if (hz > PROFILER_MAX_HZ) {
+		hz = PROFILER_MAX_HZ;
+	}
+
+	int status = hw_timer_claim(TIMER_INDEX, HW_TIMER_PROFILER);
+	if (status) {
+		return status;
+	}
+
+	CGU_ConfigPWR(CGU_PERIPHERAL_TIMER2, ENABLE);
+
+	TIMER->TCR = (1<<1); // stop and reset counter
+	TIMER->PR = 0;
+	TIMER->MR[0] = CGU_GetPCLKFrequency(CGU_PERIPHERAL_TIMER2) / hz;
+	TIMER->MCR = (1<<0) | (1<<1); // interrupt and reset on MR0
+	TIMER->IR = 0xFFFFFFFF; // clear interrupts
+
+	profiler_hz = hz;
+
+	// Highest priority so samples land inside other handlers too.
+	NVIC_SetPriority(TIMER2_IRQn, 0);
+	NVIC_EnableIRQ(TIMER2_IRQn);
+	TIMER->TCR = (1<<0); // release reset and start
+	return 0;
+}
+
+void profiler_stop ()
+{
+	if (!profiler_hz) {
+		return;
+	}
+
+	TIMER->TCR = 0;
+	NVIC_DisableIRQ(TIMER2_IRQn);
+	TIMER->IR = 0xFFFFFFFF;
+	CGU_ConfigPWR(CGU_PERIPHERAL_TIMER2, DISABLE);
+	hw_timer_release(TIMER_INDEX, HW_TIMER_PROFILER);
+	profiler_hz = 0;
+
+	// Ship whatever is left.
+	profiler_flush(NULL);
+}
+
+uint32_t profiler_rate ()
+{
+	return profiler_hz;
+}
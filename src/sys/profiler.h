@@ -0,0 +1,31 @@
+// Copyright 2014 Technical Machine, Inc. See the COPYRIGHT
+// file at the top-level directory of this distribution.
+//
+// Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+// http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+// <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+// option. This file may not be copied, modified, or distributed
+// except according to those terms.
+
+// Statistical PC sampler. TIMER2 interrupts at the sampling rate and records
+// the PC and LR of whatever it preempted. Samples are streamed to the host
+// as USB messages tagged 's', each laid out as little-endian words:
+//
+//   [dropped] [count] [pc0] [lr0] [pc1] [lr1] ...
+//
+// where `dropped` is the number of samples lost to a full ring since the
+// previous message. tools/profile_fold.js turns a capture into folded stacks.
+//
+// TIMER2 also paces the pattern generator. Whichever starts first claims the
+// timer, and profiler_start fails while a pattern plays.
+
+#pragma once
+
+#include <stdint.h>
+
+#define PROFILER_DEFAULT_HZ 1000
+#define PROFILER_MAX_HZ 20000
+
+int profiler_start (uint32_t hz);
+void profiler_stop ();
+uint32_t profiler_rate ();
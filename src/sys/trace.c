@@ -0,0 +1,117 @@
+// Copyright 2014 Technical Machine, Inc. See the COPYRIGHT
+// file at the top-level directory of this distribution.
+//
+// Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+// http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+// <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+// option. This file may not be copied, modified, or distributed
+// except according to those terms.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "LPC18xx.h"
+#include "lpc18xx_cgu.h"
+#include "linker.h"
+#include "hw.h"
+#include "trace.h"
+
+#define TRACE_RING_MASK (TRACE_RING_SIZE - 1)
+
+static const char* trace_names[TRACE_ID_COUNT] = {
+	"spi_sync",
+	"uart_rx",
+	"i2c",
+	"usb_cmd",
+	"gc_idle",
+	"sleep",
+	"lua_spi",
+};
+
+static trace_entry_t trace_ring[TRACE_RING_SIZE];
+static volatile uint32_t trace_head = 0;
+
+const char* trace_name (unsigned id)
+{
+	return id < TRACE_ID_COUNT ? trace_names[id] : "unknown";
+}
+
+void trace_init ()
+{
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+_ramfunc void trace_record (trace_id_t id, trace_phase_t phase)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	trace_entry_t* entry = &trace_ring[trace_head & TRACE_RING_MASK];
+	entry->cycles = DWT->CYCCNT;
+	entry->id = id;
+	entry->phase = phase;
+	trace_head++;
+	__set_PRIMASK(primask);
+}
+
+void trace_clear ()
+{
+	__disable_irq();
+	trace_head = 0;
+	__enable_irq();
+}
+
+// Copies up to `count` of the most recent entries, oldest first. Does not
+// allocate or lock, so it is usable from fault handlers.
+unsigned trace_tail (trace_entry_t* entries, unsigned count)
+{
+	uint32_t head = trace_head;
+	uint32_t available = head < TRACE_RING_SIZE ? head : TRACE_RING_SIZE;
+	if (count > available) {
+		count = available;
+	}
+
+	unsigned i;
+	for (i = 0; i < count; i++) {
+		entries[i] = trace_ring[(head - count + i) & TRACE_RING_MASK];
+	}
+	return count;
+}
+
+// Sends the ring to the host as a 't' message, laid out as little-endian
+// words: [cpu hz] [entry count] [name count], the NUL-terminated span names
+// padded to a word boundary, then the entries oldest first.
+void trace_dump ()
+{
+	size_t names_len = 0;
+	unsigned i;
+	for (i = 0; i < TRACE_ID_COUNT; i++) {
+		names_len += strlen(trace_names[i]) + 1;
+	}
+	names_len = (names_len + 3) & ~3;
+
+	size_t size = 3 * sizeof(uint32_t) + names_len + TRACE_RING_SIZE * sizeof(trace_entry_t);
+	uint8_t* buf = calloc(1, size);
+	if (!buf) {
+		return;
+	}
+
+	uint32_t* header = (uint32_t*) buf;
+	header[0] = CGU_GetPCLKFrequency(CGU_PERIPHERAL_M3CORE);
+	header[2] = TRACE_ID_COUNT;
+
+	char* names = (char*) &header[3];
+	for (i = 0; i < TRACE_ID_COUNT; i++) {
+		strcpy(names, trace_names[i]);
+		names += strlen(trace_names[i]) + 1;
+	}
+
+	trace_entry_t* entries = (trace_entry_t*) (buf + 3 * sizeof(uint32_t) + names_len);
+	__disable_irq();
+	header[1] = trace_tail(entries, TRACE_RING_SIZE);
+	__enable_irq();
+
+	hw_send_usb_msg('t', buf, 3 * sizeof(uint32_t) + names_len + header[1] * sizeof(trace_entry_t));
+	free(buf);
+}
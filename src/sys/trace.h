@@ -0,0 +1,59 @@
+// Copyright 2014 Technical Machine, Inc. See the COPYRIGHT
+// file at the top-level directory of this distribution.
+//
+// Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+// http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+// <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+// option. This file may not be copied, modified, or distributed
+// except according to those terms.
+
+// Cycle-stamped span tracing. The DWT cycle counter is started at boot and
+// TRACE_BEGIN/TRACE_END record (cycles, id, phase) entries into a RAM ring,
+// from interrupt or thread context. tools/trace_chrome.js converts a dump
+// into Chrome trace-event JSON.
+
+#pragma once
+
+#include <stdint.h>
+#include "LPC18xx.h"
+
+// Add new spans here and to trace_names in trace.c.
+typedef enum {
+	TRACE_SPI_SYNC = 0,
+	TRACE_UART_RX,
+	TRACE_I2C,
+	TRACE_USB_CMD,
+	TRACE_GC_IDLE,
+	TRACE_SLEEP,
+	TRACE_LUA_SPI,
+	TRACE_ID_COUNT
+} trace_id_t;
+
+typedef enum {
+	TRACE_PHASE_BEGIN = 0,
+	TRACE_PHASE_END = 1,
+} trace_phase_t;
+
+typedef struct {
+	uint32_t cycles;
+	uint16_t id;
+	uint16_t phase;
+} trace_entry_t;
+
+// Must be a power of two.
+#define TRACE_RING_SIZE 1024
+
+void trace_init ();
+void trace_record (trace_id_t id, trace_phase_t phase);
+void trace_clear ();
+unsigned trace_tail (trace_entry_t* entries, unsigned count);
+void trace_dump ();
+const char* trace_name (unsigned id);
+
+#define TRACE_BEGIN(id) trace_record((id), TRACE_PHASE_BEGIN)
+#define TRACE_END(id) trace_record((id), TRACE_PHASE_END)
+
+static inline uint32_t trace_cycles ()
+{
+	return DWT->CYCCNT;
+}
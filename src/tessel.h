@@ -54,6 +54,22 @@ void tessel_cmd_process (uint8_t cmd, uint8_t* buf, unsigned length);
 int populate_fs (const uint8_t *file, size_t len);
 
 int debugstack();
+void debugstack_send (struct lua_State* L);
+
+// JS function profiler, driven by a Lua count hook.
+int tessel_profile_start (int interval);
+void tessel_profile_stop ();
+void tessel_profile_reset ();
+void tessel_profile_idle_begin ();
+void tessel_profile_idle_end ();
+int tessel_profile_request_traceback ();
+char* tessel_profile_json ();
+void tessel_profile_command (uint8_t* buf, unsigned size);
+
+// Idle-time garbage collection, run from hw_wait_for_event.
+void tessel_gc_idle ();
+void tessel_gc_configure (int budget_us, int step_kb, int pause, int stepmul);
+void tessel_gc_reset ();
 
 void tessel_reset_board ();
 
@@ -0,0 +1,89 @@
+// Copyright 2014 Technical Machine, Inc. See the COPYRIGHT
+// file at the top-level directory of this distribution.
+//
+// Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+// http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+// <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+// option. This file may not be copied, modified, or distributed
+// except according to those terms.
+
+// Idle-time garbage collection. When the event loop has nothing to do,
+// run bounded incremental GC steps before sleeping so that collection work
+// is paid for while idle instead of inside latency-sensitive callbacks.
+
+#include "tm.h"
+#include "colony.h"
+#include "tessel.h"
+#include "hw.h"
+
+#define GC_IDLE_DEFAULT_BUDGET_US 1000
+#define GC_IDLE_DEFAULT_STEP_KB 4
+
+static uint32_t gc_idle_budget_us = GC_IDLE_DEFAULT_BUDGET_US;
+static int gc_idle_step_kb = GC_IDLE_DEFAULT_STEP_KB;
+
+// Heap size when the last idle cycle finished. Idle collection resumes
+// once the heap has grown by at least one step past this.
+static size_t gc_idle_settled = 0;
+
+static size_t gc_heap_bytes (lua_State* L)
+{
+	return ((size_t) lua_gc(L, LUA_GCCOUNT, 0) << 10) + lua_gc(L, LUA_GCCOUNTB, 0);
+}
+
+void tessel_gc_idle ()
+{
+	lua_State* L = tm_lua_state;
+	if (!L || gc_idle_budget_us == 0) {
+		return;
+	}
+
+	// Nothing new to collect since the last finished cycle.
+	if (gc_heap_bytes(L) < gc_idle_settled + ((size_t) gc_idle_step_kb << 10)) {
+		return;
+	}
+
+	uint32_t start = tm_uptime_micro();
+	while (!tm_events_pending() && !hw_priority_events_pending()) {
+		if (lua_gc(L, LUA_GCSTEP, gc_idle_step_kb)) {
+			// Finished a full cycle.
+			gc_idle_settled = gc_heap_bytes(L);
+			break;
+		}
+		if (tm_uptime_micro() - start >= gc_idle_budget_us) {
+			break;
+		}
+	}
+}
+
+// Negative budget or non-positive step, pause and multiplier values leave
+// the current setting unchanged. A budget of zero disables idle collection.
+void tessel_gc_configure (int budget_us, int step_kb, int pause, int stepmul)
+{
+	if (budget_us >= 0) {
+		gc_idle_budget_us = budget_us;
+	}
+	if (step_kb > 0) {
+		gc_idle_step_kb = step_kb;
+	}
+
+	// Pause and step multiplier tune the allocator-driven collector; a larger
+	// pause leaves more of the work to the idle path.
+	lua_State* L = tm_lua_state;
+	if (L) {
+		if (pause > 0) {
+			lua_gc(L, LUA_GCSETPAUSE, pause);
+		}
+		if (stepmul > 0) {
+			lua_gc(L, LUA_GCSETSTEPMUL, stepmul);
+		}
+	}
+	gc_idle_settled = 0;
+}
+
+void tessel_gc_reset ()
+{
+	gc_idle_budget_us = GC_IDLE_DEFAULT_BUDGET_US;
+	gc_idle_step_kb = GC_IDLE_DEFAULT_STEP_KB;
+	gc_idle_settled = 0;
+}
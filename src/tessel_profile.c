@@ -0,0 +1,328 @@
+// Copyright 2014 Technical Machine, Inc. See the COPYRIGHT
+// file at the top-level directory of this distribution.
+//
+// Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+// http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+// <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+// option. This file may not be copied, modified, or distributed
+// except according to those terms.
+
+// JS function profiler. A Lua count hook samples the stack every N VM
+// instructions and charges the time since the previous sample to the running
+// function (self) and to every distinct function on the stack (total), keyed
+// by chunk name and line defined. Colony keeps JS line numbers in the
+// compiled chunks, so sources and lines refer to the original scripts.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "tm.h"
+#include "colony.h"
+#include "tessel.h"
+#include "hw.h"
+#include "json.h"
+
+#define PROFILE_DEFAULT_INTERVAL 1000
+#define PROFILE_MAX_FUNCS 256
+#define PROFILE_MAX_LINES 1024
+#define PROFILE_MAX_DEPTH 64
+#define PROFILE_NAME_SIZE 32
+
+typedef struct {
+	uint32_t hash; // zero when the slot is empty
+	int linedefined;
+	char source[LUA_IDSIZE];
+	char name[PROFILE_NAME_SIZE];
+	uint32_t samples;
+	uint32_t self_us;
+	uint32_t total_us;
+} profile_func_t;
+
+typedef struct {
+	int func; // -1 when the slot is empty
+	int line;
+	uint32_t samples;
+	uint32_t self_us;
+} profile_line_t;
+
+static profile_func_t* profile_funcs = NULL;
+static profile_line_t* profile_lines = NULL;
+
+static lua_State* profile_state = NULL;
+static int profile_interval = 0;
+static uint32_t profile_last = 0;
+static uint32_t profile_idle_at = 0;
+static uint32_t profile_samples = 0;
+static uint32_t profile_lost = 0;
+static uint32_t profile_elapsed_us = 0;
+static volatile uint8_t profile_traceback_pending = 0;
+
+static uint32_t profile_hash (const char* source, int linedefined)
+{
+	uint32_t hash = 2166136261u;
+	while (*source) {
+		hash = (hash ^ (uint8_t) *source++) * 16777619u;
+	}
+	hash ^= (uint32_t) linedefined * 2654435761u;
+	return hash ? hash : 1;
+}
+
+static int profile_func_find (lua_Debug* info)
+{
+	uint32_t hash = profile_hash(info->short_src, info->linedefined);
+	unsigned i, slot = hash % PROFILE_MAX_FUNCS;
+	for (i = 0; i < PROFILE_MAX_FUNCS; i++, slot = (slot + 1) % PROFILE_MAX_FUNCS) {
+		profile_func_t* func = &profile_funcs[slot];
+		if (func->hash == 0) {
+			func->hash = hash;
+			func->linedefined = info->linedefined;
+			strncpy(func->source, info->short_src, sizeof(func->source) - 1);
+			strncpy(func->name, info->name ? info->name : "", sizeof(func->name) - 1);
+			return slot;
+		}
+		if (func->hash == hash && func->linedefined == info->linedefined
+			&& strcmp(func->source, info->short_src) == 0) {
+			return slot;
+		}
+	}
+	return -1;
+}
+
+static profile_line_t* profile_line_find (int func, int line)
+{
+	unsigned i, slot = ((unsigned) func * 31 + (unsigned) line) % PROFILE_MAX_LINES;
+	for (i = 0; i < PROFILE_MAX_LINES; i++, slot = (slot + 1) % PROFILE_MAX_LINES) {
+		profile_line_t* entry = &profile_lines[slot];
+		if (entry->func < 0) {
+			entry->func = func;
+			entry->line = line;
+			return entry;
+		}
+		if (entry->func == func && entry->line == line) {
+			return entry;
+		}
+	}
+	return NULL;
+}
+
+static void profile_hook (lua_State* L, lua_Debug* ar)
+{
+	(void) ar;
+
+	uint32_t now = tm_uptime_micro();
+	uint32_t elapsed = now - profile_last;
+	profile_last = now;
+
+	profile_samples++;
+	profile_elapsed_us += elapsed;
+
+	int seen[PROFILE_MAX_DEPTH];
+	int depth = 0;
+	int level;
+	lua_Debug info;
+	for (level = 0; depth < PROFILE_MAX_DEPTH && lua_getstack(L, level, &info); level++) {
+		if (!lua_getinfo(L, "Snl", &info) || info.what[0] == 'C') {
+			continue;
+		}
+
+		int func = profile_func_find(&info);
+		if (func < 0) {
+			profile_lost++;
+			continue;
+		}
+
+		if (depth == 0) {
+			// Innermost JS function gets the self time.
+			profile_funcs[func].samples++;
+			profile_funcs[func].self_us += elapsed;
+
+			profile_line_t* line = profile_line_find(func, info.currentline);
+			if (line) {
+				line->samples++;
+				line->self_us += elapsed;
+			}
+		}
+
+		// Count recursive frames once.
+		int i;
+		for (i = 0; i < depth && seen[i] != func; i++) { }
+		if (i == depth) {
+			profile_funcs[func].total_us += elapsed;
+			seen[depth++] = func;
+		}
+	}
+
+	if (profile_traceback_pending) {
+		profile_traceback_pending = 0;
+		debugstack_send(L);
+	}
+
+	// Leave the profiler's own time out of the next sample.
+	profile_last = tm_uptime_micro();
+}
+
+static void profile_clear ()
+{
+	unsigned i;
+	memset(profile_funcs, 0, PROFILE_MAX_FUNCS * sizeof(profile_func_t));
+	for (i = 0; i < PROFILE_MAX_LINES; i++) {
+		profile_lines[i].func = -1;
+	}
+	profile_samples = 0;
+	profile_lost = 0;
+	profile_elapsed_us = 0;
+}
+
+int tessel_profile_start (int interval)
+{
+	lua_State* L = tm_lua_state;
+	if (!L) {
+		return -1;
+	}
+	if (profile_state) {
+		return 0;
+	}
+	if (lua_gethook(L) != 0) {
+		// Another hook probably means we're in the process of exiting
+		return -2;
+	}
+
+	if (!profile_funcs) {
+		profile_funcs = malloc(PROFILE_MAX_FUNCS * sizeof(profile_func_t));
+		profile_lines = malloc(PROFILE_MAX_LINES * sizeof(profile_line_t));
+		if (!profile_funcs || !profile_lines) {
+			free(profile_funcs);
+			free(profile_lines);
+			profile_funcs = NULL;
+			profile_lines = NULL;
+			return -3;
+		}
+		profile_clear();
+	}
+
+	profile_interval = interval > 0 ? interval : PROFILE_DEFAULT_INTERVAL;
+	profile_state = L;
+	profile_last = tm_uptime_micro();
+	lua_sethook(L, profile_hook, LUA_MASKCOUNT, profile_interval);
+	return 0;
+}
+
+void tessel_profile_stop ()
+{
+	// Leave any other hook (such as the exit hook) in place.
+	if (profile_state && lua_gethook(profile_state) == profile_hook) {
+		lua_sethook(profile_state, NULL, 0, 0);
+	}
+	profile_state = NULL;
+}
+
+// Called from hw_wait_for_event so that time spent idle is not charged to
+// whichever function is sampled next.
+void tessel_profile_idle_begin ()
+{
+	if (profile_state) {
+		profile_idle_at = tm_uptime_micro();
+	}
+}
+
+void tessel_profile_idle_end ()
+{
+	if (profile_state) {
+		profile_last += tm_uptime_micro() - profile_idle_at;
+	}
+}
+
+// Returns nonzero if the profiler will send a traceback on its next sample,
+// since debugstack cannot install its own hook while the profiler runs.
+int tessel_profile_request_traceback ()
+{
+	if (!profile_state) {
+		return 0;
+	}
+	profile_traceback_pending = 1;
+	return 1;
+}
+
+// Drops the results and detaches from a Lua state that is about to close.
+void tessel_profile_reset ()
+{
+	tessel_profile_stop();
+	free(profile_funcs);
+	free(profile_lines);
+	profile_funcs = NULL;
+	profile_lines = NULL;
+	profile_traceback_pending = 0;
+}
+
+// Returns a malloc'd JSON report, or NULL.
+char* tessel_profile_json ()
+{
+	size_t size = 256 + PROFILE_MAX_FUNCS * (128 + 2 * (LUA_IDSIZE + PROFILE_NAME_SIZE)) + PROFILE_MAX_LINES * 64;
+	json_t json;
+	if (json_begin(&json, size)) {
+		return NULL;
+	}
+
+	unsigned i;
+	json_append(&json, "{\"running\": %s, \"interval\": %d, \"samples\": %lu, \"lost\": %lu, \"elapsed_us\": %lu, \"functions\": [",
+		profile_state ? "true" : "false", profile_interval, (unsigned long) profile_samples,
+		(unsigned long) profile_lost, (unsigned long) profile_elapsed_us);
+
+	int first = 1;
+	for (i = 0; profile_funcs && i < PROFILE_MAX_FUNCS; i++) {
+		profile_func_t* func = &profile_funcs[i];
+		if (func->hash == 0) {
+			continue;
+		}
+		json_append(&json, "%s{\"id\": %u, \"name\": ", first ? "" : ", ", i);
+		json_append_string(&json, func->name);
+		json_append(&json, ", \"source\": ");
+		json_append_string(&json, func->source);
+		json_append(&json, ", \"line\": %d, \"samples\": %lu, \"self_us\": %lu, \"total_us\": %lu}",
+			func->linedefined, (unsigned long) func->samples,
+			(unsigned long) func->self_us, (unsigned long) func->total_us);
+		first = 0;
+	}
+
+	json_append(&json, "], \"lines\": [");
+	first = 1;
+	for (i = 0; profile_lines && i < PROFILE_MAX_LINES; i++) {
+		profile_line_t* line = &profile_lines[i];
+		if (line->func < 0) {
+			continue;
+		}
+		json_append(&json, "%s{\"function\": %d, \"line\": %d, \"samples\": %lu, \"self_us\": %lu}",
+			first ? "" : ", ", line->func, line->line,
+			(unsigned long) line->samples, (unsigned long) line->self_us);
+		first = 0;
+	}
+	json_append(&json, "]}");
+	return json_end(&json);
+}
+
+void tessel_profile_command (uint8_t* buf, unsigned size)
+{
+	uint8_t op = size > 0 ? buf[0] : 'r';
+	if (op == 's') {
+		int interval = 0;
+		if (size >= 5) {
+			interval = buf[1] | (buf[2] << 8) | (buf[3] << 16) | ((uint32_t) buf[4] << 24);
+		}
+		if (profile_funcs && !profile_state) {
+			profile_clear();
+		}
+		tessel_profile_start(interval);
+	} else if (op == 'x') {
+		tessel_profile_stop();
+	} else if (op == 'c' && profile_funcs) {
+		profile_clear();
+	}
+
+	char* report = tessel_profile_json();
+	if (report) {
+		hw_send_usb_msg('j', (uint8_t*) report, strlen(report));
+		free(report);
+	} else {
+		TM_COMMAND('j', "{\"error\": \"profile report too large\"}");
+	}
+}
@@ -24,6 +24,7 @@
 #include "tm.h"
 #include "utility/wlan.h"
 #include "colony.h"
+#include "event_stats.h"
 
 static uint8_t MAX_CC_BOOT_TICKS = 120;
 int wifi_initialized = 0;
@@ -60,6 +61,7 @@ void wifi_connection_callback (void) {
 	lua_State* L = tm_lua_state;
 	if (!L) return;
 
+	event_stats_begin(EVENT_SOURCE_WIFI);
 	tm_event_unref(&wifi_connect_event);
 
 	// Push the _colony_emit helper function onto the stack
@@ -78,12 +80,14 @@ void wifi_connection_callback (void) {
  
 	// Call _colony_emit to run the JS callback
 	tm_checked_call(L, 3);
+	event_stats_end();
 }
 
 void wifi_disconnect_callback(void) {
 	lua_State* L = tm_lua_state;
 	if (!L) return;
 
+	event_stats_begin(EVENT_SOURCE_WIFI);
 	tm_event_unref(&wifi_disconnect_event);
 
 	lua_getglobal(L, "_colony_emit");
@@ -91,6 +95,7 @@ void wifi_disconnect_callback(void) {
 	lua_pushnumber(L, 0);
 
 	tm_checked_call(L, 2);
+	event_stats_end();
 }
 
 uint8_t get_cc3k_irq_flag () {
@@ -101,17 +106,21 @@ void set_cc3k_irq_flag (uint8_t value) {
 	CC3K_IRQ_FLAG = value;
 }
 
-void SPI_IRQ_CALLBACK_EVENT (tm_event* event)
+void SPI_IRQ_CALLBACK_EVENT (hw_priority_event* event)
 {
 	(void) event;
+	event_stats_begin(EVENT_SOURCE_CC3K_IRQ);
 	CC3K_EVENT_ENABLED = 0;
 	if (CC3K_IRQ_FLAG) {
 		CC3K_IRQ_FLAG = 0;
 		SPI_IRQ();
 	}
+	event_stats_end();
 }
 
-tm_event cc3k_irq_event = TM_EVENT_INIT(SPI_IRQ_CALLBACK_EVENT);
+// Driver work, so it runs ahead of queued Lua callbacks. The CC3000
+// callbacks it reaches hand anything Lua-facing to tm_events.
+hw_priority_event cc3k_irq_event = HW_PRIORITY_EVENT_INIT(SPI_IRQ_CALLBACK_EVENT);
 
 void _tessel_cc3000_irq_interrupt ()
 {
@@ -121,7 +130,8 @@ void _tessel_cc3000_irq_interrupt ()
 		CC3K_IRQ_FLAG = 1;
     	if (!CC3K_EVENT_ENABLED) {
     		CC3K_EVENT_ENABLED = 1;
-			tm_event_trigger(&cc3k_irq_event);
+			event_stats_trigger(EVENT_SOURCE_CC3K_IRQ);
+			hw_priority_event_trigger(&cc3k_irq_event);
 		}
 		GPIO_ClearInt(TM_INTERRUPT_MODE_FALLING, CC3K_GPIO_INTERRUPT);
 	}
@@ -144,7 +154,8 @@ int cc_blink = 1;
 int cc_blink = 0;
 #endif
 int cc_bootup = 0;
-void _cc3000_cb_animation_tick (size_t frame)
+// Returns 0 once the LED has stopped blinking, so the tick can be cancelled
+int _cc3000_cb_animation_tick (size_t frame)
 {
 	if (cc_blink) {
 		hw_digital_write(CC3K_CONN_LED, frame & 1 ? 1 : 0);
@@ -160,12 +171,19 @@ void _cc3000_cb_animation_tick (size_t frame)
 			}
 		}
 	}
+	return cc_blink;
+}
+
+static void cc_blink_start (void)
+{
+	cc_blink = 1;
+	cc_animation();
 }
 
 void _cc3000_cb_acquire ()
 {
 	TM_COMMAND('W', "{\"event\": \"acquire\"}");
-	cc_blink = 1;
+	cc_blink_start();
 	hw_digital_write(CC3K_ERR_LED, 0);
 	hw_digital_write(CC3K_CONN_LED, 0);
 }
@@ -184,7 +202,7 @@ void _cc3000_cb_wifi_connect ()
 	TM_COMMAND('W', "{\"event\": \"connect\"}");
 	// only dhcp events that come after this are valid
 	wifi_status.post_connect = true;
-	cc_blink = 1;
+	cc_blink_start();
 	hw_digital_write(CC3K_ERR_LED, 0);
 	hw_digital_write(CC3K_CONN_LED, 0);
 }
@@ -197,6 +215,7 @@ void _cc3000_cb_wifi_disconnect ()
 	hw_digital_write(CC3K_ERR_LED, 1);
 	hw_digital_write(CC3K_CONN_LED, 0);
 
+	event_stats_trigger(EVENT_SOURCE_WIFI);
 	tm_event_trigger(&wifi_disconnect_event);
 }
 
@@ -224,12 +243,36 @@ void _cc3000_cb_dhcp_success ()
 	hw_digital_write(CC3K_CONN_LED, 1);
 }
 
+// Sockets closed by the CC3000, queued from its (priority event) IRQ
+// handling for a normal event to report to Lua in order
+#define TCP_CLOSE_QUEUE 16
+
+static volatile uint32_t tcp_close_queue[TCP_CLOSE_QUEUE];
+static volatile uint8_t tcp_close_head = 0;
+static volatile uint8_t tcp_close_tail = 0;
+
+static void tcp_close_callback (tm_event* event)
+{
+	(void) event;
+	while (tcp_close_tail != tcp_close_head) {
+		uint32_t s = tcp_close_queue[tcp_close_tail % TCP_CLOSE_QUEUE];
+		tcp_close_tail++;
+		if (tm_lua_state != NULL) {
+			colony_ipc_emit(tm_lua_state, "tcp-close", &s, sizeof(uint32_t));
+		}
+	}
+}
+
+static tm_event tcp_close_event = TM_EVENT_INIT(tcp_close_callback);
+
 void _cc3000_cb_tcp_close (int socket)
 {
-	uint32_t s = socket;
-	if (tm_lua_state != NULL) {
-		colony_ipc_emit(tm_lua_state, "tcp-close", &s, sizeof(uint32_t));
+	// the CC3000 has far fewer sockets than the queue holds
+	if ((uint8_t) (tcp_close_head - tcp_close_tail) < TCP_CLOSE_QUEUE) {
+		tcp_close_queue[tcp_close_head % TCP_CLOSE_QUEUE] = socket;
+		tcp_close_head++;
 	}
+	tm_event_trigger(&tcp_close_event);
 }
 
 int tessel_wifi_initialized(){
@@ -341,6 +384,7 @@ void tessel_wifi_check (uint8_t asevent)
 			wifi_status.callback_payload = payload;
 			wifi_status.post_connect = false;
 			// callback
+			event_stats_trigger(EVENT_SOURCE_WIFI);
 			tm_event_trigger(&wifi_connect_event);
 		} else {
 			free(payload); 
@@ -356,6 +400,7 @@ void tessel_wifi_check (uint8_t asevent)
 			wifi_status.callback_payload = NULL;
 			wifi_status.post_connect = false;
 
+			event_stats_trigger(EVENT_SOURCE_WIFI);
 			tm_event_trigger(&wifi_connect_event);
 
 		}
@@ -28,6 +28,7 @@ int tessel_wifi_connect(char * wifi_security, char * wifi_ssid, size_t ssidlen,
 void tessel_wifi_fastconnect();
 
 void _tessel_cc3000_irq_interrupt ();
-void _cc3000_cb_animation_tick (size_t frame);
+int _cc3000_cb_animation_tick (size_t frame);
+void cc_animation ();
 
 #endif /* TESSEL_WIFI_H_ */
@@ -10,6 +10,7 @@
 #include "LPC18xx.h"
 #include "lpc18xx_cgu.h"
 #include "tm.h"
+#include "event_stats.h"
 
 void tm_timestamp_wrapped();
 
@@ -59,6 +60,7 @@ void hw_timer_update_interrupt()
             // wakeup. It's fine if the interrupt triggerred between enabling
             // it and testing it because tm_event_trigger is atomic and
             // idempotent.
+            event_stats_trigger(EVENT_SOURCE_TIMER);
             tm_event_trigger(&tm_timer_event);
         }
     }
@@ -69,6 +71,7 @@ void hw_timer_update_interrupt()
 void __attribute__ ((interrupt)) TIMER3_IRQHandler() {
     if (TIMER->IR & TIMER_IR(TIMER_CHAN_EVT)) {
         TIMER->IR = TIMER_IR(TIMER_CHAN_EVT);
+        event_stats_trigger(EVENT_SOURCE_TIMER);
         tm_event_trigger(&tm_timer_event);
     }
 
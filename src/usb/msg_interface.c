@@ -13,16 +13,21 @@
 #include "tessel.h"
 #include "usb/tessel_usb.h"
 #include "tm.h"
+#include "event_stats.h"
+#include "trace.h"
+#include "hw.h"
 #include "tessel.h"
 
 void msg_out_rearm_ep(void);
-void msg_in_handler(tm_event* event);
+void msg_in_handler(hw_priority_event* event);
 void msg_out_handler(tm_event* event);
-void msg_cleanup_handler(tm_event* event);
+void msg_cleanup_handler(hw_priority_event* event);
 
-tm_event msg_in_event = TM_EVENT_INIT(msg_in_handler);
+// Finishing an IN transfer and starting the next one never touches Lua, so
+// those run as priority events; OUT messages may call into Lua.
+hw_priority_event msg_in_event = HW_PRIORITY_EVENT_INIT(msg_in_handler);
 tm_event msg_out_event = TM_EVENT_INIT(msg_out_handler);
-tm_event msg_cleanup_event = TM_EVENT_INIT(msg_cleanup_handler);
+hw_priority_event msg_cleanup_event = HW_PRIORITY_EVENT_INIT(msg_cleanup_handler);
 
 bool usb_msg_connected = 0;
 
@@ -35,7 +40,7 @@ void usb_msg_init(uint16_t altsetting) {
 	} else {
 		usb_set_stall_ep(msg_in_ep);
 		usb_set_stall_ep(msg_out_ep);
-		tm_event_trigger(&msg_cleanup_event);
+		hw_priority_event_trigger(&msg_cleanup_event);
 	}
 }
 
@@ -76,7 +81,8 @@ void msg_in_start_ep(void) {
 		msg_in_pos += remaining;
 	} else {
 		// Notify completion
-		tm_event_trigger(&msg_in_event);
+		event_stats_trigger(EVENT_SOURCE_USB_MSG_IN);
+		hw_priority_event_trigger(&msg_in_event);
 	}
 }
 
@@ -137,6 +143,7 @@ void handle_msg_completion() {
 		if (msg_out_buf == 0) {
 			if (received >= msg_header_size) {
 				msg_out_pos = received - msg_header_size;
+				event_stats_trigger(EVENT_SOURCE_USB_MSG_OUT);
 				tm_event_trigger(&msg_out_event);
 			} else {
 				TM_DEBUG("Invalid short packet on msg_out endpoint");
@@ -145,6 +152,7 @@ void handle_msg_completion() {
 		} else {
 			msg_out_pos += received;
 			if (received < msg_max_blocksize || msg_out_pos > msg_out_length) {
+				event_stats_trigger(EVENT_SOURCE_USB_MSG_OUT);
 				tm_event_trigger(&msg_out_event);
 			} else {
 				msg_out_start_ep();
@@ -153,7 +161,7 @@ void handle_msg_completion() {
 	}
 }
 
-void msg_cleanup_handler(tm_event* event) {
+void msg_cleanup_handler(hw_priority_event* event) {
 	(void) event;
 	if (msg_out_buf) {
 		free(msg_out_buf);
@@ -172,6 +180,7 @@ void msg_cleanup_handler(tm_event* event) {
 
 void msg_out_handler(tm_event* event) {
 	(void) event;
+	event_stats_begin(EVENT_SOURCE_USB_MSG_OUT);
 	if (msg_out_buf == 0) {
 		memcpy(&msg_out_length, msg_out_initial, 4);
 		msg_out_buf = malloc(msg_out_length);
@@ -179,7 +188,9 @@ void msg_out_handler(tm_event* event) {
 
 		if (msg_out_length + msg_header_size >= sizeof(msg_out_initial)) {
 			// Now that the buffer is allocated, receive the rest of the data into it
-			return msg_out_start_ep();
+			msg_out_start_ep();
+			event_stats_end();
+			return;
 		}
 	}
 
@@ -189,7 +200,13 @@ void msg_out_handler(tm_event* event) {
 
 		if (tag >> 24 == 0) {
 			// Pass to original command processor
+			TRACE_BEGIN(TRACE_USB_CMD);
 			tessel_cmd_process(tag & 0xFF, msg_out_buf, msg_out_length);
+			TRACE_END(TRACE_USB_CMD);
+		} else if (tag >> 24 == HW_NEOPIXEL_USB_TAG) {
+			// A NeoPixel stream frame, or part of one
+			neopixel_stream_write(tag & 0xFFFFFF, msg_out_buf, msg_out_length);
+			free(msg_out_buf);
 		} else if (tag >> 24 == 0xAA) {
 			// Echo
 			hw_send_usb_msg(tag, msg_out_buf, msg_out_length);
@@ -207,10 +224,12 @@ void msg_out_handler(tm_event* event) {
 	msg_out_pos = 0;
 	msg_out_length = 0;
 	msg_out_rearm_ep();
+	event_stats_end();
 }
 
-void msg_in_handler(tm_event* event) {
+void msg_in_handler(hw_priority_event* event) {
 	(void) event;
+	event_stats_begin(EVENT_SOURCE_USB_MSG_IN);
 
 	msg_in_pos = 0;
 	message_list_item* item = in_head;
@@ -221,4 +240,5 @@ void msg_in_handler(tm_event* event) {
 	if (in_head) {
 		msg_in_start_ep();	
 	}
+	event_stats_end();
 }
@@ -0,0 +1,37 @@
+/*
+ Per-call cost of the hw bindings through the Lua C API and, on LuaJIT
+ builds, through the FFI. Toggles LED1; no wiring needed.
+*/
+
+var tessel = require('tessel'),
+    test = require('tape'),
+    hw = process.binding('hw');
+
+var CALLS = 20000;
+var led = hw.PIN_LED1;
+
+function perCall (fn) {
+  var start = tessel.cycles();
+  for (var i = 0; i < CALLS; i++) {
+    fn(led, i & 1);
+  }
+  // The cycle counter wraps every ~24s, far longer than a run.
+  return ((tessel.cycles() - start) >>> 0) / CALLS;
+}
+
+test('digital_write per-call cost', function (t) {
+  hw.digital_output(led);
+
+  var capi = perCall(function (pin, val) { hw.digital_write(pin, val); });
+  t.ok(capi > 0, 'C API: ' + capi.toFixed(1) + ' cycles/call');
+
+  if (hw.ffi_enabled) {
+    var ffi = perCall(function (pin, val) { hw.ffi.digital_write(pin, val); });
+    t.ok(ffi > 0, 'FFI: ' + ffi.toFixed(1) + ' cycles/call (' + (capi / ffi).toFixed(1) + 'x)');
+  } else {
+    t.ok(true, 'FFI not available on this build', { skip: true });
+  }
+
+  hw.digital_write(led, 0);
+  t.end();
+});
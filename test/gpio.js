@@ -368,3 +368,65 @@ test('async rawWrite rawRead', function(t) {
     });
   });
 });
+
+test('batched writePins readPins', function(t) {
+  var port = tessel.port['GPIO'];
+  port.writePins(1, [trigger]);
+  t.equal(port.readPins([pin, trigger]), 3);
+  tessel.writePins([trigger], [false]);
+  t.equal(tessel.readPins([pin, trigger]), 0);
+  t.throws(tessel.writePins.bind(tessel, [255], 0));
+  t.end();
+});
+
+test('every edge of a burst is delivered with its own timestamp', function(t) {
+  var times = [];
+  function onRise(time) {
+    times.push(time);
+  }
+  trigger.low();
+  pin.on('rise', onRise);
+  for (var i = 0; i < 10; i++) {
+    trigger.high();
+    trigger.low();
+  }
+  setTimeout(function() {
+    pin.removeListener('rise', onRise);
+    t.equal(times.length, 10);
+    for (var i = 1; i < times.length; i++) {
+      t.ok(times[i] >= times[i - 1], 'timestamps are in order');
+    }
+    t.end();
+  }, 50);
+});
+
+test('watchPins reports changes as a diff', function(t) {
+  trigger.low();
+  var group = tessel.port['GPIO'].watchPins([pin]);
+  group.once('change', function(changed, levels, time) {
+    group.stop();
+    t.equal(changed, 1);
+    t.equal(levels, 1);
+    t.ok(time > 0);
+    t.end();
+  });
+  trigger.high();
+});
+
+test('countEdges counts without per-edge events', function(t) {
+  trigger.low();
+  var total = 0;
+  var counter = pin.countEdges({ edge: 'rise', window: 20 });
+  counter.on('count', function(count, frequency) {
+    total += count;
+    if (total >= 100) {
+      counter.stop();
+      t.equal(total, 100);
+      t.end();
+    }
+  });
+  for (var i = 0; i < 100; i++) {
+    trigger.high();
+    trigger.low();
+  }
+});
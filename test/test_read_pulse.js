@@ -96,15 +96,22 @@ function testHighPulseTimeout(t) {
   }, 1300 );
 }
 
-// Test that readPulse does not interfere with neopixel
+// Test that readPulse runs on the other SCT counter alongside neopixels
 function testNeopixelThenReadPulse(t) {
+  var pending = 2;
+  function done () {
+    if (--pending == 0) {
+      testLowPulseTimeout(t);
+    }
+  }
   neopixels.animate(numNeopixels, Buffer.concat(tracer(numNeopixels)), function (err) {
     t.error(err,'no error when animating neopixels');
-    testLowPulseTimeout(t);
+    done();
   });
-  pinInput.readPulse('low',5000, function (err,pul) {
+  pinInput.readPulse('low',500, function (err,pul) {
     t.equal(err == null,false,'error when reading pulse');
-    t.equal(err.message, 'SCT is already in use by Neopixels', 'readPulse tried using sct (in use by neopixels)');
+    t.equal(err.message, 'SCT timed out while attempting to read pulse', 'readPulse runs while neopixels animate');
+    done();
   });
 }
 
@@ -126,6 +133,30 @@ function testReadPulseThenReadPulse(t) {
   });
 }
 
+// Test that a stream of pulses is recorded back to back
+test('testing readPulses functionality', function (t) {
+  pinOutput.write(0);
+  pinInput.readPulses({ count: 4, timeout: 1000 }, function (err, widths, levels) {
+    t.error(err, 'no error when reading pulses');
+    t.deepEqual(levels, [1, 0, 1, 0], 'alternating high and low pulses');
+    [100, 50, 100, 50].forEach(function (expected, i) {
+      var ms = widths[i] / 1000;
+      t.equal((Math.abs(expected-ms)/expected) <= marginOfError, true, expected + 'ms pulse');
+    });
+    t.end();
+  });
+  var levels = [1, 0, 1, 0, 1, 0];
+  var delays = [100, 100, 50, 100, 50, 100];
+  (function next (i) {
+    if (i < levels.length) {
+      setTimeout(function () {
+        pinOutput.write(levels[i]);
+        next(i + 1);
+      }, delays[i]);
+    }
+  })(0);
+});
+
 // The animation to run on neopixel strip/ring
 function tracer(numLEDs) {
   var trail = 5;
@@ -0,0 +1,98 @@
+#!/usr/bin/env node
+// Copyright 2014 Technical Machine, Inc. See the COPYRIGHT
+// file at the top-level directory of this distribution.
+//
+// Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+// http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+// <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+// option. This file may not be copied, modified, or distributed
+// except according to those terms.
+
+// Generates src/hw/hw_ffi.h, the table of hw_* functions that LuaJIT builds
+// call through the FFI instead of the Lua C API stubs in l_hw.c:
+//
+//   tools/gen_ffi.js > src/hw/hw_ffi.h
+//
+// Signatures are read from src/hw/hw.h. Only functions taking and returning
+// scalars can be bound, since JS buffers are not FFI pointers.
+
+var fs = require('fs');
+var path = require('path');
+
+// hw binding name -> C function. Keep the binding names identical to the
+// l_hw.c ones so tessel.js can use either.
+var bindings = [
+	['sleep_us', 'hw_wait_us'],
+	['sleep_ms', 'hw_wait_ms'],
+	['digital_output', 'hw_digital_output'],
+	['digital_input', 'hw_digital_input'],
+	['digital_write', 'hw_digital_write'],
+	['digital_read', 'hw_digital_read'],
+	['digital_get_mode', 'hw_digital_get_mode'],
+	['digital_set_mode', 'hw_digital_set_mode'],
+	['analog_read', 'hw_analog_read'],
+	['pwm_port_period', 'hw_pwm_port_period'],
+	['pwm_pin_pulsewidth', 'hw_pwm_pin_pulsewidth'],
+	['pwm_group_period', 'hw_pwm_group_period'],
+	['pwm_pin_group', 'hw_pwm_pin_group'],
+	['mcpwm_pulsewidth', 'hw_mcpwm_pulsewidth'],
+	['qei_position', 'hw_qei_position'],
+	['qei_direction', 'hw_qei_direction'],
+	['qei_velocity', 'hw_qei_velocity'],
+	['qei_index', 'hw_qei_index'],
+];
+
+var scalars = ['void', 'int', 'unsigned', 'size_t', 'uint8_t', 'int8_t', 'uint16_t', 'int16_t', 'uint32_t', 'int32_t'];
+
+var header = fs.readFileSync(path.join(__dirname, '../src/hw/hw.h'), 'utf8');
+
+function scalar (decl) {
+	// Drop the parameter name, if any.
+	var type = decl.trim().replace(/\s+/g, ' ').replace(/^(.*?)\s+\w+$/, function (all, type) {
+		return scalars.indexOf(type) >= 0 ? type : all;
+	});
+	if (scalars.indexOf(type) < 0) {
+		throw new Error('not a scalar type: ' + decl.trim());
+	}
+	return type;
+}
+
+var entries = bindings.map(function (binding) {
+	var name = binding[0], fn = binding[1];
+	var match = new RegExp('^\\s*([\\w ]+?)\\s+' + fn + '\\s*\\(([^)]*)\\)\\s*;', 'm').exec(header);
+	if (!match) {
+		throw new Error(fn + ' not found in hw.h');
+	}
+
+	var ret = scalar(match[1]);
+	var args = match[2].trim() == '' || match[2].trim() == 'void' ? [] : match[2].split(',').map(scalar);
+	return {
+		name: name,
+		fn: fn,
+		argc: args.length,
+		signature: ret + ' (*)(' + (args.length ? args.join(', ') : 'void') + ')'
+	};
+});
+
+var out = [];
+out.push('// Generated by tools/gen_ffi.js from hw.h. Do not edit.');
+out.push('');
+out.push('#pragma once');
+out.push('');
+out.push('#include "hw.h"');
+out.push('');
+out.push('typedef struct {');
+out.push('\tconst char* name;');
+out.push('\tconst char* signature;');
+out.push('\tint argc;');
+out.push('\tvoid* fn;');
+out.push('} hw_ffi_entry_t;');
+out.push('');
+out.push('static const hw_ffi_entry_t hw_ffi_entries[] = {');
+entries.forEach(function (entry) {
+	out.push('\t{ "' + entry.name + '", "' + entry.signature + '", ' + entry.argc + ', (void*) ' + entry.fn + ' },');
+});
+out.push('\t{ NULL, NULL, 0, NULL }');
+out.push('};');
+
+console.log(out.join('\n'));
@@ -0,0 +1,78 @@
+#!/usr/bin/env node
+// Copyright 2014 Technical Machine, Inc. See the COPYRIGHT
+// file at the top-level directory of this distribution.
+//
+// Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+// http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+// <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+// option. This file may not be copied, modified, or distributed
+// except according to those terms.
+
+// Converts a logic capture (the payload of an 'L' USB message) into a VCD
+// file for GTKWave, sigrok/PulseView and the like:
+//
+//   tools/logic_vcd.js capture.bin [name ...] > capture.vcd
+//
+// Channels are named after the remaining arguments, in pin order. See
+// src/hw/hw_logic.c for the layout.
+
+var fs = require('fs');
+
+if (process.argv.length < 3) {
+	console.error('usage: logic_vcd.js <capture.bin> [name ...]');
+	process.exit(1);
+}
+
+var dump = fs.readFileSync(process.argv[2]);
+var names = process.argv.slice(3);
+
+var rate = dump.readUInt32LE(0);
+var count = dump.readUInt32LE(4);
+var trigger = dump.readInt32LE(8);
+var width = dump.readUInt32LE(12);
+var channels = names.length || width * 8;
+
+function sample (i) {
+	var offset = 16 + i * width;
+	return width == 1 ? dump.readUInt8(offset)
+		: width == 2 ? dump.readUInt16LE(offset)
+		: dump.readUInt32LE(offset);
+}
+
+// Printable VCD identifiers, one per channel.
+function id (channel) {
+	return String.fromCharCode(33 + channel);
+}
+
+var out = [];
+out.push('$timescale 1 ns $end');
+out.push('$scope module logic $end');
+for (var c = 0; c < channels; c++) {
+	out.push('$var wire 1 ' + id(c) + ' ' + (names[c] || ('pin' + c)) + ' $end');
+}
+out.push('$var event 1 ' + id(channels) + ' trigger $end');
+out.push('$upscope $end');
+out.push('$enddefinitions $end');
+
+var previous = null;
+for (var i = 0; i < count; i++) {
+	var value = sample(i);
+	var lines = [];
+	for (var c = 0; c < channels; c++) {
+		var bit = (value >>> c) & 1;
+		if (previous === null || bit != ((previous >>> c) & 1)) {
+			lines.push(bit + id(c));
+		}
+	}
+	if (i == trigger) {
+		lines.push('1' + id(channels));
+	}
+	if (lines.length) {
+		out.push('#' + Math.round(i * 1e9 / rate));
+		out.push.apply(out, lines);
+	}
+	previous = value;
+}
+out.push('#' + Math.round(count * 1e9 / rate));
+
+console.log(out.join('\n'));
@@ -0,0 +1,103 @@
+#!/usr/bin/env node
+// Copyright 2014 Technical Machine, Inc. See the COPYRIGHT
+// file at the top-level directory of this distribution.
+//
+// Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+// http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+// <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+// option. This file may not be copied, modified, or distributed
+// except according to those terms.
+
+// Symbolizes a PC sampler capture against the firmware ELF and prints
+// folded stacks for flamegraph.pl:
+//
+//   tools/profile_fold.js out/Release/tessel-firmware.elf capture.bin > out.folded
+//
+// The capture is the concatenated payloads of the 's' USB messages, each
+// [dropped] [count] then count (pc, lr) pairs as little-endian words. Only PC
+// and LR are sampled, so each stack is at most caller;function. LR is stale
+// in functions that have already saved it, so treat callers as a hint.
+
+var fs = require('fs');
+var execFile = require('child_process').execFile;
+
+var ADDR2LINE = process.env.ADDR2LINE || 'arm-none-eabi-addr2line';
+
+if (process.argv.length < 4) {
+	console.error('usage: profile_fold.js <firmware.elf> <capture.bin>');
+	process.exit(1);
+}
+
+var elf = process.argv[2];
+var capture = fs.readFileSync(process.argv[3]);
+
+function hex (addr) {
+	return '0x' + addr.toString(16);
+}
+
+// An LR of 0xFFFFFFFx is an exception return, so there is no caller.
+function isExcReturn (lr) {
+	return lr >= 0xFFFFFFF0;
+}
+
+// Return addresses point past the call; step back into it.
+function callSite (lr) {
+	return (lr & ~1) - 1;
+}
+
+var samples = [];
+var dropped = 0;
+var offset = 0;
+while (offset + 8 <= capture.length) {
+	dropped += capture.readUInt32LE(offset);
+	var count = capture.readUInt32LE(offset + 4);
+	offset += 8;
+	for (var i = 0; i < count && offset + 8 <= capture.length; i++) {
+		samples.push({
+			pc: capture.readUInt32LE(offset) & ~1,
+			lr: capture.readUInt32LE(offset + 4)
+		});
+		offset += 8;
+	}
+}
+
+var addrs = {};
+samples.forEach(function (sample) {
+	addrs[hex(sample.pc)] = true;
+	if (!isExcReturn(sample.lr)) {
+		addrs[hex(callSite(sample.lr))] = true;
+	}
+});
+var list = Object.keys(addrs);
+
+execFile(ADDR2LINE, ['-f', '-C', '-e', elf].concat(list), { maxBuffer: 64 * 1024 * 1024 }, function (err, stdout) {
+	if (err) {
+		console.error(err.message);
+		process.exit(1);
+	}
+
+	// addr2line prints a function line and a file:line line per address.
+	var lines = stdout.split('\n');
+	var names = {};
+	list.forEach(function (addr, i) {
+		var name = lines[i * 2];
+		names[addr] = name && name != '??' ? name : addr;
+	});
+
+	var folded = {};
+	samples.forEach(function (sample) {
+		var stack = names[hex(sample.pc)];
+		if (!isExcReturn(sample.lr)) {
+			var caller = names[hex(callSite(sample.lr))];
+			if (caller != stack) {
+				stack = caller + ';' + stack;
+			}
+		}
+		folded[stack] = (folded[stack] || 0) + 1;
+	});
+
+	Object.keys(folded).forEach(function (stack) {
+		console.log(stack + ' ' + folded[stack]);
+	});
+	console.error('# ' + samples.length + ' samples, ' + dropped + ' dropped');
+});
@@ -0,0 +1,78 @@
+#!/usr/bin/env node
+// Copyright 2014 Technical Machine, Inc. See the COPYRIGHT
+// file at the top-level directory of this distribution.
+//
+// Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+// http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+// <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+// option. This file may not be copied, modified, or distributed
+// except according to those terms.
+
+// Converts a span trace dump (the payload of a 't' USB message) into Chrome
+// trace-event JSON, loadable in chrome://tracing:
+//
+//   tools/trace_chrome.js trace.bin > trace.json
+//
+// See src/sys/trace.c for the dump layout.
+
+var fs = require('fs');
+
+if (process.argv.length < 3) {
+	console.error('usage: trace_chrome.js <trace.bin>');
+	process.exit(1);
+}
+
+var dump = fs.readFileSync(process.argv[2]);
+
+var hz = dump.readUInt32LE(0);
+var count = dump.readUInt32LE(4);
+var nameCount = dump.readUInt32LE(8);
+
+var names = [];
+var offset = 12;
+for (var i = 0; i < nameCount; i++) {
+	var end = offset;
+	while (dump[end] !== 0) {
+		end++;
+	}
+	names.push(dump.toString('ascii', offset, end));
+	offset = end + 1;
+}
+offset = (offset + 3) & ~3;
+
+var events = [];
+var open = {};
+var cycles = 0;
+var last = null;
+for (var i = 0; i < count; i++, offset += 8) {
+	var stamp = dump.readUInt32LE(offset);
+	var id = dump.readUInt16LE(offset + 4);
+	var phase = dump.readUInt16LE(offset + 6);
+
+	// CYCCNT wraps every 2^32 cycles; entries are in order, so unwrap deltas.
+	if (last !== null) {
+		cycles += (stamp - last) >>> 0;
+	}
+	last = stamp;
+
+	var name = names[id] || ('span' + id);
+	if (phase === 1) {
+		// The ring may start partway through a span.
+		if (!open[id]) {
+			continue;
+		}
+		open[id]--;
+	} else {
+		open[id] = (open[id] || 0) + 1;
+	}
+
+	events.push({
+		name: name,
+		ph: phase === 1 ? 'E' : 'B',
+		ts: cycles / (hz / 1e6),
+		pid: 0,
+		tid: 0
+	});
+}
+
+console.log(JSON.stringify({ traceEvents: events, displayTimeUnit: 'ns' }));